@@ -0,0 +1 @@
+390975 06c416835da13551 53c7c76c718dc1af
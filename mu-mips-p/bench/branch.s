@@ -0,0 +1,45 @@
+# branch: data-dependent branches on a pseudo-random stream, every branch kind,
+# 10000 iterations, outcome counts in $s1-$s6
+        li $s0, 0x10010000
+        sll $t0, $a0, 20
+        addu $s0, $s0, $t0
+        li $t9, 1103515245
+        addiu $t8, $zero, 12345
+        li $s7, 10000
+        addiu $t7, $zero, 99            # x
+        move $t0, $zero
+br:     multu $t7, $t9
+        mflo $t7
+        addu $t7, $t7, $t8
+        andi $t1, $t7, 1
+        beq $t1, $zero, even
+        addiu $s1, $s1, 1
+        b c2
+even:   addiu $s2, $s2, 1
+c2:     bltz $t7, neg
+        addiu $s3, $s3, 1
+        b c3
+neg:    addiu $s4, $s4, 1
+c3:     andi $t3, $t7, 0x700
+        blez $t3, c4
+        addiu $s5, $s5, 1
+c4:     srl $t4, $t7, 28
+        andi $t4, $t4, 7
+inner:  blez $t4, c5
+        addiu $s6, $s6, 1
+        addiu $t4, $t4, -1
+        b inner
+c5:     bgez $t7, c6
+        andi $t5, $t7, 0x30
+        bgtz $t5, c6
+        addiu $s5, $s5, 100
+c6:     andi $t6, $t7, 0xff
+        sll $t6, $t6, 2
+        addu $t6, $t6, $s0
+        lw $t1, 0($t6)
+        addiu $t1, $t1, 1
+        sw $t1, 0($t6)
+        addiu $t0, $t0, 1
+        bne $t0, $s7, br
+        addiu $v0, $zero, 10
+        syscall
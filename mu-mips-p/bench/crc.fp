@@ -0,0 +1 @@
+264211 9e2147cab017daac 0ecf9e7dd6004163
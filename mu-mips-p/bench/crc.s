@@ -0,0 +1,40 @@
+# crc: bitwise CRC-32 (reflected, poly 0xEDB88320) over a 4KB pseudo-random buffer
+# buffer at base, result in $s1 and at base+0x1000, base = 0x10010000 + ($a0 << 20)
+        li $s0, 0x10010000
+        sll $t0, $a0, 20
+        addu $s0, $s0, $t0
+        li $s5, 0xEDB88320
+        addiu $s7, $s0, 0x1000          # end
+        li $t9, 1664525
+        li $t8, 1013904223
+        addiu $t0, $zero, 1             # seed
+        move $t1, $s0
+fill:   multu $t0, $t9
+        mflo $t0
+        addu $t0, $t0, $t8
+        sw $t0, 0($t1)
+        addiu $t1, $t1, 4
+        bne $t1, $s7, fill
+        nor $s1, $zero, $zero           # crc = ~0
+        move $t1, $s0
+word:   lw $t2, 0($t1)
+        addiu $t3, $zero, 4             # bytes in word
+byte:   andi $t4, $t2, 0xff
+        xor $s1, $s1, $t4
+        srl $t2, $t2, 8
+        addiu $t5, $zero, 8             # bits
+bit:    andi $t6, $s1, 1
+        subu $t6, $zero, $t6
+        and $t6, $t6, $s5
+        srl $s1, $s1, 1
+        xor $s1, $s1, $t6
+        addiu $t5, $t5, -1
+        bgtz $t5, bit
+        addiu $t3, $t3, -1
+        bgtz $t3, byte
+        addiu $t1, $t1, 4
+        bne $t1, $s7, word
+        nor $s1, $s1, $zero
+        sw $s1, 0($s7)
+        addiu $v0, $zero, 10
+        syscall
@@ -0,0 +1 @@
+263612 82d6ab4c70b14441 d1509be0f11ad3ed
@@ -0,0 +1,96 @@
+# dhry: Dhrystone-like mix of record copies, string compares, calls through
+# jal and jalr, multiply/divide and logic, 2000 iterations
+# rec1 at base, rec2 at base+0x40, str1/str2 at base+0x80/0xa0, arr at base+0x100,
+# base = 0x10010000 + ($a0 << 20)
+        li $s0, 0x10010000
+        sll $t0, $a0, 20
+        addu $s0, $s0, $t0
+        move $t0, $zero                 # rec1[k] = 5k + 3, str1 = str2 = k * 0x01010101
+        li $t8, 0x01010101
+        move $t2, $zero
+init:   sll $t1, $t0, 2
+        addu $t1, $t1, $t0
+        addiu $t1, $t1, 3
+        sll $t3, $t0, 2
+        addu $t3, $t3, $s0
+        sw $t1, 0($t3)
+        sw $t2, 0x80($t3)
+        sw $t2, 0xa0($t3)
+        addu $t2, $t2, $t8
+        addiu $t0, $t0, 1
+        addiu $t4, $zero, 8
+        bne $t0, $t4, init
+        la $s6, proc2                   # function pointer
+        move $s1, $zero                 # int_glob
+        move $s2, $zero                 # matching compares
+        addiu $s3, $zero, 1             # run index
+        addiu $s7, $zero, 2001
+loop:   move $t0, $s0                   # rec2 = rec1
+        addiu $t1, $s0, 0x40
+        addiu $t2, $s0, 0x20
+copy:   lw $t3, 0($t0)
+        sw $t3, 0($t1)
+        addiu $t0, $t0, 4
+        addiu $t1, $t1, 4
+        bne $t0, $t2, copy
+        move $a1, $s3
+        jal proc1
+        addu $s1, $s1, $v1
+        andi $t0, $s3, 7                # str2[i & 7] ^= i every 4th run
+        andi $t1, $s3, 3
+        bne $t1, $zero, cmp
+        sll $t0, $t0, 2
+        addu $t0, $t0, $s0
+        lw $t1, 0xa0($t0)
+        xor $t1, $t1, $s3
+        sw $t1, 0xa0($t0)
+cmp:    addiu $t0, $s0, 0x80            # strcmp(str1, str2)
+        addiu $t1, $s0, 0xa0
+        addiu $t2, $s0, 0xa0
+cmp_l:  lw $t3, 0($t0)
+        lw $t4, 0($t1)
+        bne $t3, $t4, differ
+        addiu $t0, $t0, 4
+        addiu $t1, $t1, 4
+        bne $t0, $t2, cmp_l
+        addiu $s2, $s2, 1
+        b after
+differ: sw $t3, 0($t1)                  # repair the first difference
+after:  move $a1, $s1
+        jalr $s6
+        move $s1, $v1
+        andi $t0, $s3, 15               # arr[i & 15] += i
+        sll $t0, $t0, 2
+        addu $t0, $t0, $s0
+        lw $t1, 0x100($t0)
+        addu $t1, $t1, $s3
+        sw $t1, 0x100($t0)
+        addiu $s3, $s3, 1
+        bne $s3, $s7, loop
+        addiu $v0, $zero, 10
+        syscall
+proc1:  lw $t0, 0x44($s0)               # v1 = (rec2[1] * 3 + i) / 7 + (... % 7) with logic
+        addiu $t1, $zero, 3
+        multu $t0, $t1
+        mflo $t0
+        addu $t0, $t0, $a1
+        addiu $t1, $zero, 7
+        divu $t0, $t1
+        mflo $t2
+        mfhi $t3
+        or $t4, $t2, $t3
+        and $t5, $t2, $a1
+        xor $v1, $t4, $t5
+        slti $t6, $t3, 4
+        addu $v1, $v1, $t6
+        sw $v1, 0x44($s0)               # rec1[1] feeds the next run
+        jr $ra
+proc2:  sll $t0, $a1, 3
+        srl $t1, $a1, 5
+        xor $t0, $t0, $t1
+        nor $t1, $a1, $zero
+        and $t1, $t1, $s3
+        addu $v1, $t0, $t1
+        li $t2, 0x7fffffff
+        and $v1, $v1, $t2
+        jr $ra
@@ -0,0 +1 @@
+300014 f1f37919ac112147 820eb5f2a01b73b8
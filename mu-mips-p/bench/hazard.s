@@ -0,0 +1,29 @@
+# hazard: back-to-back load-use, store-to-load, ALU and HI/LO dependence chains,
+# 20000 iterations; data at base, base = 0x10010000 + ($a0 << 20)
+        li $s0, 0x10010000
+        sll $t0, $a0, 20
+        addu $s0, $s0, $t0
+        li $s7, 20000
+        addiu $t1, $zero, 3
+        sw $t1, 0($s0)
+        move $t0, $zero
+        move $s1, $zero
+hz:     lw $t1, 0($s0)
+        addu $t2, $t1, $t0              # load-use
+        sw $t2, 4($s0)
+        lw $t3, 4($s0)                  # store-to-load
+        addu $t3, $t3, $t3              # load-use
+        xor $t4, $t3, $t2
+        or $t5, $t4, $t1
+        andi $t5, $t5, 0xffff
+        mult $t5, $t5
+        mflo $t6
+        addu $s1, $s1, $t6
+        srl $t6, $t6, 4
+        sw $t6, 0($s0)
+        addiu $t0, $t0, 1
+        bne $t0, $s7, hz
+        lw $s2, 0($s0)
+        lw $s3, 4($s0)
+        addiu $v0, $zero, 10
+        syscall
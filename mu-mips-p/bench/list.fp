@@ -0,0 +1 @@
+306309 f7e48f1f4db734d9 5cf24fafa3154a39
@@ -0,0 +1,44 @@
+# list: build a 1024-node singly linked list in scattered order, then walk it
+# 40 times incrementing every value; nodes are {next, value} at base + 8 * idx,
+# idx = (i * 389) & 1023, base = 0x10010000 + ($a0 << 20)
+        li $s0, 0x10010000
+        sll $t0, $a0, 20
+        addu $s0, $s0, $t0
+        addiu $s7, $zero, 1024
+        addiu $s6, $zero, 389
+        move $t0, $zero                 # i
+build:  mult $t0, $s6
+        mflo $t1
+        andi $t1, $t1, 1023
+        sll $t1, $t1, 3
+        addu $t1, $t1, $s0              # node i
+        addiu $t2, $t0, 1
+        mult $t2, $s6
+        mflo $t3
+        andi $t3, $t3, 1023
+        sll $t3, $t3, 3
+        addu $t3, $t3, $s0              # node i + 1
+        bne $t2, $s7, link
+        move $t3, $zero                 # tail
+link:   sw $t3, 0($t1)
+        sll $t4, $t0, 1
+        addu $t4, $t4, $t0
+        addiu $t4, $t4, 1
+        sw $t4, 4($t1)
+        move $t0, $t2
+        bne $t0, $s7, build
+        move $s1, $zero                 # sum
+        move $s2, $zero                 # nodes visited
+        addiu $s3, $zero, 40            # passes
+pass:   move $t0, $s0
+walk:   lw $t1, 4($t0)
+        addiu $t1, $t1, 1
+        sw $t1, 4($t0)
+        addu $s1, $s1, $t1
+        lw $t0, 0($t0)
+        addiu $s2, $s2, 1
+        bne $t0, $zero, walk
+        addiu $s3, $s3, -1
+        bgtz $s3, pass
+        addiu $v0, $zero, 10
+        syscall
@@ -0,0 +1 @@
+324813 1171fcc5fc57cdd8 f06d51c2d6615ed3
@@ -0,0 +1,58 @@
+# matmul: C = A * B for 32x32 word matrices, checksum of C in $s3
+# A at base, B at base+0x1000, C at base+0x2000, base = 0x10010000 + ($a0 << 20)
+        li $s0, 0x10010000
+        sll $t0, $a0, 20
+        addu $s0, $s0, $t0
+        addiu $s7, $zero, 32            # N
+        addiu $s1, $s0, 0x1000          # B
+        addiu $s2, $s0, 0x2000          # C
+        move $t9, $s0
+        move $t0, $zero                 # i
+init_i: move $t1, $zero                 # j
+init_j: sll $t2, $t1, 1                 # A[i][j] = i + 2j + 1
+        addu $t2, $t2, $t0
+        addiu $t2, $t2, 1
+        sw $t2, 0($t9)
+        sll $t3, $t0, 1                 # B[i][j] = 3i - j + 32
+        addu $t3, $t3, $t0
+        subu $t3, $t3, $t1
+        addiu $t3, $t3, 32
+        sw $t3, 0x1000($t9)
+        addiu $t9, $t9, 4
+        addiu $t1, $t1, 1
+        bne $t1, $s7, init_j
+        addiu $t0, $t0, 1
+        bne $t0, $s7, init_i
+        move $s3, $zero
+        move $t0, $zero                 # i
+mm_i:   move $t1, $zero                 # j
+mm_j:   move $t4, $zero
+        mult $t0, $s7
+        mflo $t5
+        sll $t5, $t5, 2
+        addu $t5, $t5, $s0              # &A[i][0]
+        sll $t6, $t1, 2
+        addu $t6, $t6, $s1              # &B[0][j]
+        move $t2, $zero                 # k
+mm_k:   lw $t7, 0($t5)
+        lw $t8, 0($t6)
+        mult $t7, $t8
+        mflo $t7
+        addu $t4, $t4, $t7
+        addiu $t5, $t5, 4
+        addiu $t6, $t6, 128
+        addiu $t2, $t2, 1
+        bne $t2, $s7, mm_k
+        mult $t0, $s7
+        mflo $t3
+        addu $t3, $t3, $t1
+        sll $t3, $t3, 2
+        addu $t3, $t3, $s2
+        sw $t4, 0($t3)
+        addu $s3, $s3, $t4
+        addiu $t1, $t1, 1
+        bne $t1, $s7, mm_j
+        addiu $t0, $t0, 1
+        bne $t0, $s7, mm_i
+        addiu $v0, $zero, 10
+        syscall
@@ -0,0 +1 @@
+262304 5f4b510a7b6fc2bb 737ec38366453c8f
@@ -0,0 +1,45 @@
+# memcpy: copy a 16KB buffer 20 times with a 4x unrolled word loop
+# src at base, dst at base+0x4000, base = 0x10010000 + ($a0 << 20)
+        li $s0, 0x10010000
+        sll $t0, $a0, 20
+        addu $s0, $s0, $t0
+        li $s1, 0x4000
+        addu $s1, $s1, $s0              # dst
+        li $t8, 0x9E3779B1
+        move $t0, $s0
+        move $t1, $s1
+        move $t2, $zero                 # fill value
+fill:   addu $t2, $t2, $t8
+        sw $t2, 0($t0)
+        addiu $t0, $t0, 4
+        bne $t0, $t1, fill
+        addiu $s7, $zero, 20            # rounds
+round:  move $t0, $s0
+        move $t1, $s1
+copy:   lw $t3, 0($t0)
+        lw $t4, 4($t0)
+        lw $t5, 8($t0)
+        lw $t6, 12($t0)
+        sw $t3, 0($t1)
+        sw $t4, 4($t1)
+        sw $t5, 8($t1)
+        sw $t6, 12($t1)
+        addiu $t0, $t0, 16
+        addiu $t1, $t1, 16
+        bne $t0, $s1, copy
+        lw $t3, 0($s0)                  # perturb the source between rounds
+        addiu $t3, $t3, 1
+        sw $t3, 0($s0)
+        addiu $s7, $s7, -1
+        bgtz $s7, round
+        move $t0, $s1                   # checksum dst
+        li $t7, 0x4000
+        addu $t7, $t7, $s1
+        move $s2, $zero
+sum:    lw $t3, 0($t0)
+        sll $s2, $s2, 1
+        xor $s2, $s2, $t3
+        addiu $t0, $t0, 4
+        bne $t0, $t7, sum
+        addiu $v0, $zero, 10
+        syscall
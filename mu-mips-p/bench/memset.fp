@@ -0,0 +1 @@
+246015 757bc032541248d7 ad118f97add03951
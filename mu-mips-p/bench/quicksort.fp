@@ -0,0 +1 @@
+246862 7d1dcfc40adaec66 f2c6a112fb640fee
@@ -0,0 +1,74 @@
+# quicksort: recursive Lomuto sort of 2048 pseudo-random words
+# array at base, stack below base+0x20000, base = 0x10010000 + ($a0 << 20)
+# $s1 = inversions left after sorting (0), $s2 = order-sensitive checksum
+        li $s0, 0x10010000
+        sll $t0, $a0, 20
+        addu $s0, $s0, $t0
+        addiu $s7, $zero, 2048
+        li $t9, 1103515245
+        addiu $t8, $zero, 12345
+        addiu $t0, $zero, 7             # seed
+        move $t1, $s0
+        move $t2, $zero
+fill:   multu $t0, $t9
+        mflo $t0
+        addu $t0, $t0, $t8
+        srl $t3, $t0, 8
+        sw $t3, 0($t1)
+        addiu $t1, $t1, 4
+        addiu $t2, $t2, 1
+        bne $t2, $s7, fill
+        li $t4, 0x20000
+        addu $sp, $s0, $t4
+        move $a1, $s0                   # lo
+        addiu $a2, $s0, 8188            # hi, inclusive
+        jal qsort
+        move $s1, $zero
+        move $s2, $zero
+        move $t1, $s0
+        addiu $t2, $zero, 1
+        lw $t3, 0($t1)
+        move $s2, $t3
+verify: lw $t4, 4($t1)
+        slt $t5, $t4, $t3
+        addu $s1, $s1, $t5
+        sll $s2, $s2, 1
+        xor $s2, $s2, $t4
+        move $t3, $t4
+        addiu $t1, $t1, 4
+        addiu $t2, $t2, 1
+        bne $t2, $s7, verify
+        addiu $v0, $zero, 10
+        syscall
+qsort:  slt $t0, $a1, $a2
+        beq $t0, $zero, qret
+        addiu $sp, $sp, -16
+        sw $ra, 0($sp)
+        sw $a1, 4($sp)
+        sw $a2, 8($sp)
+        lw $t1, 0($a2)                  # pivot
+        addiu $t2, $a1, -4              # i
+        move $t3, $a1                   # j
+part:   lw $t4, 0($t3)
+        slt $t5, $t1, $t4
+        bne $t5, $zero, skip
+        addiu $t2, $t2, 4
+        lw $t6, 0($t2)
+        sw $t4, 0($t2)
+        sw $t6, 0($t3)
+skip:   addiu $t3, $t3, 4
+        bne $t3, $a2, part
+        addiu $t2, $t2, 4
+        lw $t6, 0($t2)
+        sw $t1, 0($t2)
+        sw $t6, 0($a2)
+        sw $t2, 12($sp)
+        addiu $a2, $t2, -4
+        jal qsort
+        lw $t2, 12($sp)
+        addiu $a1, $t2, 4
+        lw $a2, 8($sp)
+        jal qsort
+        lw $ra, 0($sp)
+        addiu $sp, $sp, 16
+qret:   jr $ra
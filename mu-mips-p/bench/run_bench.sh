@@ -0,0 +1,72 @@
+#!/bin/sh
+# Run every benchmark kernel on every execution engine, check the final
+# register and memory state against <kernel>.expect and report host-side
+# simulation speed.
+#
+# usage: run_bench.sh [simulator] [kernel ...]
+# Exits non-zero if any run does not reach its expected state.
+
+BENCH_DIR=$(cd "$(dirname "$0")" && pwd)
+SIM=${1:-$BENCH_DIR/../src/mu-mips}
+[ $# -gt 0 ] && shift
+SIM=$(cd "$(dirname "$SIM")" && pwd)/$(basename "$SIM")
+KERNELS=${*:-"matmul memcpy memset quicksort list crc dhry hazard branch"}
+MAX_CYCLES=20000000
+
+# engine name, command line options, command that dumps context 0
+ENGINES="pipeline:-:tdump_0
+dual:issue=2:tdump_0
+ooo:core=ooo:tdump_0
+trace:core=trace:tdump_0
+interval:core=interval:tdump_0
+mt2:threads=2:tdump_0
+mc2:cores=2:cdump_0"
+
+cd "$BENCH_DIR" || exit 1
+printf "%-10s %-9s %-8s %10s %10s %8s %12s %12s %9s\n" \
+	kernel engine result insts cycles host_s inst/s cycles/s rss_kb
+failed=0
+for kernel in $KERNELS; do
+	for engine in $ENGINES; do
+		name=${engine%%:*}
+		rest=${engine#*:}
+		opts=${rest%%:*}
+		[ "$opts" = "-" ] && opts=
+		dump=$(echo "${rest#*:}" | tr _ ' ')
+		{
+			echo "run $MAX_CYCLES"
+			echo "$dump"
+			awk '$1 == "M" { print "mdump 0x" $2 " 0x" $2 }' "$kernel.expect"
+			echo "stats"
+			echo "quit"
+		} | "$SIM" "$kernel.in" verbose=0 $opts 2>&1 | awk -v expect="$kernel.expect" \
+			-v kernel="$kernel" -v engine="$name" '
+			/^\[R[0-9]+\]/ { reg = substr($1, 3, length($1) - 3); got["R" reg] = tolower(substr($3, 3)) }
+			/^\t0x[0-9a-f]+ \(/ { got["M" substr($1, 3)] = tolower(substr($4, 3)) }
+			/^# Instructions Executed/ { insts = $NF }
+			/^# Cycles Executed/ { cycles = $NF }
+			/^Host Seconds/ { secs = $NF }
+			/^Sim Instructions\/sec/ { ips = $NF }
+			/^Sim Cycles\/sec/ { cps = $NF }
+			/^Peak RSS/ { rss = $NF }
+			END {
+				result = "MATCH"
+				while ((getline line < expect) > 0) {
+					split(line, f, " ")
+					key = (f[1] == "M") ? "M" f[2] : f[1]
+					want = (f[1] == "M") ? f[3] : f[2]
+					if (got[key] != want) {
+						if (result == "MATCH")
+							mismatch = key " got " (key in got ? got[key] : "none") " want " want
+						result = "MISMATCH"
+					}
+				}
+				printf "%-10s %-9s %-8s %10s %10s %8s %12s %12s %9s\n", kernel, engine, result,
+					insts, cycles, secs, ips, cps, rss
+				if (result != "MATCH")
+					printf "    %s\n", mismatch
+				exit result != "MATCH"
+			}' || failed=1
+	done
+done
+exit $failed
@@ -0,0 +1,106 @@
+#!/bin/sh
+# Regression run: every <program>.in in a directory, on every engine, in
+# parallel. Each run is reduced to a fingerprint (commits, a hash of the
+# committed-instruction stream and a hash of the final registers and touched
+# memory) and compared with <program>.fp, which the functional engine writes
+# with -u. A program that mismatches is re-run alone with a commit log on the
+# failing engine and on the functional engine to find the first divergent
+# commit.
+#
+# usage: run_regress.sh [-u] [-j jobs] [simulator] [dir]
+# Exits non-zero if any run does not match its fingerprint.
+
+UPDATE=0
+JOBS=$(nproc 2>/dev/null || echo 1)
+while [ $# -gt 0 ]; do
+	case "$1" in
+		-u) UPDATE=1; shift ;;
+		-j) JOBS=$2; shift 2 ;;
+		*) break ;;
+	esac
+done
+BENCH_DIR=$(cd "$(dirname "$0")" && pwd)
+SIM=${1:-$BENCH_DIR/../src/mu-mips}
+SIM=$(cd "$(dirname "$SIM")" && pwd)/$(basename "$SIM")
+DIR=$(cd "${2:-$BENCH_DIR}" && pwd)
+MAX_CYCLES=20000000
+
+# engine name:command line options, single-thread engines that commit values
+ENGINES="pipeline:-
+dual:issue=2
+ooo:core=ooo
+fetchq:fetch_queue=8
+memsys:dcache=8_store_buffer=4_prefetch=stride"
+
+# fingerprint <program> <options|-> <command>, prints "<commits> <commit hash> <state hash>"
+fingerprint() {
+	opts=$(echo "$2" | tr _ ' ')
+	[ "$opts" = "-" ] && opts=
+	printf '%s\nfingerprint\nquit\n' "$3" | "$SIM" "$1.in" verbose=0 fingerprint=1 $opts 2>&1 |
+		awk '/Fingerprint\t/ { print $(NF-2), $(NF-1), $NF }'
+}
+
+cd "$DIR" || exit 1
+PROGRAMS=$(ls *.in 2>/dev/null | sed 's/\.in$//')
+if [ -z "$PROGRAMS" ]; then
+	echo "No programs in $DIR"
+	exit 1
+fi
+
+if [ $UPDATE -eq 1 ]; then
+	for p in $PROGRAMS; do
+		fingerprint "$p" - "func 0" > "$p.fp"
+		echo "$p.fp: $(cat "$p.fp")"
+	done
+	exit 0
+fi
+
+# one job per program and engine, JOBS at a time
+export SIM MAX_CYCLES
+RESULTS=$(for p in $PROGRAMS; do
+	for engine in $ENGINES; do
+		echo "$p ${engine%%:*} ${engine#*:}"
+	done
+done | xargs -P "$JOBS" -n 3 sh -c '
+	opts=$(echo "$2" | tr _ " ")
+	[ "$opts" = "-" ] && opts=
+	got=$(printf "run %s\nfingerprint\nquit\n" "$MAX_CYCLES" | "$SIM" "$0.in" verbose=0 fingerprint=1 $opts 2>&1 |
+		awk "/Fingerprint\t/ { print \$(NF-2), \$(NF-1), \$NF }")
+	want=$(cat "$0.fp" 2>/dev/null)
+	if [ -z "$want" ]; then
+		result=NOFP
+	elif [ "$got" = "$want" ]; then
+		result=MATCH
+	else
+		result=MISMATCH
+	fi
+	echo "$0 $1 $2 $result $got"
+' | sort)
+
+printf "%-10s %-9s %-8s %10s %16s %16s\n" program engine result commits commit_hash state_hash
+echo "$RESULTS" | while read p engine opts result commits chash shash; do
+	printf "%-10s %-9s %-8s %10s %16s %16s\n" "$p" "$engine" "$result" "$commits" "$chash" "$shash"
+done
+TMP=$(mktemp -d)
+echo "$RESULTS" | while read p engine opts result rest; do
+	[ "$result" = MATCH ] && continue
+	[ "$result" = NOFP ] && { echo "$p: no $p.fp, run with -u"; continue; }
+	o=$(echo "$opts" | tr _ ' ')
+	[ "$o" = "-" ] && o=
+	printf 'func 0\nquit\n' | "$SIM" "$p.in" verbose=0 commit_log="$TMP/ref" > /dev/null 2>&1
+	printf 'run %s\nquit\n' "$MAX_CYCLES" | "$SIM" "$p.in" verbose=0 commit_log="$TMP/got" $o > /dev/null 2>&1
+	diff=$(cmp "$TMP/ref" "$TMP/got" 2>&1)
+	if [ -z "$diff" ]; then
+		echo "$p on $engine: same commits, the final state differs (HI/LO or memory outside the commit stream)"
+	elif echo "$diff" | grep -q EOF; then
+		echo "$p on $engine: $(wc -l < "$TMP/got") commits, the functional engine made $(wc -l < "$TMP/ref")"
+	else
+		line=$(echo "$diff" | awk '{ print $NF }')
+		echo "$p on $engine: first divergent commit #$line (pc dest value addr word)"
+		echo "    want $(sed -n "${line}p" "$TMP/ref")"
+		echo "    got  $(sed -n "${line}p" "$TMP/got")"
+	fi
+done
+rm -rf "$TMP"
+echo "$RESULTS" | grep -qv " MATCH " && exit 1
+exit 0
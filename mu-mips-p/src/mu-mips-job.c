@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/***************************************************************/
+/* mu-mips-job: send one job to a simulator serving jobs                  */
+/* (daemon <socket> <workers>). The commands on stdin go to the job   */
+/* and its output is copied to stdout as it arrives, e.g.                  */
+/*   printf 'run 1000000\nstats\nquit\n' | mu-mips-job sim.sock p.in core=ooo */
+/***************************************************************/
+#define LINE_SIZE 1024
+#define BUF_SIZE 4096
+
+/***************************************************************/
+/* Connect to the server's socket, -1 if nothing listens there           */
+/***************************************************************/
+int connect_server(const char *path)
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	if (strlen(path) >= sizeof(addr.sun_path)){
+		return -1;
+	}
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0){
+		return -1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0){
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/***************************************************************/
+/* Write all of buf, 0 if the other end went away                         */
+/***************************************************************/
+int write_all(int fd, const char *buf, size_t len)
+{
+	ssize_t n;
+
+	while (len > 0){
+		n = write(fd, buf, len);
+		if (n <= 0){
+			return 0;
+		}
+		buf += n;
+		len -= n;
+	}
+	return 1;
+}
+
+/***************************************************************/
+/* main                                                                                                                                   */
+/***************************************************************/
+int main(int argc, char *argv[])
+{
+	char line[LINE_SIZE], path[PATH_MAX], buf[BUF_SIZE];
+	struct pollfd fds[2];
+	int fd, i, len;
+	ssize_t n;
+
+	if (argc == 3 && strcmp(argv[2], "-s") == 0){
+		snprintf(line, sizeof(line), "shutdown\n");
+	}
+	else if (argc >= 3){
+		if (realpath(argv[2], path) == NULL){	//The server may run elsewhere
+			printf("Error: Can't find program file %s\n", argv[2]);
+			return 1;
+		}
+		len = snprintf(line, sizeof(line), "job %s", path);
+		for (i = 3; i < argc && len < sizeof(line); i++){
+			len += snprintf(line + len, sizeof(line) - len, " %s", argv[i]);
+		}
+		if (len >= sizeof(line) - 1){
+			printf("Error: job line longer than %d bytes\n", LINE_SIZE - 2);
+			return 1;
+		}
+		strcat(line, "\n");
+	}
+	else{
+		printf("Usage: %s <socket> <program> [<option>=<val> ...] < commands\n", argv[0]);
+		printf("       %s <socket> -s\n", argv[0]);
+		printf("\toptions are simulator options, and seconds=<n> to limit the job's wall clock time\n");
+		printf("\t-s\tstop the server once its running jobs finish\n");
+		return 1;
+	}
+	fd = connect_server(argv[1]);
+	if (fd < 0){
+		printf("Error: no server on %s\n", argv[1]);
+		return 1;
+	}
+	if (!write_all(fd, line, strlen(line))){
+		printf("Error: server closed the connection\n");
+		return 1;
+	}
+
+	fds[0].fd = STDIN_FILENO;
+	fds[0].events = POLLIN;
+	fds[1].fd = fd;
+	fds[1].events = POLLIN;
+	if (line[0] == 's'){
+		fds[0].fd = -1;	//Nothing to send after shutdown
+	}
+	while (1){
+		if (poll(fds, 2, -1) < 0){
+			break;
+		}
+		if (fds[0].revents){
+			n = read(STDIN_FILENO, buf, sizeof(buf));
+			if (n <= 0 || !write_all(fd, buf, n)){
+				shutdown(fd, SHUT_WR);	//The job sees the end of its commands
+				fds[0].fd = -1;
+			}
+		}
+		if (fds[1].revents){
+			n = read(fd, buf, sizeof(buf));
+			if (n <= 0){
+				break;	//Job finished
+			}
+			if (!write_all(STDOUT_FILENO, buf, n)){
+				break;
+			}
+		}
+	}
+	close(fd);
+	return 0;
+}
@@ -0,0 +1,33 @@
+#include <stdint.h>
+#include <stdatomic.h>
+
+/***************************************************************/
+/* Live counters the simulator publishes in POSIX shared memory     */
+/* (set stats_shm 1) and mu-mips-top reads. The page is a seqlock:   */
+/* the writer makes seq odd, updates the fields and makes it even    */
+/* again; a reader retries until it sees the same even seq on both  */
+/* sides of its copy.                                                                               */
+/***************************************************************/
+#define STATS_SHM_PREFIX "mu-mips."	/* page name is /mu-mips.<pid> */
+#define STATS_MAGIC 0x4D495053
+
+#define STATS_IDLE 0	/* loaded, not run yet */
+#define STATS_RUNNING 1
+#define STATS_PAUSED 2	/* run <n> returned */
+#define STATS_HALTED 3	/* program exited */
+
+typedef struct Stats_Page_Struct {
+	uint32_t magic;
+	_Atomic uint32_t seq;
+	int32_t pid;
+	uint32_t state;
+	uint32_t pc;
+	uint32_t core_model, issue_width, threads, cores;
+	uint64_t cycles;
+	uint64_t instructions;
+	uint64_t hazard_stalls;	/* ID held for a load-use hazard */
+	uint64_t mem_stalls;	/* pipeline frozen on a cache or TLB miss */
+	uint64_t flush_cycles;	/* fetch slots squashed behind taken branches */
+	double host_seconds;
+	char program[32];
+} Stats_Page;
@@ -0,0 +1,193 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <dirent.h>
+#include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "mu-mips-stats.h"
+
+/***************************************************************/
+/* mu-mips-top: watch every simulator that publishes its counters */
+/* (set stats_shm 1). Pages are mapped read-only and copied under */
+/* their seqlock, so the simulators never wait on a reader.            */
+/***************************************************************/
+#define MAX_SIMS 1024
+#define SHM_DIR "/dev/shm"
+
+typedef struct Sim_Entry_Struct {
+	char name[64];
+	Stats_Page last;	/* snapshot of the previous refresh */
+	int seen;
+} Sim_Entry;
+
+Sim_Entry SIMS[MAX_SIMS];
+int NUM_SIMS;
+
+/***************************************************************/
+/* Copy a consistent snapshot of a page, FALSE if the writer kept it busy */
+/***************************************************************/
+int read_page(const Stats_Page *page, Stats_Page *copy)
+{
+	uint32_t before, after;
+	int tries;
+
+	for (tries = 0; tries < 1000; tries++){
+		before = atomic_load_explicit(&page->seq, memory_order_acquire);
+		if (before & 1){
+			continue;	//Writer is in the middle of an update
+		}
+		memcpy(copy, (const void *)page, sizeof(Stats_Page));
+		atomic_thread_fence(memory_order_acquire);
+		after = atomic_load_explicit(&page->seq, memory_order_relaxed);
+		if (before == after){
+			return copy->magic == STATS_MAGIC;
+		}
+	}
+	return 0;
+}
+
+/***************************************************************/
+/* Map one page by name and take a snapshot of it                            */
+/***************************************************************/
+int snapshot(const char *name, Stats_Page *copy)
+{
+	char path[80];
+	Stats_Page *page;
+	int fd, ok;
+
+	snprintf(path, sizeof(path), "/%s", name);
+	fd = shm_open(path, O_RDONLY, 0);
+	if (fd < 0){
+		return 0;
+	}
+	page = mmap(NULL, sizeof(Stats_Page), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (page == MAP_FAILED){
+		return 0;
+	}
+	ok = read_page(page, copy);
+	munmap(page, sizeof(Stats_Page));
+	return ok;
+}
+
+/***************************************************************/
+/* Find the entry of the previous refresh for a page                          */
+/***************************************************************/
+Sim_Entry *find_sim(const char *name)
+{
+	int i;
+
+	for (i = 0; i < NUM_SIMS; i++){
+		if (strcmp(SIMS[i].name, name) == 0){
+			return &SIMS[i];
+		}
+	}
+	if (NUM_SIMS == MAX_SIMS){
+		return NULL;
+	}
+	memset(&SIMS[NUM_SIMS], 0, sizeof(Sim_Entry));
+	snprintf(SIMS[NUM_SIMS].name, sizeof(SIMS[NUM_SIMS].name), "%s", name);
+	return &SIMS[NUM_SIMS++];
+}
+
+/***************************************************************/
+/* Print one line per simulator                                                             */
+/***************************************************************/
+void refresh(double interval)
+{
+	char *states[] = { "idle", "run", "pause", "halt" };
+	char engine[32];
+	struct dirent *ent;
+	Stats_Page now;
+	Sim_Entry *sim;
+	DIR *dir;
+	double cpi, rate;
+	int alive;
+
+	printf("%-7s %-5s %-14s %-24s %12s %12s %6s %6s %6s %6s %10s %12s\n", "PID", "STATE", "ENGINE",
+		"PROGRAM", "CYCLES", "INSTS", "CPI", "HAZ%", "MEM%", "FLUSH%", "PC", "CYCLES/S");
+	dir = opendir(SHM_DIR);
+	if (dir == NULL){
+		printf("Error: Can't open %s\n", SHM_DIR);
+		return;
+	}
+	while ((ent = readdir(dir)) != NULL){
+		if (strncmp(ent->d_name, STATS_SHM_PREFIX, strlen(STATS_SHM_PREFIX)) != 0){
+			continue;
+		}
+		if (!snapshot(ent->d_name, &now) || (sim = find_sim(ent->d_name)) == NULL){
+			continue;
+		}
+		alive = kill(now.pid, 0) == 0 || errno != ESRCH;
+		if (now.core_model == 1){
+			snprintf(engine, sizeof(engine), "ooo");
+		}
+		else if (now.core_model == 2){
+			snprintf(engine, sizeof(engine), "trace");
+		}
+		else if (now.core_model == 3){
+			snprintf(engine, sizeof(engine), "interval");
+		}
+		else if (now.cores > 1){
+			snprintf(engine, sizeof(engine), "%u cores", now.cores);
+		}
+		else if (now.threads > 1){
+			snprintf(engine, sizeof(engine), "%u threads", now.threads);
+		}
+		else{
+			snprintf(engine, sizeof(engine), "pipe x%u", now.issue_width);
+		}
+		cpi = now.instructions ? (double)now.cycles / now.instructions : 0.0;
+		rate = sim->seen && interval > 0 ? (now.cycles - sim->last.cycles) / interval : 0.0;
+		printf("%-7d %-5s %-14.14s %-24.24s %12llu %12llu %6.2f %6.1f %6.1f %6.1f 0x%08x %12.0f\n",
+			now.pid, alive ? states[now.state & 3] : "gone", engine, now.program,
+			(unsigned long long)now.cycles, (unsigned long long)now.instructions, cpi,
+			now.cycles ? 100.0 * now.hazard_stalls / now.cycles : 0.0,
+			now.cycles ? 100.0 * now.mem_stalls / now.cycles : 0.0,
+			now.cycles ? 100.0 * now.flush_cycles / now.cycles : 0.0,
+			now.pc, rate);
+		sim->last = now;
+		sim->seen = 1;
+	}
+	closedir(dir);
+}
+
+/***************************************************************/
+/* main                                                                                                                                   */
+/***************************************************************/
+int main(int argc, char *argv[])
+{
+	double interval = 1.0;
+	int once = 0, i;
+
+	for (i = 1; i < argc; i++){
+		if (strcmp(argv[i], "-1") == 0){
+			once = 1;
+		}
+		else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc){
+			interval = atof(argv[++i]);
+		}
+		else{
+			printf("Usage: %s [-1] [-d <seconds>]\n", argv[0]);
+			printf("\t-1\tprint one snapshot and exit\n");
+			printf("\t-d\tseconds between refreshes (default 1)\n");
+			return 1;
+		}
+	}
+	if (once){
+		refresh(0);
+		return 0;
+	}
+	while (1){
+		printf("\033[H\033[J");	//Clear the terminal
+		refresh(interval);
+		fflush(stdout);
+		usleep((useconds_t)(interval * 1000000));
+	}
+	return 0;
+}
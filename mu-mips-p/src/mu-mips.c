@@ -1,12 +1,31 @@
 #include <stdio.h>
+#include <stdio_ext.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 #include <stdint.h>
 #include <assert.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+#include <signal.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
 
 #include "mu-mips.h"
 
-int stall = 0;
+SIM_TLS int stall = 0;
 
 /***************************************************************/
 /* Print out a list of commands available                                                                  */
@@ -24,6 +43,41 @@ void help() {
 	printf("low <val>\t-- set the LO register to <val>\n");
 	printf("print\t-- print the program loaded into memory\n");
 	printf("show\t-- print the current content of the pipeline registers\n");
+	printf("func <n>\t-- run <n> instructions (0 for all) on the functional engine (before the first cycle)\n");
+	printf("fingerprint\t-- print commits, commit hash and state hash (set fingerprint 1)\n");
+	printf("gdb <port>\t-- wait for gdb on 127.0.0.1:<port> and run under it (before the first cycle)\n");
+	printf("daemon <socket> <n>\t-- serve jobs on a Unix socket, <n> at a time, with these options (see mu-mips-job)\n");
+	printf("set <option> <val>\t-- set a simulator option before the first cycle:\n");
+	printf("\tcore pipeline|ooo|trace|interval, issue 1|2, threads <n>, fetch rr|stall|icount,\n");
+	printf("\trob, rs, lsq, ooo_width, muldiv_lat, mem_lat <n> (ooo core),\n");
+	printf("\tcores, quantum <n> (multicore), dcache <KB>, dcache_assoc, dcache_line, miss_lat <n>,\n");
+	printf("\tstore_buffer <n> (entries, 0 for none),\n");
+	printf("\tprefetch none|next|stride|stream, prefetch_degree, prefetch_distance <n> (needs dcache),\n");
+	printf("\tfetch_queue <n> (0 for none), fetch_width <n>, icache <KB> (decoupled front end),\n");
+	printf("\tfingerprint 0|1, commit_log <file|-> (hash or log every committed instruction),\n");
+	printf("\tlockstep 0|1 (check every commit against the functional engine, stop at the first difference),\n");
+	printf("\tconsole_in <file|-> (bytes programs read from the console at 0x%08x),\n", MMIO_RX_DATA);
+	printf("\tif_stages, ex_stages, mem_stages <n> (depth of the fetch, execute and memory stages),\n");
+	printf("\tstack_dist 0|1, sd_window <n> (miss ratio of every cache size and working set per <n> cycles, pipeline core),\n");
+	printf("\tmmu off|hw|sw, itlb, dtlb, tlb_assoc, tlb_lat <n> (pipeline core),\n");
+	printf("\thost_pipe 0|1 (run MEM on a second host thread, experimental),\n");
+	printf("\ttrace_in <file|->, trace_out <file|-> (trace core, - runs the program in process),\n");
+	printf("\tverbose 0|1, stats_shm 0|1, stats_every <n>, batch_simd auto|scalar|sse2|avx2,\n");
+	printf("\tskip 0|1 (credit idle loops and miss stalls in bulk), cycle_limit <n> (0 for none),\n");
+	printf("\tconsole_out <file|-> (where programs' console output goes, - for stdout)\n");
+	printf("\tsd_out <file|-> (where stats writes the stack distance curves and working set series)\n");
+	printf("\tdin_out, branch_out <file|-> (Dinero din and binary branch traces from here on, .gz compresses)\n");
+	printf("\t(these may be changed at any time)\n");
+	printf("stats\t-- print performance counters\n");
+	printf("profile\t-- print host time per pipeline stage (make prof builds)\n");
+	printf("thread <t> <file>\t-- run a separate program on hardware thread <t>\n");
+	printf("treg <t> <reg> <val>\t-- set GPR <reg> of hardware thread <t> to <val>\n");
+	printf("tdump <t>\t-- dump register values of hardware thread <t>\n");
+	printf("cdump <c>\t-- dump register values of core <c>\n");
+	printf("batch <k> <file|->\t-- run <k> instances of the program, line l of <file> sets lane l: <reg>=<val> ...\n");
+	printf("\t\t(a lane stops after cycle_limit instructions, %d without one)\n", BATCH_INST_LIMIT);
+	printf("bdump <l>\t-- dump register values of batch lane <l>\n");
+	printf("simpoint <n> <k> <file|->\t-- split the run into <n>-instruction intervals, simulate one per phase (at most <k>) and estimate CPI, write the points to <file>\n");
 	printf("?\t-- display help menu\n");
 	printf("quit\t-- exit the simulator\n\n");
 	printf("------------------------------------------------------------------\n\n");
@@ -35,16 +89,29 @@ void help() {
 uint32_t mem_read_32(uint32_t address)
 {
 	int i;
+	uint32_t value = 0;
+#ifdef STAGE_PROF
+	uint64_t prof_start = PROF_ON ? prof_ticks() : 0;
+#endif
+	if (address >= MMIO_BEGIN){
+		return mmio_read(address);
+	}
 	for (i = 0; i < NUM_MEM_REGION; i++) {
 		if ( (address >= MEM_REGIONS[i].begin) &&  ( address <= MEM_REGIONS[i].end) ) {
 			uint32_t offset = address - MEM_REGIONS[i].begin;
-			return (MEM_REGIONS[i].mem[offset+3] << 24) |
+			value = (MEM_REGIONS[i].mem[offset+3] << 24) |
 					(MEM_REGIONS[i].mem[offset+2] << 16) |
 					(MEM_REGIONS[i].mem[offset+1] <<  8) |
 					(MEM_REGIONS[i].mem[offset+0] <<  0);
+			break;
 		}
 	}
-	return 0;
+#ifdef STAGE_PROF
+	if (PROF_ON){
+		prof_record(PROF_MEM_READ, prof_ticks() - prof_start);
+	}
+#endif
+	return value;
 }
 
 /***************************************************************/
@@ -54,25 +121,141 @@ void mem_write_32(uint32_t address, uint32_t value)
 {
 	int i;
 	uint32_t offset;
+#ifdef STAGE_PROF
+	uint64_t prof_start = PROF_ON ? prof_ticks() : 0;
+#endif
+	if (address >= MMIO_BEGIN){
+		mmio_write(address, value);
+		return;
+	}
 	for (i = 0; i < NUM_MEM_REGION; i++) {
 		if ( (address >= MEM_REGIONS[i].begin) && (address <= MEM_REGIONS[i].end) ) {
 			offset = address - MEM_REGIONS[i].begin;
-
+			MEM_DIRTY[address >> MEM_PAGE_SHIFT] = 1;
+			MEM_WRITES++;
 			MEM_REGIONS[i].mem[offset+3] = (value >> 24) & 0xFF;
 			MEM_REGIONS[i].mem[offset+2] = (value >> 16) & 0xFF;
 			MEM_REGIONS[i].mem[offset+1] = (value >>  8) & 0xFF;
 			MEM_REGIONS[i].mem[offset+0] = (value >>  0) & 0xFF;
 		}
 	}
+#ifdef STAGE_PROF
+	if (PROF_ON){
+		prof_record(PROF_MEM_WRITE, prof_ticks() - prof_start);
+	}
+#endif
 }
 
 /***************************************************************/
 /* Execute one cycle                                                                                                              */
 /***************************************************************/
 void cycle() {                                                
-	handle_pipeline();
+#ifdef STAGE_PROF
+	PROF_ON = MC_CORES == 1 && CYCLE_COUNT % PROF_SAMPLE_PERIOD == 0;	//Core threads would race on PROF
+#endif
+	if (CORE_MODEL == CORE_OOO){
+		ooo_cycle();
+	}
+	else if (CORE_MODEL == CORE_TRACE){
+		trace_cycle();
+	}
+	else{
+		handle_pipeline();
+	}
 	CURRENT_STATE = NEXT_STATE;
 	CYCLE_COUNT++;
+	if (STATS_PAGE != NULL && CYCLE_COUNT % STATS_EVERY == 0){
+		stats_publish(STATS_RUNNING);
+	}
+}
+
+/***************************************************************/
+/* Credit up to budget cycles the pipeline would spend without any       */
+/* effect, returns how many. Called after each cycle of the pipeline core.  */
+/***************************************************************/
+uint32_t cycle_skip(uint32_t budget)
+{
+	uint32_t n, period, m, i;
+	
+	if (!SKIP_IDLE || VERBOSE || budget == 0 || !RUN_FLAG || CORE_MODEL != CORE_PIPELINE){
+		return 0;
+	}
+	if (mem_stall > 0){	//Frozen on a miss, every cycle up to the refill is the same
+		n = (uint32_t)mem_stall < budget ? (uint32_t)mem_stall : budget;
+		for (i = 0; i < n && SB_ENTRIES > 0 && (SB_BUSY > 0 || SB_COUNT > 0); i++){
+			sb_tick();	//The store buffer keeps draining
+		}
+		for (i = 0; i < n && IQ_ENTRIES > 0; i++){
+			fe_fetch();	//and the front end keeps fetching
+			BE_BOUND_CYCLES++;
+		}
+		mem_stall -= n;
+		MEM_STALL_CYCLES += n;
+		CYCLE_COUNT += n;
+		SKIPPED_CYCLES += n;
+		return n;
+	}
+	if (LOOP_EDGE == 0 || ISSUE_WIDTH > 1 || NUM_THREADS > 1 || MMU_MODE != MMU_OFF || SB_COUNT > 0 || SB_BUSY > 0 ||
+		PF_MODE != PF_NONE || IQ_ENTRIES > 0 || FINGERPRINT || LOCKSTEP || PIPE_DEEP || STACK_DIST ||
+		DIN_OUT.fp != NULL || BRANCH_OUT.fp != NULL){	//Those see every commit or access
+		LOOP_EDGE = 0;
+		return 0;
+	}
+	if (LOOP_EDGE == LOOP.target && MEM_WRITES == LOOP.writes && MEM_STALL_CYCLES == LOOP.mem_stalls &&
+		DCACHE->misses + DCACHE->upgrades == LOOP.dcache_misses &&
+		stall == LOOP.stall && EXIT_PENDING == LOOP.exit_pending &&
+		memcmp(&CURRENT_STATE, &LOOP.state, sizeof(CPU_State)) == 0 &&
+		memcmp(&IF_ID, &LOOP.if_id, sizeof(CPU_Pipeline_Reg)) == 0 &&
+		memcmp(&ID_EX, &LOOP.id_ex, sizeof(CPU_Pipeline_Reg)) == 0 &&
+		memcmp(&EX_MEM, &LOOP.ex_mem, sizeof(CPU_Pipeline_Reg)) == 0 &&
+		memcmp(&MEM_WB, &LOOP.mem_wb, sizeof(CPU_Pipeline_Reg)) == 0){
+		/* the last iteration changed nothing, the next ones will not either */
+		period = CYCLE_COUNT - LOOP.cycles;
+		m = budget / period;
+		CYCLE_COUNT += m * period;
+		INSTRUCTION_COUNT += m * (INSTRUCTION_COUNT - LOOP.instructions);
+		HAZARD_STALL_CYCLES += m * (HAZARD_STALL_CYCLES - LOOP.hazard_stalls);
+		FLUSH_CYCLES += m * (FLUSH_CYCLES - LOOP.flush_cycles);
+		DCACHE->hits += m * (DCACHE->hits - LOOP.dcache_hits);
+		DCACHE->clock += m * (DCACHE->clock - LOOP.dcache_clock);	//Lines the loop touches stay the newest
+		SKIPPED_CYCLES += m * period;
+		n = m * period;
+	}
+	else{
+		n = 0;
+		LOOP.target = LOOP_EDGE;
+		LOOP.state = CURRENT_STATE;
+		LOOP.if_id = IF_ID;
+		LOOP.id_ex = ID_EX;
+		LOOP.ex_mem = EX_MEM;
+		LOOP.mem_wb = MEM_WB;
+		LOOP.stall = stall;
+		LOOP.exit_pending = EXIT_PENDING;
+		LOOP.writes = MEM_WRITES;
+		LOOP.mem_stalls = MEM_STALL_CYCLES;
+		LOOP.dcache_misses = DCACHE->misses + DCACHE->upgrades;
+	}
+	LOOP.cycles = CYCLE_COUNT;
+	LOOP.instructions = INSTRUCTION_COUNT;
+	LOOP.hazard_stalls = HAZARD_STALL_CYCLES;
+	LOOP.flush_cycles = FLUSH_CYCLES;
+	LOOP.dcache_hits = DCACHE->hits;
+	LOOP.dcache_clock = DCACHE->clock;
+	LOOP_EDGE = 0;
+	return n;
+}
+
+/***************************************************************/
+/* Cycles a run may take before cycle_limit stops it                                            */
+/***************************************************************/
+uint32_t limit_cycles(uint32_t budget) {
+	if (CYCLE_LIMIT == 0){
+		return budget;
+	}
+	if (CYCLE_COUNT >= CYCLE_LIMIT){
+		return 0;
+	}
+	return budget < CYCLE_LIMIT - CYCLE_COUNT ? budget : CYCLE_LIMIT - CYCLE_COUNT;
 }
 
 /***************************************************************/
@@ -84,30 +267,78 @@ void run(int num_cycles) {
 		printf("Simulation Stopped\n\n");
 		return;
 	}
+	if (limit_cycles(num_cycles) == 0) {
+		printf("Cycle limit reached.\n\n");
+		return;
+	}
+	num_cycles = limit_cycles(num_cycles);
 
 	printf("Running simulator for %d cycles...\n\n", num_cycles);
-	int i;
-	for (i = 0; i < num_cycles; i++) {
-		if (RUN_FLAG == FALSE) {
+	double start = host_time();
+	stats_publish(STATS_RUNNING);
+	if (MC_CORES > 1){
+		mc_run(num_cycles);
+	}
+	else if (CORE_MODEL == CORE_INTERVAL){
+		interval_run(num_cycles);
+		if (RUN_FLAG == FALSE){
 			printf("Simulation Stopped.\n\n");
-			break;
 		}
-		cycle();
 	}
+	else{
+		int i;
+		for (i = 0; i < num_cycles; i++) {
+			if (RUN_FLAG == FALSE) {
+				printf("Simulation Stopped.\n\n");
+				break;
+			}
+			cycle();
+			i += cycle_skip(num_cycles - i - 1);
+		}
+	}
+	pipe_stop();
+	console_flush();
+	export_flush(&DIN_OUT);
+	export_flush(&BRANCH_OUT);
+	HOST_SECONDS += host_time() - start;
+	stats_publish(RUN_FLAG ? STATS_PAUSED : STATS_HALTED);
 }
 
 /***************************************************************/
 /* simulate to completion                                                                                               */
 /***************************************************************/
 void runAll() {                                                     
+	uint32_t budget = limit_cycles(0xFFFFFFFF);
+	
 	if (RUN_FLAG == FALSE) {
 		printf("Simulation Stopped.\n\n");
 		return;
 	}
 
 	printf("Simulation Started...\n\n");
-	while (RUN_FLAG){
-		cycle();
+	double start = host_time();
+	stats_publish(STATS_RUNNING);
+	if (MC_CORES > 1){
+		mc_run(budget);
+	}
+	else if (CORE_MODEL == CORE_INTERVAL){
+		interval_run(budget);
+	}
+	else{
+		while (RUN_FLAG && budget > 0){
+			cycle();
+			budget -= 1 + cycle_skip(budget - 1);
+		}
+	}
+	pipe_stop();
+	console_flush();
+	export_flush(&DIN_OUT);
+	export_flush(&BRANCH_OUT);
+	HOST_SECONDS += host_time() - start;
+	stats_publish(RUN_FLAG ? STATS_PAUSED : STATS_HALTED);
+	if (RUN_FLAG){
+		printf("Cycle limit reached.\n\n");
+		return;
 	}
 	printf("Simulation Finished.\n\n");
 }
@@ -151,6 +382,29 @@ void rdump() {
 	printf("-------------------------------------\n");
 }
 
+/***************************************************************/
+/* Read a file name or option value of up to PROG_PATH_SIZE - 1 bytes,    */
+/* FALSE if it is missing or longer, the rest of a long one is dropped */
+/***************************************************************/
+int scan_path(char *path)
+{
+	int c;
+	
+	if (scanf("%255s", path) != 1){
+		return FALSE;
+	}
+	c = getchar();
+	if (c == EOF || isspace(c)){
+		ungetc(c, stdin);
+		return TRUE;
+	}
+	while (c != EOF && !isspace(c)){
+		c = getchar();
+	}
+	printf("Error: %.40s... is longer than %d characters\n", path, PROG_PATH_SIZE - 1);
+	return FALSE;
+}
+
 /***************************************************************/
 /* Read a command from standard input.                                                               */  
 /***************************************************************/
@@ -160,10 +414,14 @@ void handle_command() {
 	uint32_t register_no;
 	int register_value;
 	int hi_reg_value, lo_reg_value;
+	char option[20], value[PROG_PATH_SIZE];
+	char file[PROG_PATH_SIZE];
+	int thread_no;
 
 	printf("MU-MIPS SIM:> ");
 
 	if (scanf("%s", buffer) == EOF){
+		export_close_all();
 		exit(0);
 	}
 
@@ -172,6 +430,18 @@ void handle_command() {
 		case 's':
 			if (buffer[1] == 'h' || buffer[1] == 'H'){
 				show_pipeline();
+			}else if (buffer[1] == 'e' || buffer[1] == 'E'){
+				if (scanf("%19s", option) != 1 || !scan_path(value)){
+					break;
+				}
+				set_option(option, value);
+			}else if (buffer[1] == 't' || buffer[1] == 'T'){
+				print_stats();
+			}else if (buffer[3] == 'p' || buffer[3] == 'P'){
+				if (scanf("%u %d", &start, &thread_no) != 2 || !scan_path(file)){
+					break;
+				}
+				simpoint_run(start, thread_no, strcmp(file, "-") == 0 ? NULL : file);
 			}else {
 				runAll(); 
 			}
@@ -188,6 +458,8 @@ void handle_command() {
 			break;
 		case 'Q':
 		case 'q':
+			console_flush();
+			export_close_all();
 			printf("**************************\n");
 			printf("Exiting MU-MIPS! Good Bye...\n");
 			printf("**************************\n");
@@ -213,6 +485,7 @@ void handle_command() {
 			}
 			CURRENT_STATE.REGS[register_no] = register_value;
 			NEXT_STATE.REGS[register_no] = register_value;
+			LS_STATE.REGS[register_no] = register_value;
 			break;
 		case 'H':
 		case 'h':
@@ -221,6 +494,7 @@ void handle_command() {
 			}
 			CURRENT_STATE.HI = hi_reg_value; 
 			NEXT_STATE.HI = hi_reg_value; 
+			LS_STATE.HI = hi_reg_value;
 			break;
 		case 'L':
 		case 'l':
@@ -229,10 +503,91 @@ void handle_command() {
 			}
 			CURRENT_STATE.LO = lo_reg_value;
 			NEXT_STATE.LO = lo_reg_value;
+			LS_STATE.LO = lo_reg_value;
 			break;
 		case 'P':
 		case 'p':
-			print_program(); 
+			if (buffer[2] == 'o' || buffer[2] == 'O'){
+				print_profile();
+			}else {
+				print_program(); 
+			}
+			break;
+		case 'C':
+		case 'c':
+			if (scanf("%d", &thread_no) != 1){
+				break;
+			}
+			cdump(thread_no);
+			break;
+		case 'F':
+		case 'f':
+			if (buffer[1] == 'i' || buffer[1] == 'I'){
+				print_fingerprint();
+			}else {
+				if (scanf("%u", &cycles) != 1){
+					break;
+				}
+				func_run(cycles);
+			}
+			break;
+		case 'D':
+		case 'd':
+			if (scanf("%255s %d", file, &thread_no) != 2){
+				break;
+			}
+			server_run(file, thread_no);
+			break;
+		case 'G':
+		case 'g':
+			if (scanf("%d", &thread_no) != 1){
+				break;
+			}
+			gdb_serve(thread_no);
+			break;
+		case 'B':
+		case 'b':
+			if (buffer[1] == 'd' || buffer[1] == 'D'){
+				if (scanf("%d", &thread_no) != 1){
+					break;
+				}
+				batch_dump(thread_no);
+			}else {
+				if (scanf("%d", &thread_no) != 1 || !scan_path(file)){
+					break;
+				}
+				batch_run(thread_no, file);
+			}
+			break;
+		case 'T':
+		case 't':
+			if (buffer[1] == 'r' || buffer[1] == 'R'){
+				if (scanf("%d %u %i", &thread_no, &register_no, &register_value) != 3){
+					break;
+				}
+				if (thread_no < 0 || thread_no >= MAX_THREADS || register_no >= MIPS_REGS){
+					printf("Invalid thread or register\n");
+					break;
+				}
+				switch_thread(thread_no);
+				CURRENT_STATE.REGS[register_no] = register_value;
+				NEXT_STATE.REGS[register_no] = register_value;
+			}else if (buffer[1] == 'd' || buffer[1] == 'D'){
+				if (scanf("%d", &thread_no) != 1){
+					break;
+				}
+				if (thread_no < 0 || thread_no >= MAX_THREADS){
+					printf("Invalid thread\n");
+					break;
+				}
+				switch_thread(thread_no);
+				rdump();
+			}else {
+				if (scanf("%d", &thread_no) != 1 || !scan_path(file)){
+					break;
+				}
+				load_thread_program(thread_no, file);
+			}
 			break;
 		default:
 			printf("Invalid Command.\n");
@@ -245,6 +600,9 @@ void handle_command() {
 /***************************************************************/
 void reset() {   
 	int i;
+	trace_reset();	//The functional engine must stop touching memory first
+	pipe_stop();
+	switch_thread(0);
 	/*reset registers*/
 	for (i = 0; i < MIPS_REGS; i++){
 		CURRENT_STATE.REGS[i] = 0;
@@ -252,18 +610,58 @@ void reset() {
 	CURRENT_STATE.HI = 0;
 	CURRENT_STATE.LO = 0;
 	
-	for (i = 0; i < NUM_MEM_REGION; i++) {
-		uint32_t region_size = MEM_REGIONS[i].end - MEM_REGIONS[i].begin + 1;
-		memset(MEM_REGIONS[i].mem, 0, region_size);
-	}
+	mem_clear();
 	
 	/*load program*/
 	load_program();
+	for (i = 1; i < MAX_THREADS; i++){
+		if (THREADS[i].prog_file[0] != '\0'){
+			load_program_file(THREADS[i].prog_file, MEM_TEXT_BEGIN + i * THREAD_TEXT_STRIDE);
+		}
+	}
+	
+	/*reset pipeline*/
+	insert_bubble(&IF_ID);	//Empty, not NOPs that would commit
+	insert_bubble(&ID_EX);
+	insert_bubble(&EX_MEM);
+	insert_bubble(&MEM_WB);
+	insert_bubble(&IF_ID_S1);
+	insert_bubble(&ID_EX_S1);
+	insert_bubble(&EX_MEM_S1);
+	insert_bubble(&MEM_WB_S1);
+	stall = 0;
+	mem_stall = 0;
+	FETCH_REDIRECT = FALSE;
+	EXIT_PENDING = FALSE;
 	
 	/*reset PC*/
 	INSTRUCTION_COUNT = 0;
+	CYCLE_COUNT = 0;
+	HOST_SECONDS = 0;
+	HAZARD_STALL_CYCLES = 0;
+	MEM_STALL_CYCLES = 0;
+	FLUSH_CYCLES = 0;
+	SKIPPED_CYCLES = 0;
+	LOOP_EDGE = 0;
+	memset(&LOOP, 0, sizeof(Loop_Snapshot));
+	ISSUE_CYCLES = 0;
+	DUAL_ISSUE_CYCLES = 0;
 	CURRENT_STATE.PC =  MEM_TEXT_BEGIN;
 	NEXT_STATE = CURRENT_STATE;
+	ooo_reset();
+	fe_reset();
+	mt_reset();
+	mc_reset();
+	mmu_reset();
+	COMMIT_HASH = FP_SEED;
+	COMMIT_COUNT = 0;
+	lockstep_reset();
+	console_reset();
+	pipe_reset();
+	sd_reset(&SD_INST);
+	sd_reset(&SD_DATA);
+	FETCH_REFILL = IF_STAGES - 1;	//The first instruction fills the extra fetch stages
+	EXIT_DRAIN = 0;
 	RUN_FLAG = TRUE;
 }
 
@@ -279,18 +677,63 @@ void init_memory() {
 	}
 }
 
+/***************************************************************/
+/* Zero every page written since start up, the rest is still zero         */
+/***************************************************************/
+void mem_clear() {
+	uint32_t page;
+	uint8_t *p;
+	
+	for (page = 0; page < MEM_PAGES; page++){
+		if (MEM_DIRTY[page] && (p = mem_page(page << MEM_PAGE_SHIFT)) != NULL){
+			memset(p, 0, MEM_PAGE_SIZE);
+		}
+	}
+}
+
+/***************************************************************/
+/* Host address of the simulated page at address, NULL if unmapped      */
+/***************************************************************/
+uint8_t *mem_page(uint32_t address) {
+	int i;
+	
+	for (i = 0; i < NUM_MEM_REGION; i++) {
+		if (address >= MEM_REGIONS[i].begin && address <= MEM_REGIONS[i].end) {
+			return MEM_REGIONS[i].mem + (address - MEM_REGIONS[i].begin);
+		}
+	}
+	return NULL;
+}
+
 /**************************************************************/
 /* load program into memory                                                                                      */
 /**************************************************************/
 void load_program() {                   
+	PROGRAM_SIZE = load_program_file(prog_file, MEM_TEXT_BEGIN);
+}
+
+/**************************************************************/
+/* load a program file at base, returns its size in words                              */
+/**************************************************************/
+uint32_t load_program_file(char *file, uint32_t base) {
 	FILE * fp;
 	int i, word;
 	uint32_t address;
+	Program_Image *image;
+
+	/* Server jobs reuse the image the server parsed. */
+	if ((image = image_find(file)) != NULL) {
+		for (i = 0; i < image->num_words; i++) {
+			mem_write_32(base + 4 * i, image->words[i]);
+		}
+		printf("Program loaded into memory.\n%d words written into memory (cached).\n\n", image->num_words);
+		return image->num_words;
+	}
 
 	/* Open program file. */
-	fp = fopen(prog_file, "r");
+	fp = fopen(file, "r");
 	if (fp == NULL) {
-		printf("Error: Can't open program file %s\n", prog_file);
+		printf("Error: Can't open program file %s\n", file);
 		exit(-1);
 	}
 
@@ -298,14 +741,14 @@ void load_program() {
 
 	i = 0;
 	while( fscanf(fp, "%x\n", &word) != EOF ) {
-		address = MEM_TEXT_BEGIN + i;
+		address = base + i;
 		mem_write_32(address, word);
 		printf("writing 0x%08x into address 0x%08x (%d)\n", word, address, address);
 		i += 4;
 	}
-	PROGRAM_SIZE = i/4;
-	printf("Program loaded into memory.\n%d words written into memory.\n\n", PROGRAM_SIZE);
+	printf("Program loaded into memory.\n%d words written into memory.\n\n", i/4);
 	fclose(fp);
+	return i/4;
 }
 
 /************************************************************/
@@ -313,19 +756,201 @@ void load_program() {
 /************************************************************/
 void handle_pipeline()
 {
+	Decoded_Inst d;
+
 	/*INSTRUCTION_COUNT should be incremented when instruction is done*/
 	/*Since we do not have branch/jump instructions, INSTRUCTION_COUNT should be incremented in WB stage */
 
 	NEXT_STATE = CURRENT_STATE;
+	if (MC_CORES > 1){
+		mc_poll_messages();
+	}
+	if (SB_ENTRIES > 0){
+		sb_tick();
+	}
+	if (IQ_ENTRIES > 0){
+		fe_fetch();	//Fetch runs ahead even while the back end is frozen
+	}
+	if (mem_stall > 0){
+		mem_stall--;	//Whole pipeline waits for the data cache
+		MEM_STALL_CYCLES++;
+		if (IQ_ENTRIES > 0){
+			BE_BOUND_CYCLES++;
+		}
+		return;
+	}
+	if (EXIT_DRAIN > 0){
+		if (--EXIT_DRAIN == 0){
+			RUN_FLAG = FALSE;	//The exit SYSCALL left the last extra stage
+		}
+		return;
+	}
+	PIPE_TICK++;
 	if (stall > 0){
 		stall = stall - 1;	//Decrement stall back to 0	
+		HAZARD_STALL_CYCLES++;
 	}
-	printf("Handle Pipeline: Stall = %d\n", stall);
-	WB();
-	MEM();
-	EX();
-	ID();
-	IF();
+	if (VERBOSE) printf("Handle Pipeline: Stall = %d\n", stall);
+	if (NUM_THREADS > 1){
+		handle_pipeline_mt();
+		return;
+	}
+	if (ISSUE_WIDTH == 2){
+		handle_pipeline_dual();
+		return;
+	}
+	if (HOST_PIPE && !PIPE_RUNNING){
+		pipe_start();
+	}
+	if (PIPE_RUNNING){
+		pipe_cycle();
+		return;
+	}
+	PROF_CALL(PROF_WB, WB());
+	PROF_CALL(PROF_MEM, MEM());
+	if (EXCEPTION_TAKEN){
+		flush_for_exception();
+		return;
+	}
+	PROF_CALL(PROF_EX, forward_operands(&ID_EX); EX());
+	if (FETCH_REDIRECT){
+		insert_bubble(&ID_EX);	//Squash the instruction fetched behind a taken branch
+		FLUSH_CYCLES += REDIRECT_PENALTY;	//and the fetch slot of this cycle
+		FETCH_REFILL = REDIRECT_PENALTY - 2;	//and any deeper fetch and EX stages
+	}
+	else{
+		PROF_CALL(PROF_ID,
+			decode_instruction(IF_ID.IR, &d);
+			if (stall == 0 && !IF_ID.Bubble){
+				stall = pipe_hazard(&d, PIPE_TICK + 1);	//Wait for the load data
+			}
+			ID();
+			if (stall == 0 && !IF_ID.Bubble){
+				pipe_produce(&d, PIPE_TICK + 1);	//Enters EX next tick
+			});
+	}
+	PROF_CALL(PROF_IF, IF());
+}
+
+/***************************************************************/
+/* Start the MEM host thread for host_pipe                                                 */
+/***************************************************************/
+void pipe_start()
+{
+	memset(&PIPE, 0, sizeof(Host_Pipe));
+	PIPE_SEQ = 0;
+	if (pthread_create(&PIPE_THREAD, NULL, pipe_mem_main, NULL) != 0){
+		printf("Error: Can't start the MEM host thread, host_pipe is off\n");
+		HOST_PIPE = FALSE;
+		return;
+	}
+	PIPE_RUNNING = TRUE;
+}
+
+/***************************************************************/
+/* Stop it between run commands so it never spins at the prompt        */
+/***************************************************************/
+void pipe_stop()
+{
+	if (!PIPE_RUNNING){
+		return;
+	}
+	atomic_store_explicit(&PIPE.quit, TRUE, memory_order_relaxed);
+	atomic_store_explicit(&PIPE.go, ++PIPE_SEQ, memory_order_release);
+	pthread_join(PIPE_THREAD, NULL);
+	PIPE_RUNNING = FALSE;
+}
+
+/***************************************************************/
+/* Wait until flag reaches value, polling briefly before yielding          */
+/***************************************************************/
+void pipe_wait(_Atomic uint32_t *flag, uint32_t value)
+{
+	int spins = 0;
+	
+	while (atomic_load_explicit(flag, memory_order_acquire) != value){
+		if (++spins < PIPE_SPINS){
+#if defined(__x86_64__) || defined(__i386__)
+			_mm_pause();
+#endif
+			continue;
+		}
+		sched_yield();
+	}
+}
+
+/***************************************************************/
+/* MEM host thread: one MEM stage per cycle handed over                 */
+/***************************************************************/
+void *pipe_mem_main(void *arg)
+{
+	uint32_t seq = 0;
+	
+	(void)arg;
+	PROF_ON = FALSE;	//PROF belongs to the main thread
+	DCACHE = &CORES[0].dcache;
+	while (TRUE){
+		pipe_wait(&PIPE.go, ++seq);
+		if (atomic_load_explicit(&PIPE.quit, memory_order_relaxed)){
+			break;
+		}
+		EX_MEM = PIPE.in;
+		MEM();
+		PIPE.out = MEM_WB;
+		PIPE.mem_stall = mem_stall;
+		PIPE.writes = MEM_WRITES;
+		mem_stall = 0;
+		MEM_WRITES = 0;
+		atomic_store_explicit(&PIPE.done, seq, memory_order_release);
+	}
+	return NULL;
+}
+
+/***************************************************************/
+/* One single-issue cycle with MEM on the other host thread. A load    */
+/* or store to a device stays on this thread, which owns the counters */
+/* and regions of interest the devices read and update.                       */
+/***************************************************************/
+void pipe_cycle()
+{
+	Decoded_Inst d;
+	int device;
+	
+	decode_instruction(EX_MEM.IR, &d);
+	device = !EX_MEM.Bubble && (d.is_load || d.is_store) && EX_MEM.ALUOutput >= MMIO_BEGIN;
+	PIPE.in = EX_MEM;	//forward_value reads it either way
+	if (!device){
+		atomic_store_explicit(&PIPE.go, ++PIPE_SEQ, memory_order_release);
+	}
+	PROF_CALL(PROF_WB, WB());	//Reads the MEM/WB latch of the last cycle
+	if (device){
+		PROF_CALL(PROF_MEM, MEM());
+	}
+	PROF_CALL(PROF_EX, forward_operands(&ID_EX); EX());
+	if (FETCH_REDIRECT){
+		insert_bubble(&ID_EX);	//Squash the instruction fetched behind a taken branch
+		FLUSH_CYCLES += REDIRECT_PENALTY;	//and the fetch slot of this cycle
+		FETCH_REFILL = REDIRECT_PENALTY - 2;	//and any deeper fetch and EX stages
+	}
+	else{
+		PROF_CALL(PROF_ID,
+			decode_instruction(IF_ID.IR, &d);
+			if (stall == 0 && !IF_ID.Bubble){
+				stall = pipe_hazard(&d, PIPE_TICK + 1);	//Wait for the load data
+			}
+			ID();
+			if (stall == 0 && !IF_ID.Bubble){
+				pipe_produce(&d, PIPE_TICK + 1);	//Enters EX next tick
+			});
+	}
+	PROF_CALL(PROF_IF, IF());
+	if (device){
+		return;
+	}
+	pipe_wait(&PIPE.done, PIPE_SEQ);
+	MEM_WB = PIPE.out;
+	mem_stall += PIPE.mem_stall;
+	MEM_WRITES += PIPE.writes;
 }
 
 /************************************************************/
@@ -341,6 +966,11 @@ void WB()
 	uint32_t funct = MEM_WB.IR & 0x0000003F;	//Get first 6 bits for function code
 	uint32_t rt = (MEM_WB.IR & 0x001F0000) >> 16;
 	uint32_t rd = (MEM_WB.IR & 0x0000F800) >> 11;
+	Decoded_Inst d;
+	
+	if (MEM_WB.Bubble){
+		return;
+	}
 	    
 	if (opcode == 0x00) {	 //R-type instruction
 		switch(funct) {
@@ -360,7 +990,6 @@ void WB()
 				break;
 				
 			case 0x08:	//JR
-				NEXT_STATE.REGS[rd] = MEM_WB.ALUOutput;
 				INSTRUCTION_COUNT++;
 				break;
 				
@@ -370,6 +999,14 @@ void WB()
 				break;
 				
 			case 0x0C:	//SYSCALL
+				if (EXIT_PENDING){
+					EXIT_PENDING = FALSE;
+					EXIT_DRAIN = EX_STAGES + MEM_STAGES - 2;	//Stages this model folds into EX and MEM
+					if (EXIT_DRAIN == 0){
+						RUN_FLAG = FALSE;	//Everything older has written back
+					}
+				}
+				INSTRUCTION_COUNT++;
 				break;
 				
 			case 0x10:	//MFHI
@@ -377,8 +1014,7 @@ void WB()
 				INSTRUCTION_COUNT++;
 				break;
 				
-			case 0x11:	//MTHI
-				NEXT_STATE.REGS[rd] = MEM_WB.ALUOutput;
+			case 0x11:	//MTHI, HI and LO were written in EX
 				INSTRUCTION_COUNT++;
 				break;
 				
@@ -387,28 +1023,23 @@ void WB()
 				INSTRUCTION_COUNT++;
 				break;
 				
-			case 0x13:	//MTLO
-				NEXT_STATE.REGS[rd] = MEM_WB.ALUOutput;
+			case 0x13:	//MTLO, HI and LO were written in EX
 				INSTRUCTION_COUNT++;
 				break;
 				
-			case 0x18:	//MULT
-				NEXT_STATE.REGS[rd] = MEM_WB.ALUOutput;
+			case 0x18:	//MULT, HI and LO were written in EX
 				INSTRUCTION_COUNT++;
 				break;
 				
-			case 0x19:	//MULTU
-				NEXT_STATE.REGS[rd] = MEM_WB.ALUOutput;
+			case 0x19:	//MULTU, HI and LO were written in EX
 				INSTRUCTION_COUNT++;
 				break;
 				
-			case 0x1A:	//DIV
-				NEXT_STATE.REGS[rd] = MEM_WB.ALUOutput;
+			case 0x1A:	//DIV, HI and LO were written in EX
 				INSTRUCTION_COUNT++;
 				break;
 				
-			case 0x1B:	//DIVU
-				NEXT_STATE.REGS[rd] = MEM_WB.ALUOutput;
+			case 0x1B:	//DIVU, HI and LO were written in EX
 				INSTRUCTION_COUNT++;
 				break;
 				
@@ -465,37 +1096,31 @@ void WB()
 	else{
 		switch(opcode){
 			case 0x01:	//BLTZ OR BGEZ
-				NEXT_STATE.REGS[rt] = MEM_WB.ALUOutput;
 				INSTRUCTION_COUNT++;
 				break;
 				
 			case 0x02:	//J
-				NEXT_STATE.REGS[rt] = MEM_WB.ALUOutput;
 				INSTRUCTION_COUNT++;
 				break;
 				
 			case 0x03:	//JAL
-				NEXT_STATE.REGS[rt] = MEM_WB.ALUOutput;
+				NEXT_STATE.REGS[31] = MEM_WB.ALUOutput;	//Return address
 				INSTRUCTION_COUNT++;
 				break;
 				
 			case 0x04:	//BEQ
-				NEXT_STATE.REGS[rt] = MEM_WB.ALUOutput;
 				INSTRUCTION_COUNT++;
 				break;
 				
 			case 0x05:	//BNE
-				NEXT_STATE.REGS[rt] = MEM_WB.ALUOutput;
 				INSTRUCTION_COUNT++;
 				break;
 				
 			case 0x06:	//BLEZ
-				NEXT_STATE.REGS[rt] = MEM_WB.ALUOutput;
 				INSTRUCTION_COUNT++;
 				break;
 				
 			case 0x07:	//BGTZ
-				NEXT_STATE.REGS[rt] = MEM_WB.ALUOutput;
 				INSTRUCTION_COUNT++;
 				break;
 				
@@ -549,19 +1174,33 @@ void WB()
 				INSTRUCTION_COUNT++;
 				break;
 				
+			case 0x10:	//COP0
+				if (((MEM_WB.IR & 0x03E00000) >> 21) == 0x00){	//MFC0
+					NEXT_STATE.REGS[rt] = MEM_WB.ALUOutput;
+				}
+				INSTRUCTION_COUNT++;
+				break;
+				
+			case 0x30:	//LL
+				NEXT_STATE.REGS[rt] = MEM_WB.LMD;
+				INSTRUCTION_COUNT++;
+				break;
+				
+			case 0x38:	//SC
+				NEXT_STATE.REGS[rt] = MEM_WB.LMD;	//1 if the store happened
+				INSTRUCTION_COUNT++;
+				break;
+				
 			case 0x28:	//SB
-//				NEXT_STATE.REGS[rt] = MEM_WB.ALUOutput;
-				//INSTRUCTION_COUNT++;
+				INSTRUCTION_COUNT++;	//Memory was written in MEM
 				break;
 				
 			case 0x29:	//SH
-//				NEXT_STATE.REGS[rt] = MEM_WB.ALUOutput;
-				//INSTRUCTION_COUNT++;
+				INSTRUCTION_COUNT++;
 				break;
 				
 			case 0x2B:	//SW
-			//	NEXT_STATE.REGS[rt] = MEM_WB.ALUOutput;
-			//	INSTRUCTION_COUNT++;
+				INSTRUCTION_COUNT++;
 				break;
 				
 			default:
@@ -569,6 +1208,15 @@ void WB()
 				break;
 		}
 	}
+	if (FINGERPRINT || LOCKSTEP){
+		decode_instruction(MEM_WB.IR, &d);
+		if (FINGERPRINT){
+			commit_hash(MEM_WB.PC - 4, &d, NEXT_STATE.REGS[d.dest], MEM_WB.ALUOutput);
+		}
+		if (LOCKSTEP){
+			lockstep_check(MEM_WB.PC - 4, &d, NEXT_STATE.REGS[d.dest], MEM_WB.ALUOutput);
+		}
+	}
 }
 
 /************************************************************/
@@ -586,11 +1234,33 @@ void MEM()
 	MEM_WB.imm = EX_MEM.imm;
 	MEM_WB.ALUOutput = EX_MEM.ALUOutput;
 	MEM_WB.LMD = 0;
+	MEM_WB.Bubble = EX_MEM.Bubble;
+	MEM_WB.TID = EX_MEM.TID;
+	MEM_WB.Exception = EX_MEM.Exception;
+	
+	uint32_t opcode, vaddr;
+	int write;
+	Decoded_Inst d;
 	
-	uint32_t opcode;
+	if (MEM_WB.Exception){	//Fetch fault, everything older has left MEM
+		take_exception(MEM_WB.Exception, MEM_WB.PC - 4, MEM_WB.PC - 4);
+		return;
+	}
+	if (MEM_WB.Bubble){
+		return;
+	}
 	
 	opcode = (MEM_WB.IR & 0xFC000000) >> 26;	//Shift to get opcode bits 26-31
 	
+	if (MMU_MODE != MMU_OFF && (opcode >= 0x20 && opcode <= 0x38)){	//Loads, stores, LL and SC
+		write = (opcode >= 0x28 && opcode != 0x30);
+		vaddr = MEM_WB.ALUOutput;
+		if (!mmu_translate(&DTLB, &MEM_WB.ALUOutput)){
+			take_exception(write ? EXC_TLBS : EXC_TLBL, MEM_WB.PC - 4, vaddr);
+			return;
+		}
+	}
+	
 	if (opcode == 0x00){
 		return;	//Don't need r type	
 	}
@@ -598,33 +1268,59 @@ void MEM()
 	else{
 		switch(opcode){
 			case 0x20:	//LB
-				MEM_WB.LMD = 0x000000FF & mem_read_32(MEM_WB.ALUOutput);	//Get first 8 bits from memory and place in lmd
-				break;
-				
 			case 0x21:	//LH
-				MEM_WB.LMD = 0x0000FFFF & mem_read_32(MEM_WB.ALUOutput);	//Get first 16 bits from memory and place in lmd
+			case 0x23:	//LW
+			case 0x30:	//LL
+				mem_access_timing(MEM_WB.PC, MEM_WB.ALUOutput, FALSE);
+				break;
+			case 0x28:	//SB
+			case 0x29:	//SH
+			case 0x2B:	//SW
+			case 0x38:	//SC
+				mem_access_timing(MEM_WB.PC, MEM_WB.ALUOutput, TRUE);
+				break;
+		}
+		decode_instruction(MEM_WB.IR, &d);
+		switch(opcode){
+			case 0x20:	//LB
+				MEM_WB.LMD = load_data(&d, MEM_WB.ALUOutput);	//Sign extended byte at ALUOutput
+				break;
+				
+			case 0x21:	//LH
+				MEM_WB.LMD = load_data(&d, MEM_WB.ALUOutput);	//Sign extended halfword at ALUOutput
 				break;
 				
 			case 0x23:	//LW
-				MEM_WB.LMD = 0xFFFFFFFF & mem_read_32(MEM_WB.ALUOutput);	//Get first 32 bits from memory and place in lmd
-				printf("lw mem address = %X\n", MEM_WB.ALUOutput);
+				MEM_WB.LMD = load_data(&d, MEM_WB.ALUOutput);	//Word at ALUOutput
+				if (VERBOSE) printf("lw mem address = %X\n", MEM_WB.ALUOutput);
                 break;
 				
+			case 0x30:	//LL
+				MEM_WB.LMD = load_linked(MEM_WB.ALUOutput);
+				break;
+				
 			case 0x28:	//SB
-				mem_write_32(MEM_WB.ALUOutput, MEM_WB.B);	//Write B into ALUOutput memory
+				store_word(&d, MEM_WB.ALUOutput, MEM_WB.B);	//Write the low byte of B into ALUOutput memory
 				break;
 				
 			case 0x29:	//SH
-				mem_write_32(MEM_WB.ALUOutput, MEM_WB.B);	//Write B into ALUOutput memory
+				store_word(&d, MEM_WB.ALUOutput, MEM_WB.B);	//Write the low halfword of B into ALUOutput memory
 				break;
 				
 			case 0x2B:	//SW
-				mem_write_32(MEM_WB.ALUOutput, MEM_WB.B);	//Write B into ALUOutput memory
+				store_word(&d, MEM_WB.ALUOutput, MEM_WB.B);	//Write B into ALUOutput memory
+				break;
+				
+			case 0x38:	//SC
+				MEM_WB.LMD = store_conditional(MEM_WB.ALUOutput, MEM_WB.B);
 				break;
 				
 			default:
 				break;
 		}
+		if (d.is_load && !d.is_store && MEM_WB.ALUOutput >= MMIO_BEGIN){
+			mmio_consume(MEM_WB.ALUOutput);	//Older branches have resolved, the load commits
+		}
 	}
 	
 }
@@ -643,10 +1339,18 @@ void EX()
 	EX_MEM.B = ID_EX.B;
 	EX_MEM.imm = ID_EX.imm;
 	EX_MEM.ALUOutput = 0;
+	EX_MEM.Bubble = ID_EX.Bubble;
+	EX_MEM.TID = ID_EX.TID;
+	EX_MEM.Exception = ID_EX.Exception;
+	EX_MEM.PredPC = ID_EX.PredPC;
 	
 	uint32_t opcode, funct, sa;
 	uint64_t multiply;
 	
+	if (EX_MEM.Bubble){
+		return;
+	}
+	
 	opcode = (EX_MEM.IR & 0xFC000000) >> 26;	//Shift left to get opcode bits 26-31
 	funct = EX_MEM.IR & 0x0000003F;	//Get first 6 bits for function code
 	sa = (EX_MEM.IR & 0x000007C0) >> 6;	//Get shift amount
@@ -662,20 +1366,29 @@ void EX()
 				break;
 				
 			case 0x03:	//SRA
-				EX_MEM.ALUOutput = EX_MEM.B >> sa;	//Same as SRL
+				EX_MEM.ALUOutput = (uint32_t)((int32_t)EX_MEM.B >> sa);	//Like SRL, but copies the sign bit in
 				break;
 				
 			case 0x08:	//JR
+				pipeline_branch();
 				break;
 				
 			case 0x09:	//JALR
+				pipeline_branch();
 				break;
 				
 			case 0x0C:	//SYSCALL
-                if(CURRENT_STATE.REGS[2] == 0xa){
-                    RUN_FLAG = FALSE;
-                    }
-                    print_instruction(CURRENT_STATE.PC-8);
+				if (EX_MEM.A == 0xa){	//$v0, forwarded into A
+					if (NUM_THREADS > 1){
+						RUN_FLAG = FALSE;	//The barrel pipeline drains on its own
+					}
+					else{
+						EXIT_PENDING = TRUE;	//Retire older instructions, then stop in WB
+						FETCH_REDIRECT = TRUE;
+						REDIRECT_TID = EX_MEM.TID;
+					}
+				}
+				if (VERBOSE) print_instruction(CURRENT_STATE.PC-8);
 				break;
 				
 			case 0x10:	//MFHI
@@ -695,13 +1408,13 @@ void EX()
 				break;
 				
 			case 0x18:	//MULT
-				multiply = EX_MEM.A * EX_MEM.B;	//multiply rs and rt, store low order into LO and high order into HI
+				multiply = (uint64_t)((int64_t)(int32_t)EX_MEM.A * (int64_t)(int32_t)EX_MEM.B);	//signed 64-bit product, low order into LO and high order into HI
 				NEXT_STATE.LO = 0x00000000FFFFFFFF & multiply;
 				NEXT_STATE.HI = (0xFFFFFFFF00000000 & multiply) >> 32;
 				break;
 				
 			case 0x19:	//MULTU
-				multiply = EX_MEM.A * EX_MEM.B;	//multiply rs and rt, store low order into LO and high order into HI
+				multiply = (uint64_t)EX_MEM.A * (uint64_t)EX_MEM.B;	//multiply rs and rt, store low order into LO and high order into HI
 				NEXT_STATE.LO = 0x00000000FFFFFFFF & multiply;
 				NEXT_STATE.HI = (0xFFFFFFFF00000000 & multiply) >> 32;
 				break;
@@ -711,8 +1424,8 @@ void EX()
 					printf("Cannot divide by 0\n");
 				}
 				else{
-					NEXT_STATE.LO = EX_MEM.A / EX_MEM.B;	//same as lab 1
-					NEXT_STATE.HI = EX_MEM.A % EX_MEM.B;
+					NEXT_STATE.LO = (uint32_t)((int32_t)EX_MEM.A / (int32_t)EX_MEM.B);	//Signed quotient and remainder
+					NEXT_STATE.HI = (uint32_t)((int32_t)EX_MEM.A % (int32_t)EX_MEM.B);
 				}
 				break;
 				
@@ -728,7 +1441,7 @@ void EX()
 				
 			case 0x20:	//ADD
 				EX_MEM.ALUOutput = EX_MEM.A + EX_MEM.B;	//ADD rd(ALUOutput), rs(A), rt(B)
-				print_instruction(CURRENT_STATE.PC-8);
+				if (VERBOSE) print_instruction(CURRENT_STATE.PC-8);
                 break;
 				
 			case 0x21:	//ADDU
@@ -745,7 +1458,7 @@ void EX()
 				
 			case 0x24:	//AND
 				EX_MEM.ALUOutput = EX_MEM.A & EX_MEM.B;	//AND rd(ALUOutput), rs(A), rt(B)
-				print_instruction(CURRENT_STATE.PC-8);
+				if (VERBOSE) print_instruction(CURRENT_STATE.PC-8);
                 break;
 				
 			case 0x25:	//OR
@@ -754,7 +1467,7 @@ void EX()
 				
 			case 0x26:	//XOR
 				EX_MEM.ALUOutput = EX_MEM.A ^ EX_MEM.B;	//XOR rd(ALUOutput), rs(A), rt(B)
-				print_instruction(CURRENT_STATE.PC-8);
+				if (VERBOSE) print_instruction(CURRENT_STATE.PC-8);
                 break;
 				
 			case 0x27:	//NOR
@@ -762,7 +1475,7 @@ void EX()
 				break;
 				
 			case 0x2A:	//SLT
-				if(EX_MEM.A < EX_MEM.B){
+				if((int32_t)EX_MEM.A < (int32_t)EX_MEM.B){
 					EX_MEM.ALUOutput = 1;	//If rs(A) is less than rt(B), result = 1
 				}
 				else{
@@ -778,24 +1491,31 @@ void EX()
 	else{
 		switch(opcode){
 			case 0x01:	//BLTZ OR BGEZ
+				pipeline_branch();
 				break;
 				
 			case 0x02:	//J
+				pipeline_branch();
 				break;
 				
 			case 0x03:	//JAL
+				pipeline_branch();
 				break;
 				
 			case 0x04:	//BEQ
+				pipeline_branch();
 				break;
 				
 			case 0x05:	//BNE
+				pipeline_branch();
 				break;
 				
 			case 0x06:	//BLEZ
+				pipeline_branch();
 				break;
 				
 			case 0x07:	//BGTZ
+				pipeline_branch();
 				break;
 				
 			case 0x08:	//ADDI
@@ -807,11 +1527,11 @@ void EX()
 				
 			case 0x09:	//ADDIU
 				EX_MEM.ALUOutput = EX_MEM.A + EX_MEM.imm;	//ADDIU rt(aluoutput), rs(A), immediate
-				print_instruction((CURRENT_STATE.PC)-8);
+				if (VERBOSE) print_instruction((CURRENT_STATE.PC)-8);
                 break;
 				
 			case 0x0A:	//SLTI
-				if (EX_MEM.A < EX_MEM.imm){
+				if ((int32_t)EX_MEM.A < (int32_t)EX_MEM.imm){
 					EX_MEM.ALUOutput = 1;	//If rs(A) < immediate, rt(aluoutput) = 1	
 				}
 				else{
@@ -820,21 +1540,21 @@ void EX()
 				break;
 				
 			case 0x0C:	//ANDI
-				EX_MEM.ALUOutput = EX_MEM.A & EX_MEM.imm;	//ANDI rt(aluotput), rs(A), immediate
+				EX_MEM.ALUOutput = EX_MEM.A & (EX_MEM.imm & 0x0000FFFF);	//ANDI rt(aluotput), rs(A), zero extended immediate
 				break;
 				
 			case 0x0D:	//ORI
-				EX_MEM.ALUOutput = EX_MEM.A | EX_MEM.imm;	//ORI rt(aluotput), rs(A), immediate
+				EX_MEM.ALUOutput = EX_MEM.A | (EX_MEM.imm & 0x0000FFFF);	//ORI rt(aluotput), rs(A), zero extended immediate
 				break;
 				
 			case 0x0E:	//XORI
-				EX_MEM.ALUOutput = EX_MEM.A ^ EX_MEM.imm;	//XORI rt(aluotput), rs(A), immediate
-				print_instruction(CURRENT_STATE.PC-8);
+				EX_MEM.ALUOutput = EX_MEM.A ^ (EX_MEM.imm & 0x0000FFFF);	//XORI rt(aluotput), rs(A), zero extended immediate
+				if (VERBOSE) print_instruction(CURRENT_STATE.PC-8);
                 break;
 				
 			case 0x0F:	//LUI
 				EX_MEM.ALUOutput = EX_MEM.imm << 16;	//Shift immediate left 16 bits and place in ALUOutput
-				print_instruction(CURRENT_STATE.PC-8);
+				if (VERBOSE) print_instruction(CURRENT_STATE.PC-8);
                 break;
 				
 			case 0x20:	//LB
@@ -856,7 +1576,7 @@ void EX()
 				EX_MEM.A = ID_EX.A;	//Update Memory locations with current values
 				EX_MEM.B = ID_EX.B;
 				EX_MEM.imm = ID_EX.imm;
-                print_instruction(CURRENT_STATE.PC-8);
+                if (VERBOSE) print_instruction(CURRENT_STATE.PC-8);
 				break;
 				
 			case 0x28:	//SB
@@ -878,7 +1598,28 @@ void EX()
 				EX_MEM.A = ID_EX.A;	//Update Memory locations with current values
 				EX_MEM.B = ID_EX.B;
 				EX_MEM.imm = ID_EX.imm;
-                print_instruction(CURRENT_STATE.PC-8);
+                if (VERBOSE) print_instruction(CURRENT_STATE.PC-8);
+				break;
+				
+			case 0x30:	//LL
+			case 0x38:	//SC
+				EX_MEM.ALUOutput = ID_EX.A + ID_EX.imm;	//aluoutput = a + immediate
+				break;
+				
+			case 0x10:	//COP0
+				switch((EX_MEM.IR & 0x03E00000) >> 21){
+					case 0x00:	//MFC0
+						EX_MEM.ALUOutput = CP0[(EX_MEM.IR & 0x0000F800) >> 11];
+						break;
+					case 0x04:	//MTC0
+						CP0[(EX_MEM.IR & 0x0000F800) >> 11] = EX_MEM.B;
+						break;
+					case 0x10:	//CO
+						if (funct == 0x06 && REFILL_TLB != NULL){	//TLBWR
+							tlb_write(REFILL_TLB, CP0[CP0_ENTRYHI] >> PAGE_SHIFT, CP0[CP0_ENTRYLO0]);
+						}
+						break;	//ERET was handled in ID
+				}
 				break;
 				
 			default:
@@ -896,19 +1637,24 @@ void ID()
 	/*IMPLEMENT THIS*/
 	//Second stage
 	//Initialize ID pipeline registers
+	uint32_t opcode, funct, rs, rt, rd, sa, immediate;
 	
-	if ((EX_MEM.RegWrite && EX_MEM.RegisterRd != 0) && (EX_MEM.RegisterRd == ID_EX.RegisterRs)) {
+	if ((EX_MEM.RegWrite && EX_MEM.RegisterRD != 0) && (EX_MEM.RegisterRD == ID_EX.RegisterRS)) {
 		stall = 1;
 	}
 	    
-	if ((MEM_WB.RegWrite && MEM_WB.RegisterRd != 0) && (MEM_WB.RegisterRd == ID_EX.RegisterRs)) {
+	if ((MEM_WB.RegWrite && MEM_WB.RegisterRD != 0) && (MEM_WB.RegisterRD == ID_EX.RegisterRS)) {
 		stall = 1;
 	}
 	
 	if(stall == 0){
-		printf("Executing ID stage\n");
+		if (VERBOSE) printf("Executing ID stage\n");
 		ID_EX.IR = IF_ID.IR;
 		ID_EX.PC = IF_ID.PC;
+		ID_EX.Bubble = IF_ID.Bubble;
+		ID_EX.TID = IF_ID.TID;
+		ID_EX.Exception = IF_ID.Exception;
+		ID_EX.PredPC = IF_ID.PredPC;
 		ID_EX.A = 0;
 		ID_EX.B = 0;
 		ID_EX.imm = 0;
@@ -917,8 +1663,6 @@ void ID()
 		ID_EX.RegisterRS = 0;
 		ID_EX.RegisterRT = 0;
 		
-		uint32_t opcode, funct, rs, rt, rd, imm, sa;
-		
 		opcode = (IF_ID.IR & 0xFC000000) >> 26;
 		funct = IF_ID.IR & 0x0000003F;
 	
@@ -996,14 +1740,16 @@ void ID()
 			}
 			
 		}
+		else if (opcode == 0x10 && (IF_ID.IR & 0x02000000) && funct == 0x18 && !IF_ID.Bubble){	//ERET
+			NEXT_STATE.PC = CP0[CP0_EPC];	//Return to the faulting instruction
+			FETCH_REDIRECT = TRUE;
+			REDIRECT_TID = ACTIVE_THREAD;
+		}
 		
 	}
-	
-		while(stall > 0) {
-		
-		}
-	
-	
+	else{
+		insert_bubble(&ID_EX);	//Hold IF/ID and send a bubble down the pipeline
+	}
 	
 	rs = (IF_ID.IR & 0x03E00000) >> 21;	//Shift left to get rs bits 21-25
 	rt = (IF_ID.IR & 0x001F0000) >> 16;	//Shift left to get rt bits 16-20
@@ -1028,116 +1774,5113 @@ void IF()
 {	//something with memread
 	/*IMPLEMENT THIS*/
 	//First stage
+	uint32_t fetch_addr = CURRENT_STATE.PC + FETCH_OFFSET;
+	
+	if (FETCH_REDIRECT && ACTIVE_THREAD == REDIRECT_TID){
+		FETCH_REDIRECT = FALSE;
+		FETCH_BLOCKED = FALSE;	//A fetch fault behind the redirect was squashed too
+		if (IQ_ENTRIES > 0){
+			fe_redirect(NEXT_STATE.PC);
+		}
+		insert_bubble(&IF_ID);
+		return;
+	}
+	if (FETCH_BLOCKED || EXIT_PENDING){
+		insert_bubble(&IF_ID);	//Nothing valid to fetch this cycle
+		return;
+	}
+	if (FETCH_REFILL > 0 && stall == 0){
+		FETCH_REFILL--;	//The redirected fetch is still in the extra fetch or EX stages
+		insert_bubble(&IF_ID);
+		return;
+	}
+	if (IQ_ENTRIES > 0){
+		fe_deliver();
+		return;
+	}
 	if (stall == 0){	//Fetch instruction if there's no stall
-		IF_ID.IR = mem_read_32(CURRENT_STATE.PC);	//Get current value in memory
+		if (MMU_MODE != MMU_OFF && !mmu_translate(&ITLB, &fetch_addr)){
+			insert_bubble(&IF_ID);	//The miss is raised once it reaches MEM
+			IF_ID.Exception = EXC_TLBL;
+			IF_ID.PC = CURRENT_STATE.PC + 4;
+			FETCH_BLOCKED = TRUE;
+			return;
+		}
+		IF_ID.IR = mem_read_32(fetch_addr);	//Get current value in memory
+		if (STACK_DIST){
+			sd_access(&SD_INST, fetch_addr);
+		}
+		if (DIN_OUT.fp != NULL){
+			export_din(2, fetch_addr);
+		}
 		IF_ID.PC = CURRENT_STATE.PC + 4;	//Increment counter
 		NEXT_STATE.PC = IF_ID.PC;	//Store incremented counter into pc's next state
+		IF_ID.Bubble = 0;
+		IF_ID.TID = ACTIVE_THREAD;
+		IF_ID.Exception = 0;
 	}
 	else{
-		printf("Stalled in IF Stage\n");	
+		if (VERBOSE) printf("Stalled in IF Stage\n");	
 	}
+}
+
+
+/************************************************************/
+/* maintain the two-wide pipeline                                                                       */ 
+/* slot 0 holds the older instruction of a pair, slot 1 lives in the *_S1 latches  */
+/************************************************************/
+void handle_pipeline_dual()
+{
+	int paired;
 	
-	while(stall > 0) {
-		
+	PROF_CALL(PROF_WB, WB(); swap_slot_latches(); WB(); swap_slot_latches());
+	PROF_CALL(PROF_MEM, MEM(); swap_slot_latches(); MEM(); swap_slot_latches());
+	PROF_CALL(PROF_EX,
+		forward_operands(&ID_EX);
+		forward_operands(&ID_EX_S1);
+		EX();
+		swap_slot_latches();
+		EX();
+		swap_slot_latches());
+	PROF_CALL(PROF_ID, paired = ID_dual());
+	PROF_CALL(PROF_IF, IF_dual(paired));
+}
+
+/************************************************************/
+/* exchange the slot 0 and slot 1 pipeline registers so a stage function can run on slot 1 */
+/************************************************************/
+void swap_slot_latches()
+{
+	CPU_Pipeline_Reg tmp;
+	
+	tmp = IF_ID;	IF_ID = IF_ID_S1;	IF_ID_S1 = tmp;
+	tmp = ID_EX;	ID_EX = ID_EX_S1;	ID_EX_S1 = tmp;
+	tmp = EX_MEM;	EX_MEM = EX_MEM_S1;	EX_MEM_S1 = tmp;
+	tmp = MEM_WB;	MEM_WB = MEM_WB_S1;	MEM_WB_S1 = tmp;
+}
+
+/************************************************************/
+/* empty a pipeline register                                                                                 */
+/************************************************************/
+void insert_bubble(CPU_Pipeline_Reg *reg)
+{
+	memset(reg, 0, sizeof(CPU_Pipeline_Reg));
+	reg->Bubble = 1;
+}
+
+/************************************************************/
+/* decode dual-issue pair, returns TRUE if both slots were issued                   */
+/************************************************************/
+int ID_dual()
+{
+	Decoded_Inst d0, d1;
+	int paired;
+	
+	if (FETCH_REDIRECT){
+		insert_bubble(&ID_EX);	//Squash both slots behind a taken branch
+		insert_bubble(&ID_EX_S1);
+		return FALSE;
+	}
+	
+	decode_instruction(IF_ID.IR, &d0);
+	decode_instruction(IF_ID_S1.IR, &d1);
+	
+	if (stall > 0 || (!IF_ID.Bubble && load_use_hazard(&d0))){
+		stall = 1;	//Hold both IF/ID slots for a cycle
+		insert_bubble(&ID_EX);
+		insert_bubble(&ID_EX_S1);
+		if (VERBOSE) printf("Stalled in ID Stage\n");
+		return FALSE;
+	}
+	
+	paired = !IF_ID.Bubble && !IF_ID_S1.Bubble && !load_use_hazard(&d1) && can_pair(&d0, &d1);
+	
+	ID();
+	if (paired){
+		swap_slot_latches();
+		ID();
+		swap_slot_latches();
+		DUAL_ISSUE_CYCLES++;
+	}
+	else{
+		insert_bubble(&ID_EX_S1);
+	}
+	if (!IF_ID.Bubble){
+		ISSUE_CYCLES++;
 	}
+	return paired;
 }
 
+/************************************************************/
+/* fetch for the two-wide pipeline, an unissued slot 1 instruction moves to slot 0  */
+/************************************************************/
+void IF_dual(int paired)
+{
+	if (FETCH_REDIRECT || EXIT_PENDING){
+		FETCH_REDIRECT = FALSE;
+		insert_bubble(&IF_ID);
+		insert_bubble(&IF_ID_S1);
+		return;
+	}
+	if (stall > 0){
+		if (VERBOSE) printf("Stalled in IF Stage\n");
+		return;
+	}
+	
+	if (!paired && !IF_ID_S1.Bubble){
+		IF_ID = IF_ID_S1;	//Slot 1 did not issue, it becomes the older instruction
+		swap_slot_latches();
+		IF();
+		swap_slot_latches();
+		return;
+	}
+	
+	IF();
+	IF_ID_S1.IR = mem_read_32(NEXT_STATE.PC);	//Second word of the fetch pair
+	if (STACK_DIST){
+		sd_access(&SD_INST, NEXT_STATE.PC);
+	}
+	if (DIN_OUT.fp != NULL){
+		export_din(2, NEXT_STATE.PC);
+	}
+	IF_ID_S1.PC = NEXT_STATE.PC + 4;
+	IF_ID_S1.Bubble = 0;
+	NEXT_STATE.PC = IF_ID_S1.PC;
+}
 
 /************************************************************/
-/* Initialize Memory                                                                                                    */ 
+/* dual-issue pairing rules                                                                                     */
 /************************************************************/
-void initialize() { 
-	init_memory();
-	CURRENT_STATE.PC = MEM_TEXT_BEGIN;
-	NEXT_STATE = CURRENT_STATE;
-	RUN_FLAG = TRUE;
+int can_pair(Decoded_Inst *d0, Decoded_Inst *d1)
+{
+	if ((d0->is_load || d0->is_store) && (d1->is_load || d1->is_store)){
+		return FALSE;	//Only one memory port
+	}
+	if (d0->is_branch){
+		return FALSE;	//Nothing issues behind a branch, one in slot 1 pairs
+	}
+	if (d0->opcode == 0x00 && d0->funct == 0x0C){
+		return FALSE;	//Nor behind a SYSCALL
+	}
+	if (d0->dest != 0 && ((d1->reads_rs && d1->rs == d0->dest) || (d1->reads_rt && d1->rt == d0->dest))){
+		return FALSE;	//RAW dependence inside the pair
+	}
+	if (d0->writes_hilo && d1->reads_hilo){
+		return FALSE;
+	}
+	return TRUE;
 }
 
 /************************************************************/
-/* Print the program loaded into memory (in MIPS assembly format)    */ 
+/* TRUE if d reads the result of a load that is still in the EX/MEM registers            */
 /************************************************************/
-void print_program(){
-	/*IMPLEMENT THIS*/
+int load_use_hazard(Decoded_Inst *d)
+{
+	CPU_Pipeline_Reg *older[MAX_ISSUE_WIDTH] = { &EX_MEM, &EX_MEM_S1 };
+	Decoded_Inst p;
 	int i;
-	uint32_t addr;
 	
-	for(i=0; i<PROGRAM_SIZE; i++){
-		addr = MEM_TEXT_BEGIN + (i*4);
-		printf("[0x%x]\t", addr);
-		print_instruction(addr);
+	for (i = 0; i < MAX_ISSUE_WIDTH; i++){
+		if (older[i]->Bubble){
+			continue;
+		}
+		decode_instruction(older[i]->IR, &p);
+		if (!p.is_load || p.dest == 0){
+			continue;
+		}
+		if ((d->reads_rs && d->rs == p.dest) || (d->reads_rt && d->rt == p.dest)){
+			return TRUE;
+		}
 	}
+	return FALSE;
 }
 
 /************************************************************/
-/* Print the instruction at given memory address (in MIPS assembly format)    */
+/* forget every result in flight, registers can be read from the register file      */
 /************************************************************/
-void print_instruction(uint32_t addr){
-	uint32_t instruction, opcode, function, rs, rt, rd, sa, immediate, target;
+void pipe_reset()
+{
+	memset(REG_READY, 0, sizeof(REG_READY));
+}
+
+/************************************************************/
+/* bubbles an instruction needs before it can enter EX at tick for its operands      */
+/* to be forwarded                                                                                                */
+/************************************************************/
+uint32_t pipe_hazard(Decoded_Inst *d, uint32_t tick)
+{
+	uint32_t ready = 0;
 	
-	instruction = mem_read_32(addr);
+	if (d->reads_rs && d->rs != 0){
+		ready = REG_READY[d->rs];
+	}
+	if (d->reads_rt && d->rt != 0 && REG_READY[d->rt] > ready){
+		ready = REG_READY[d->rt];
+	}
+	return ready > tick ? ready - tick : 0;
+}
+
+/************************************************************/
+/* an instruction enters EX at tick, note when its result can be forwarded             */
+/************************************************************/
+void pipe_produce(Decoded_Inst *d, uint32_t tick)
+{
+	if (d->dest != 0){
+		REG_READY[d->dest] = tick + (d->is_load ? LOAD_LATENCY : ALU_LATENCY);
+	}
+}
+
+/************************************************************/
+/* read a source register for EX, bypassing results from either MEM/WB slot        */
+/************************************************************/
+uint32_t forward_value(uint32_t reg)
+{
+	CPU_Pipeline_Reg *newer[MAX_ISSUE_WIDTH] = { &MEM_WB_S1, PIPE_RUNNING ? &PIPE.in : &MEM_WB };	//Younger slot first
+	Decoded_Inst p;
+	int i;
 	
-	opcode = (instruction & 0xFC000000) >> 26;
-	function = instruction & 0x0000003F;
-	rs = (instruction & 0x03E00000) >> 21;
-	rt = (instruction & 0x001F0000) >> 16;
-	rd = (instruction & 0x0000F800) >> 11;
-	sa = (instruction & 0x000007C0) >> 6;
-	immediate = instruction & 0x0000FFFF;
-	target = instruction & 0x03FFFFFF;
+	if (reg == 0){
+		return 0;
+	}
+	for (i = 0; i < MAX_ISSUE_WIDTH; i++){
+		if (newer[i]->Bubble){
+			continue;
+		}
+		decode_instruction(newer[i]->IR, &p);
+		if (p.dest == reg && !p.is_load){
+			return newer[i]->ALUOutput;
+		}
+	}
+	return NEXT_STATE.REGS[reg];	//Already written back this cycle or earlier
+}
+
+/************************************************************/
+/* resolve a branch or jump in EX, a taken one redirects fetch                                */
+/************************************************************/
+void pipeline_branch()
+{
+	Decoded_Inst d;
+	uint32_t next_pc;
 	
-	if(opcode == 0x00){
-		/*R format instructions here*/
-		
-		switch(function){
-			case 0x00:
-				printf("SLL $r%u, $r%u, 0x%x\n", rd, rt, sa);
-				break;
-			case 0x02:
-				printf("SRL $r%u, $r%u, 0x%x\n", rd, rt, sa);
+	decode_instruction(EX_MEM.IR, &d);
+	next_pc = branch_resolve(&d, EX_MEM.PC - 4, EX_MEM.A, EX_MEM.B);
+	if (d.dest != 0){
+		EX_MEM.ALUOutput = EX_MEM.PC;	//JAL and JALR link the return address
+	}
+	if (BRANCH_OUT.fp != NULL){
+		export_branch(EX_MEM.PC - 4, &d, next_pc);
+	}
+	if (IQ_ENTRIES > 0){
+		ooo_train(EX_MEM.PC - 4, &d, next_pc);
+		FE_BRANCHES++;
+		if (next_pc != EX_MEM.PredPC){
+			FE_MISPREDICTS++;	//The queue holds the wrong path
+			NEXT_STATE.PC = next_pc;
+			FETCH_REDIRECT = TRUE;
+			REDIRECT_TID = EX_MEM.TID;
+		}
+		return;
+	}
+	if (next_pc != EX_MEM.PC){
+		NEXT_STATE.PC = next_pc;
+		FETCH_REDIRECT = TRUE;
+		REDIRECT_TID = EX_MEM.TID;
+		if (next_pc < EX_MEM.PC){
+			LOOP_EDGE = next_pc;	//Candidate loop, cycle_skip compares iterations
+		}
+	}
+}
+
+/************************************************************/
+/* cross-slot forwarding into the ID/EX operands                                                   */
+/************************************************************/
+void forward_operands(CPU_Pipeline_Reg *reg)
+{
+	Decoded_Inst d;
+	
+	if (reg->Bubble){
+		return;
+	}
+	decode_instruction(reg->IR, &d);
+	if (d.reads_rs){
+		reg->A = forward_value(d.rs);
+	}
+	if (d.reads_rt){
+		reg->B = forward_value(d.rt);
+	}
+}
+
+/************************************************************/
+/* split an instruction into its fields and register usage                                        */
+/************************************************************/
+void decode_instruction(uint32_t instruction, Decoded_Inst *d)
+{
+	memset(d, 0, sizeof(Decoded_Inst));
+	d->opcode = (instruction & 0xFC000000) >> 26;
+	d->funct = instruction & 0x0000003F;
+	d->rs = (instruction & 0x03E00000) >> 21;
+	d->rt = (instruction & 0x001F0000) >> 16;
+	d->rd = (instruction & 0x0000F800) >> 11;
+	d->sa = (instruction & 0x000007C0) >> 6;
+	d->imm = instruction & 0x0000FFFF;
+	if (d->imm & 0x8000){
+		d->imm |= 0xFFFF0000;
+	}
+	d->target = instruction & 0x03FFFFFF;
+	
+	if (d->opcode == 0x00){
+		switch(d->funct){
+			case 0x00:	//SLL
+			case 0x02:	//SRL
+			case 0x03:	//SRA
+				d->reads_rt = 1;
+				d->dest = d->rd;
 				break;
-			case 0x03:
-				printf("SRA $r%u, $r%u, 0x%x\n", rd, rt, sa);
+			case 0x08:	//JR
+				d->reads_rs = 1;
+				d->is_branch = 1;
 				break;
-			case 0x08:
-				printf("JR $r%u\n", rs);
+			case 0x09:	//JALR
+				d->reads_rs = 1;
+				d->dest = d->rd;
+				d->is_branch = 1;
 				break;
-			case 0x09:
-				if(rd == 31){
-					printf("JALR $r%u\n", rs);
-				}
-				else{
-					printf("JALR $r%u, $r%u\n", rd, rs);
-				}
+			case 0x0C:	//SYSCALL, service number in $v0
+				d->rs = 2;
+				d->reads_rs = 1;
 				break;
-			case 0x0C:
-				printf("SYSCALL\n");
+			case 0x10:	//MFHI
+			case 0x12:	//MFLO
+				d->reads_hilo = 1;
+				d->dest = d->rd;
 				break;
-			case 0x10:
-				printf("MFHI $r%u\n", rd);
+			case 0x11:	//MTHI
+			case 0x13:	//MTLO
+				d->reads_rs = 1;
+				d->writes_hilo = 1;
 				break;
-			case 0x11:
-				printf("MTHI $r%u\n", rs);
+			case 0x18:	//MULT
+			case 0x19:	//MULTU
+			case 0x1A:	//DIV
+			case 0x1B:	//DIVU
+				d->reads_rs = 1;
+				d->reads_rt = 1;
+				d->writes_hilo = 1;
 				break;
-			case 0x12:
-				printf("MFLO $r%u\n", rd);
+			default:	//ADD, ADDU, SUB, SUBU, AND, OR, XOR, NOR, SLT
+				d->reads_rs = 1;
+				d->reads_rt = 1;
+				d->dest = d->rd;
 				break;
-			case 0x13:
-				printf("MTLO $r%u\n", rs);
+		}
+	}
+	else{
+		switch(d->opcode){
+			case 0x01:	//BLTZ OR BGEZ
+			case 0x06:	//BLEZ
+			case 0x07:	//BGTZ
+				d->reads_rs = 1;
+				d->is_branch = 1;
 				break;
-			case 0x18:
-				printf("MULT $r%u, $r%u\n", rs, rt);
+			case 0x02:	//J
+				d->is_branch = 1;
 				break;
-			case 0x19:
-				printf("MULTU $r%u, $r%u\n", rs, rt);
+			case 0x03:	//JAL
+				d->dest = 31;
+				d->is_branch = 1;
 				break;
-			case 0x1A:
-				printf("DIV $r%u, $r%u\n", rs, rt);
+			case 0x04:	//BEQ
+			case 0x05:	//BNE
+				d->reads_rs = 1;
+				d->reads_rt = 1;
+				d->is_branch = 1;
 				break;
-			case 0x1B:
-				printf("DIVU $r%u, $r%u\n", rs, rt);
+			case 0x0F:	//LUI
+				d->dest = d->rt;
 				break;
-			case 0x20:
-				printf("ADD $r%u, $r%u, $r%u\n", rd, rs, rt);
+			case 0x20:	//LB
+			case 0x21:	//LH
+			case 0x23:	//LW
+				d->reads_rs = 1;
+				d->dest = d->rt;
+				d->is_load = 1;
+				break;
+			case 0x28:	//SB
+			case 0x29:	//SH
+			case 0x2B:	//SW
+				d->reads_rs = 1;
+				d->reads_rt = 1;
+				d->is_store = 1;
+				break;
+			case 0x10:	//COP0, MFC0 writes rt and MTC0 reads it
+				if (d->rs == 0x00){
+					d->dest = d->rt;
+				}
+				else if (d->rs == 0x04){
+					d->reads_rt = 1;
+				}
+				break;
+			case 0x30:	//LL
+				d->reads_rs = 1;
+				d->dest = d->rt;
+				d->is_load = 1;
+				break;
+			case 0x38:	//SC, its result is known no earlier than a load's
+				d->reads_rs = 1;
+				d->reads_rt = 1;
+				d->dest = d->rt;
+				d->is_load = 1;
+				d->is_store = 1;
+				break;
+			default:	//ADDI, ADDIU, SLTI, ANDI, ORI, XORI
+				d->reads_rs = 1;
+				d->dest = d->rt;
+				break;
+		}
+	}
+}
+
+/************************************************************/
+/* compute the register or HI/LO result of a non-memory instruction                     */
+/* hi and lo hold the current values on entry and the new values on return           */
+/************************************************************/
+uint32_t alu_compute(Decoded_Inst *d, uint32_t pc, uint32_t a, uint32_t b, uint32_t *hi, uint32_t *lo)
+{
+	uint64_t product;
+	
+	if (d->opcode == 0x00){
+		switch(d->funct){
+			case 0x00:	//SLL
+				return b << d->sa;
+			case 0x02:	//SRL
+				return b >> d->sa;
+			case 0x03:	//SRA
+				return (uint32_t)((int32_t)b >> d->sa);
+			case 0x09:	//JALR
+				return pc + 4;
+			case 0x10:	//MFHI
+				return *hi;
+			case 0x11:	//MTHI
+				*hi = a;
+				return 0;
+			case 0x12:	//MFLO
+				return *lo;
+			case 0x13:	//MTLO
+				*lo = a;
+				return 0;
+			case 0x18:	//MULT
+				product = (uint64_t)((int64_t)(int32_t)a * (int64_t)(int32_t)b);
+				*lo = product & 0xFFFFFFFF;
+				*hi = product >> 32;
+				return 0;
+			case 0x19:	//MULTU
+				product = (uint64_t)a * (uint64_t)b;
+				*lo = product & 0xFFFFFFFF;
+				*hi = product >> 32;
+				return 0;
+			case 0x1A:	//DIV
+				if (b != 0){
+					*lo = (uint32_t)((int32_t)a / (int32_t)b);
+					*hi = (uint32_t)((int32_t)a % (int32_t)b);
+				}
+				return 0;
+			case 0x1B:	//DIVU
+				if (b != 0){
+					*lo = a / b;
+					*hi = a % b;
+				}
+				return 0;
+			case 0x20:	//ADD
+			case 0x21:	//ADDU
+				return a + b;
+			case 0x22:	//SUB
+			case 0x23:	//SUBU
+				return a - b;
+			case 0x24:	//AND
+				return a & b;
+			case 0x25:	//OR
+				return a | b;
+			case 0x26:	//XOR
+				return a ^ b;
+			case 0x27:	//NOR
+				return ~(a | b);
+			case 0x2A:	//SLT
+				return (int32_t)a < (int32_t)b;
+			default:
+				return 0;
+		}
+	}
+	switch(d->opcode){
+		case 0x03:	//JAL
+			return pc + 4;
+		case 0x08:	//ADDI
+		case 0x09:	//ADDIU
+			return a + d->imm;
+		case 0x0A:	//SLTI
+			return (int32_t)a < (int32_t)d->imm;
+		case 0x0C:	//ANDI
+			return a & (d->imm & 0x0000FFFF);
+		case 0x0D:	//ORI
+			return a | (d->imm & 0x0000FFFF);
+		case 0x0E:	//XORI
+			return a ^ (d->imm & 0x0000FFFF);
+		case 0x0F:	//LUI
+			return d->imm << 16;
+		default:
+			return 0;
+	}
+}
+
+/************************************************************/
+/* address of the instruction executed after a branch or jump at pc                        */
+/************************************************************/
+uint32_t branch_resolve(Decoded_Inst *d, uint32_t pc, uint32_t a, uint32_t b)
+{
+	uint32_t taken_pc = pc + 4 + (d->imm << 2);
+	int taken = FALSE;
+	
+	if (d->opcode == 0x00){	//JR, JALR
+		return a;
+	}
+	switch(d->opcode){
+		case 0x01:	//BLTZ OR BGEZ
+			taken = (d->rt == 0) ? ((int32_t)a < 0) : ((int32_t)a >= 0);
+			break;
+		case 0x02:	//J
+		case 0x03:	//JAL
+			return ((pc + 4) & 0xF0000000) | (d->target << 2);
+		case 0x04:	//BEQ
+			taken = (a == b);
+			break;
+		case 0x05:	//BNE
+			taken = (a != b);
+			break;
+		case 0x06:	//BLEZ
+			taken = ((int32_t)a <= 0);
+			break;
+		case 0x07:	//BGTZ
+			taken = ((int32_t)a > 0);
+			break;
+	}
+	return taken ? taken_pc : pc + 4;
+}
+
+/************************************************************/
+/* extract the value of a load from the aligned word containing addr                      */
+/************************************************************/
+uint32_t extract_load(Decoded_Inst *d, uint32_t addr, uint32_t word)
+{
+	uint32_t shift = (addr & 0x3) * 8;
+	
+	switch(d->opcode){
+		case 0x20:	//LB
+			return (uint32_t)(int32_t)(int8_t)((word >> shift) & 0xFF);
+		case 0x21:	//LH
+			return (uint32_t)(int32_t)(int16_t)((word >> shift) & 0xFFFF);
+		default:	//LW
+			return word;
+	}
+}
+
+/************************************************************/
+/* perform a load                                                                                                      */
+/************************************************************/
+uint32_t load_data(Decoded_Inst *d, uint32_t addr)
+{
+	return extract_load(d, addr, mem_read_32(addr & ~0x3));
+}
+
+/************************************************************/
+/* the aligned word containing addr after a store of value into word                       */
+/************************************************************/
+uint32_t merge_store(Decoded_Inst *d, uint32_t addr, uint32_t word, uint32_t value)
+{
+	uint32_t shift = (addr & 0x3) * 8;
+	uint32_t mask;
+	
+	switch(d->opcode){
+		case 0x28:	//SB
+			mask = 0xFF << shift;
+			break;
+		case 0x29:	//SH
+			mask = 0xFFFF << shift;
+			break;
+		default:	//SW
+			return value;
+	}
+	return (word & ~mask) | ((value << shift) & mask);
+}
+
+/************************************************************/
+/* perform a store, SB and SH merge into the existing word                                */
+/************************************************************/
+void store_data(Decoded_Inst *d, uint32_t addr, uint32_t value)
+{
+	if (d->opcode == 0x28 || d->opcode == 0x29){	//SB, SH
+		value = merge_store(d, addr, mem_read_32(addr & ~0x3), value);
+	}
+	mem_write_32(addr & ~0x3, value);
+}
+
+/************************************************************/
+/* empty the out-of-order core and restart fetch at the current PC                          */
+/************************************************************/
+void ooo_reset()
+{
+	int i;
+	
+	memset(ROB, 0, sizeof(ROB));
+	memset(RS, 0, sizeof(RS));
+	memset(LSQ, 0, sizeof(LSQ));
+	ROB_HEAD = ROB_COUNT = 0;
+	LSQ_HEAD = LSQ_COUNT = 0;
+	FQ_HEAD = FQ_COUNT = 0;
+	for (i = 0; i < OOO_NUM_REGS; i++){
+		RAT[i] = -1;
+	}
+	memset(BP_COUNTERS, 1, sizeof(BP_COUNTERS));	//Weakly not taken
+	memset(BTB, 0, sizeof(BTB));
+	FETCH_PC = CURRENT_STATE.PC;
+	
+	OOO_ROB_OCCUPANCY = 0;
+	OOO_ROB_MAX = 0;
+	OOO_ISSUED = 0;
+	OOO_LOADS_INFLIGHT = 0;
+	OOO_MLP_CYCLES = 0;
+	OOO_BRANCHES = OOO_MISPREDICTS = 0;
+	OOO_FORWARDED_LOADS = 0;
+}
+
+/************************************************************/
+/* advance the out-of-order core by one cycle                                                        */
+/* stages run back to front so each sees the state left by the previous cycle       */
+/************************************************************/
+void ooo_cycle()
+{
+	NEXT_STATE = CURRENT_STATE;
+	ooo_commit();
+	ooo_execute();
+	ooo_memory();
+	ooo_issue();
+	ooo_dispatch();
+	ooo_fetch();
+	
+	OOO_ROB_OCCUPANCY += ROB_COUNT;
+	if (ROB_COUNT > OOO_ROB_MAX){
+		OOO_ROB_MAX = ROB_COUNT;
+	}
+}
+
+/************************************************************/
+/* position of a ROB entry counted from the head (oldest is 0)                               */
+/************************************************************/
+int ooo_rob_age(int rob)
+{
+	return (rob - ROB_HEAD + OOO_ROB_SIZE) % OOO_ROB_SIZE;
+}
+
+/************************************************************/
+/* retire finished instructions in program order into the architectural state        */
+/************************************************************/
+void ooo_commit()
+{
+	ROB_Entry *e;
+	LSQ_Entry *l;
+	int n;
+	
+	for (n = 0; n < OOO_WIDTH && ROB_COUNT > 0; n++){
+		e = &ROB[ROB_HEAD];
+		if (!e->done){
+			break;
+		}
+		if (e->d.is_store){
+			l = &LSQ[e->lsq];
+			store_data(&e->d, l->addr, l->Vdata);
+		}
+		if (e->d.dest != 0){
+			NEXT_STATE.REGS[e->d.dest] = e->value;
+			if (RAT[e->d.dest] == ROB_HEAD){
+				RAT[e->d.dest] = -1;
+			}
+		}
+		if (e->d.writes_hilo){
+			NEXT_STATE.HI = e->hi;
+			NEXT_STATE.LO = e->lo;
+			if (RAT[OOO_REG_HILO] == ROB_HEAD){
+				RAT[OOO_REG_HILO] = -1;
+			}
+		}
+		if (FINGERPRINT){
+			commit_hash(e->PC, &e->d, e->value, e->lsq >= 0 ? LSQ[e->lsq].addr : 0);
+		}
+		if (LOCKSTEP){
+			lockstep_check(e->PC, &e->d, e->value, e->lsq >= 0 ? LSQ[e->lsq].addr : 0);
+		}
+		if (e->d.is_load && !e->d.is_store && LSQ[e->lsq].addr >= MMIO_BEGIN){
+			mmio_consume(LSQ[e->lsq].addr);
+		}
+		if (e->lsq >= 0){
+			LSQ[LSQ_HEAD].busy = 0;
+			LSQ_HEAD = (LSQ_HEAD + 1) % OOO_LSQ_SIZE;
+			LSQ_COUNT--;
+		}
+		NEXT_STATE.PC = e->next_pc;
+		INSTRUCTION_COUNT++;
+		e->busy = 0;
+		ROB_HEAD = (ROB_HEAD + 1) % OOO_ROB_SIZE;
+		ROB_COUNT--;
+		
+		if (e->d.opcode == 0x00 && e->d.funct == 0x0C && NEXT_STATE.REGS[2] == 0xA){	//SYSCALL exit
+			RUN_FLAG = FALSE;
+			break;
+		}
+	}
+}
+
+/************************************************************/
+/* pass a finished result to every waiting reservation station and LSQ entry           */
+/************************************************************/
+void ooo_broadcast(int rob, uint32_t value, uint32_t hi, uint32_t lo)
+{
+	RS_Entry *rs;
+	int c, i;
+	
+	for (c = 0; c < FU_CLASSES; c++){
+		for (i = 0; i < OOO_RS_SIZE; i++){
+			rs = &RS[c][i];
+			if (!rs->busy){
+				continue;
+			}
+			if (rs->Qj == rob){
+				rs->Vj = value;
+				rs->Qj = -1;
+			}
+			if (rs->Qk == rob){
+				rs->Vk = value;
+				rs->Qk = -1;
+			}
+			if (rs->Qhl == rob){
+				rs->Vhi = hi;
+				rs->Vlo = lo;
+				rs->Qhl = -1;
+			}
+		}
+	}
+	for (i = 0; i < OOO_LSQ_SIZE; i++){
+		if (!LSQ[i].busy){
+			continue;
+		}
+		if (LSQ[i].Qbase == rob){
+			LSQ[i].Vbase = value;
+			LSQ[i].Qbase = -1;
+		}
+		if (LSQ[i].Qdata == rob){
+			LSQ[i].Vdata = value;
+			LSQ[i].Qdata = -1;
+		}
+	}
+}
+
+/************************************************************/
+/* finish functional unit operations and resolve branches                                       */
+/************************************************************/
+void ooo_execute()
+{
+	RS_Entry *rs;
+	ROB_Entry *e;
+	uint32_t next_pc;
+	int c, i, rob;
+	
+	for (c = 0; c < FU_CLASSES; c++){
+		for (i = 0; i < OOO_RS_SIZE; i++){
+			rs = &RS[c][i];
+			if (!rs->busy || !rs->executing || --rs->remaining > 0){
+				continue;
+			}
+			rob = rs->rob;
+			e = &ROB[rob];
+			e->hi = rs->Vhi;
+			e->lo = rs->Vlo;
+			e->value = alu_compute(&e->d, e->PC, rs->Vj, rs->Vk, &e->hi, &e->lo);
+			e->done = 1;
+			rs->busy = 0;
+			ooo_broadcast(rob, e->value, e->hi, e->lo);
+			
+			if (c == FU_BRANCH){
+				next_pc = branch_resolve(&e->d, e->PC, rs->Vj, rs->Vk);
+				ooo_train(e->PC, &e->d, next_pc);
+				OOO_BRANCHES++;
+				if (next_pc != e->next_pc){
+					OOO_MISPREDICTS++;
+					e->next_pc = next_pc;
+					ooo_recover(rob);
+				}
+			}
+		}
+	}
+}
+
+/************************************************************/
+/* address generation, memory disambiguation and store-to-load forwarding             */
+/************************************************************/
+void ooo_memory()
+{
+	LSQ_Entry *l, *s, *match;
+	ROB_Entry *e;
+	int n, k, idx, blocked, inflight = 0;
+	
+	for (n = 0; n < LSQ_COUNT; n++){
+		idx = (LSQ_HEAD + n) % OOO_LSQ_SIZE;
+		l = &LSQ[idx];
+		e = &ROB[l->rob];
+		
+		if (l->accessing){
+			inflight++;
+			if (--l->remaining == 0){
+				e->value = load_data(&e->d, l->addr);
+				e->done = 1;
+				l->accessing = 0;
+				ooo_broadcast(l->rob, e->value, 0, 0);
+			}
+			continue;
+		}
+		if (e->done){
+			continue;
+		}
+		if (!l->addr_ready){
+			if (l->Qbase == -1){
+				l->addr = l->Vbase + e->d.imm;	//Address generation takes this cycle
+				l->addr_ready = 1;
+			}
+			continue;
+		}
+		if (e->d.is_store){
+			if (l->Qdata == -1){
+				e->done = 1;	//Memory is written at commit
+				if (e->d.dest != 0){
+					e->value = 1;	//SC, nothing else can break the link of a single core
+					ooo_broadcast(l->rob, e->value, 0, 0);
+				}
+			}
+			continue;
+		}
+		
+		if (l->addr >= MMIO_BEGIN && l->rob != ROB_HEAD){
+			continue;	//Device loads are not speculative, they wait to be the oldest
+		}
+		/* a load may go once every older store has an address */
+		blocked = FALSE;
+		match = NULL;
+		for (k = 0; k < n; k++){
+			s = &LSQ[(LSQ_HEAD + k) % OOO_LSQ_SIZE];
+			if (!ROB[s->rob].d.is_store){
+				continue;
+			}
+			if (!s->addr_ready){
+				blocked = TRUE;
+				break;
+			}
+			if ((s->addr & ~0x3) == (l->addr & ~0x3)){
+				match = s;	//Youngest older store to the same word
+			}
+		}
+		if (blocked){
+			continue;
+		}
+		if (match != NULL){
+			if (ROB[match->rob].d.opcode != 0x2B || match->Qdata != -1){
+				continue;	//Partial store or data not ready, wait for it to commit
+			}
+			e->value = extract_load(&e->d, l->addr, match->Vdata);
+			e->done = 1;
+			OOO_FORWARDED_LOADS++;
+			ooo_broadcast(l->rob, e->value, 0, 0);
+			continue;
+		}
+		l->accessing = 1;
+		l->remaining = OOO_MEM_LATENCY;
+		inflight++;
+	}
+	
+	if (inflight > 0){
+		OOO_LOADS_INFLIGHT += inflight;
+		OOO_MLP_CYCLES++;
+	}
+}
+
+/************************************************************/
+/* send ready reservation station entries to functional units, oldest first             */
+/************************************************************/
+void ooo_issue()
+{
+	RS_Entry *rs, *pick;
+	int units[FU_CLASSES];
+	int c, i, n, pick_class;
+	
+	units[FU_ALU] = OOO_WIDTH;
+	units[FU_MULDIV] = 1;	//Not pipelined
+	units[FU_BRANCH] = 1;
+	for (i = 0; i < OOO_RS_SIZE; i++){
+		if (RS[FU_MULDIV][i].busy && RS[FU_MULDIV][i].executing){
+			units[FU_MULDIV] = 0;
+		}
+	}
+	
+	for (n = 0; n < OOO_WIDTH; n++){
+		pick = NULL;
+		pick_class = 0;
+		for (c = 0; c < FU_CLASSES; c++){
+			if (units[c] == 0){
+				continue;
+			}
+			for (i = 0; i < OOO_RS_SIZE; i++){
+				rs = &RS[c][i];
+				if (!rs->busy || rs->executing || rs->Qj != -1 || rs->Qk != -1 || rs->Qhl != -1){
+					continue;
+				}
+				if (pick == NULL || ooo_rob_age(rs->rob) < ooo_rob_age(pick->rob)){
+					pick = rs;
+					pick_class = c;
+				}
+			}
+		}
+		if (pick == NULL){
+			break;
+		}
+		pick->executing = 1;
+		pick->remaining = (pick_class == FU_MULDIV) ? OOO_MULDIV_LATENCY : 1;
+		units[pick_class]--;
+		OOO_ISSUED++;
+	}
+}
+
+/************************************************************/
+/* functional unit class of a non-memory instruction                                                 */
+/************************************************************/
+int ooo_fu_class(Decoded_Inst *d)
+{
+	if (d->is_branch){
+		return FU_BRANCH;
+	}
+	if (d->opcode == 0x00 && d->funct >= 0x18 && d->funct <= 0x1B){
+		return FU_MULDIV;
+	}
+	return FU_ALU;
+}
+
+/************************************************************/
+/* read a renamed source register, tag is -1 when the value is available              */
+/************************************************************/
+void ooo_read_operand(uint32_t reg, uint32_t *value, int *tag)
+{
+	*value = 0;
+	*tag = -1;
+	if (reg == 0){
+		return;
+	}
+	if (RAT[reg] == -1){
+		*value = NEXT_STATE.REGS[reg];
+	}
+	else if (ROB[RAT[reg]].done){
+		*value = ROB[RAT[reg]].value;
+	}
+	else{
+		*tag = RAT[reg];
+	}
+}
+
+/************************************************************/
+/* rename and dispatch instructions from the fetch queue into the ROB, RS and LSQ */
+/************************************************************/
+void ooo_dispatch()
+{
+	Fetch_Entry *f;
+	ROB_Entry *e;
+	RS_Entry *rs;
+	LSQ_Entry *l;
+	Decoded_Inst d;
+	int n, i, c, rob, mem, syscall;
+	
+	for (n = 0; n < OOO_WIDTH && FQ_COUNT > 0; n++){
+		f = &FETCH_QUEUE[FQ_HEAD];
+		decode_instruction(f->IR, &d);
+		mem = d.is_load || d.is_store;
+		syscall = (d.opcode == 0x00 && d.funct == 0x0C);
+		
+		if (ROB_COUNT == OOO_ROB_SIZE){
+			break;
+		}
+		rs = NULL;
+		c = ooo_fu_class(&d);
+		if (mem){
+			if (LSQ_COUNT == OOO_LSQ_SIZE){
+				break;
+			}
+		}
+		else if (!syscall){
+			for (i = 0; i < OOO_RS_SIZE && rs == NULL; i++){
+				if (!RS[c][i].busy){
+					rs = &RS[c][i];
+				}
+			}
+			if (rs == NULL){
+				break;
+			}
+		}
+		
+		rob = (ROB_HEAD + ROB_COUNT) % OOO_ROB_SIZE;
+		ROB_COUNT++;
+		e = &ROB[rob];
+		memset(e, 0, sizeof(ROB_Entry));
+		e->busy = 1;
+		e->PC = f->PC;
+		e->IR = f->IR;
+		e->d = d;
+		e->next_pc = f->next_pc;
+		e->lsq = -1;
+		
+		if (mem){
+			e->lsq = (LSQ_HEAD + LSQ_COUNT) % OOO_LSQ_SIZE;
+			LSQ_COUNT++;
+			l = &LSQ[e->lsq];
+			memset(l, 0, sizeof(LSQ_Entry));
+			l->busy = 1;
+			l->rob = rob;
+			ooo_read_operand(d.rs, &l->Vbase, &l->Qbase);
+			l->Qdata = -1;
+			if (d.is_store){
+				ooo_read_operand(d.rt, &l->Vdata, &l->Qdata);
+			}
+		}
+		else if (syscall){
+			e->done = 1;	//Takes effect at commit
+		}
+		else{
+			memset(rs, 0, sizeof(RS_Entry));
+			rs->busy = 1;
+			rs->rob = rob;
+			rs->Qj = rs->Qk = rs->Qhl = -1;
+			if (d.reads_rs){
+				ooo_read_operand(d.rs, &rs->Vj, &rs->Qj);
+			}
+			if (d.reads_rt){
+				ooo_read_operand(d.rt, &rs->Vk, &rs->Qk);
+			}
+			if (d.reads_hilo || (d.writes_hilo && (d.funct == 0x11 || d.funct == 0x13))){	//MTHI/MTLO keep the other half
+				if (RAT[OOO_REG_HILO] == -1){
+					rs->Vhi = NEXT_STATE.HI;
+					rs->Vlo = NEXT_STATE.LO;
+				}
+				else if (ROB[RAT[OOO_REG_HILO]].done){
+					rs->Vhi = ROB[RAT[OOO_REG_HILO]].hi;
+					rs->Vlo = ROB[RAT[OOO_REG_HILO]].lo;
+				}
+				else{
+					rs->Qhl = RAT[OOO_REG_HILO];
+				}
+			}
+		}
+		
+		if (d.dest != 0){
+			RAT[d.dest] = rob;
+		}
+		if (d.writes_hilo){
+			RAT[OOO_REG_HILO] = rob;
+		}
+		FQ_HEAD = (FQ_HEAD + 1) % OOO_FETCH_QUEUE;
+		FQ_COUNT--;
+	}
+}
+
+/************************************************************/
+/* fetch along the predicted path into the fetch queue                                           */
+/************************************************************/
+void ooo_fetch()
+{
+	Fetch_Entry *f;
+	int n;
+	
+	for (n = 0; n < OOO_WIDTH && FQ_COUNT < OOO_FETCH_QUEUE; n++){
+		f = &FETCH_QUEUE[(FQ_HEAD + FQ_COUNT) % OOO_FETCH_QUEUE];
+		FQ_COUNT++;
+		f->PC = FETCH_PC;
+		f->IR = mem_read_32(FETCH_PC);
+		f->next_pc = ooo_predict(f->PC, f->IR);
+		FETCH_PC = f->next_pc;
+		if (f->next_pc != f->PC + 4){
+			break;	//Taken branch ends the fetch group
+		}
+	}
+}
+
+/************************************************************/
+/* bimodal direction prediction, BTB for register jumps                                        */
+/************************************************************/
+uint32_t ooo_predict(uint32_t pc, uint32_t instruction)
+{
+	Decoded_Inst d;
+	uint32_t idx = (pc >> 2) % OOO_BP_ENTRIES;
+	
+	decode_instruction(instruction, &d);
+	if (!d.is_branch){
+		return pc + 4;
+	}
+	if (d.opcode == 0x00){	//JR, JALR
+		return BTB[idx] ? BTB[idx] : pc + 4;
+	}
+	if (d.opcode == 0x02 || d.opcode == 0x03){	//J, JAL
+		return branch_resolve(&d, pc, 0, 0);
+	}
+	return (BP_COUNTERS[idx] >= 2) ? pc + 4 + (d.imm << 2) : pc + 4;
+}
+
+/************************************************************/
+/* update the predictor with a resolved branch                                                       */
+/************************************************************/
+void ooo_train(uint32_t pc, Decoded_Inst *d, uint32_t next_pc)
+{
+	uint32_t idx = (pc >> 2) % OOO_BP_ENTRIES;
+	
+	if (d->opcode == 0x00){
+		BTB[idx] = next_pc;
+	}
+	else if (next_pc != pc + 4){
+		if (BP_COUNTERS[idx] < 3){
+			BP_COUNTERS[idx]++;
+		}
+	}
+	else if (BP_COUNTERS[idx] > 0){
+		BP_COUNTERS[idx]--;
+	}
+}
+
+/************************************************************/
+/* squash everything younger than a mispredicted branch and refetch                     */
+/************************************************************/
+void ooo_recover(int rob)
+{
+	int age = ooo_rob_age(rob);
+	int c, i, idx;
+	
+	for (c = 0; c < FU_CLASSES; c++){
+		for (i = 0; i < OOO_RS_SIZE; i++){
+			if (RS[c][i].busy && ooo_rob_age(RS[c][i].rob) > age){
+				RS[c][i].busy = 0;
+			}
+		}
+	}
+	while (LSQ_COUNT > 0){
+		idx = (LSQ_HEAD + LSQ_COUNT - 1) % OOO_LSQ_SIZE;
+		if (ooo_rob_age(LSQ[idx].rob) <= age){
+			break;
+		}
+		LSQ[idx].busy = 0;
+		LSQ_COUNT--;
+	}
+	while (ROB_COUNT > age + 1){
+		ROB[(ROB_HEAD + ROB_COUNT - 1) % OOO_ROB_SIZE].busy = 0;
+		ROB_COUNT--;
+	}
+	
+	/* rebuild the rename table from the surviving entries */
+	for (i = 0; i < OOO_NUM_REGS; i++){
+		RAT[i] = -1;
+	}
+	for (i = 0; i < ROB_COUNT; i++){
+		idx = (ROB_HEAD + i) % OOO_ROB_SIZE;
+		if (ROB[idx].d.dest != 0){
+			RAT[ROB[idx].d.dest] = idx;
+		}
+		if (ROB[idx].d.writes_hilo){
+			RAT[OOO_REG_HILO] = idx;
+		}
+	}
+	
+	FQ_COUNT = 0;
+	FETCH_PC = ROB[rob].next_pc;
+}
+
+/************************************************************/
+/* give every hardware thread a fresh context copied from thread 0                      */
+/* thread t starts with t in $a0 so one program can split its work                           */
+/************************************************************/
+void mt_reset()
+{
+	int t;
+	
+	switch_thread(0);
+	for (t = 0; t < MAX_THREADS; t++){
+		THREADS[t].current = CURRENT_STATE;
+		if (t > 0){
+			THREADS[t].current.REGS[4] = t;
+		}
+		THREADS[t].next = THREADS[t].current;
+		THREADS[t].running = (t < NUM_THREADS);
+		THREADS[t].instructions = 0;
+		THREADS[t].wait = 0;
+		THREADS[t].replay_pc = 0;
+		THREADS[t].text_offset = (THREADS[t].prog_file[0] != '\0') ? t * THREAD_TEXT_STRIDE : 0;
+	}
+	FETCH_OFFSET = 0;
+	LAST_FETCH_THREAD = NUM_THREADS - 1;	//Round robin starts at thread 0
+	memset(PENDING_WRITES, 0, sizeof(PENDING_WRITES));
+	MT_SQUASHES = 0;
+	MT_PARKS = 0;
+}
+
+/************************************************************/
+/* make thread t the context seen through CURRENT_STATE and NEXT_STATE                */
+/************************************************************/
+void switch_thread(int t)
+{
+	if (t == ACTIVE_THREAD){
+		return;
+	}
+	THREADS[ACTIVE_THREAD].current = CURRENT_STATE;
+	THREADS[ACTIVE_THREAD].next = NEXT_STATE;
+	CURRENT_STATE = THREADS[t].current;
+	NEXT_STATE = THREADS[t].next;
+	FETCH_OFFSET = THREADS[t].text_offset;
+	ACTIVE_THREAD = t;
+}
+
+/************************************************************/
+/* maintain the pipeline shared by NUM_THREADS hardware threads                          */
+/* each stage runs in the context of the thread that owns its instruction              */
+/************************************************************/
+void handle_pipeline_mt()
+{
+	Decoded_Inst d;
+	uint32_t retired;
+	int t, blocked;
+	int wb_tid = -1;
+	uint32_t wb_dest = 0;
+	
+	for (t = 0; t < NUM_THREADS; t++){
+		if (t != ACTIVE_THREAD){
+			THREADS[t].next = THREADS[t].current;	//handle_pipeline did the active thread
+		}
+		if (THREADS[t].wait > 0){
+			THREADS[t].wait--;
+		}
+	}
+	
+	switch_thread(MEM_WB.TID);
+	retired = INSTRUCTION_COUNT;
+	WB();
+	THREADS[MEM_WB.TID].instructions += INSTRUCTION_COUNT - retired;
+	if (!MEM_WB.Bubble){
+		decode_instruction(MEM_WB.IR, &d);
+		wb_tid = MEM_WB.TID;
+		wb_dest = d.dest;
+	}
+	
+	t = EX_MEM.TID;
+	switch_thread(t);
+	MEM();
+	if (mem_stall > 0){
+		mt_park(t, mem_stall);
+		mem_stall = 0;	//The pipeline itself does not freeze
+	}
+	else if (!MEM_WB.Bubble && MEM_WB.PC == THREADS[t].replay_pc){
+		THREADS[t].replay_pc = 0;
+	}
+	
+	switch_thread(ID_EX.TID);
+	EX();
+	if (RUN_FLAG == FALSE){	//SYSCALL exit only ends its own thread
+		THREADS[ID_EX.TID].running = FALSE;
+	}
+	
+	blocked = ID_mt();
+	if (FETCH_REDIRECT && blocked < 0){
+		blocked = REDIRECT_TID;	//Its next fetch comes from the branch target
+	}
+	
+	t = select_fetch_thread(blocked);
+	if (t >= 0){
+		switch_thread(t);
+		IF();
+		LAST_FETCH_THREAD = t;
+	}
+	else{
+		insert_bubble(&IF_ID);
+		for (t = 0; t < NUM_THREADS; t++){
+			if (THREADS[t].running && THREADS[t].wait > 0){
+				MEM_STALL_CYCLES++;	//Nothing to fetch while a thread waits for memory
+				break;
+			}
+		}
+	}
+	
+	/* a register becomes readable in ID the cycle after its write back */
+	if (wb_tid >= 0 && wb_dest != 0){
+		PENDING_WRITES[wb_tid][wb_dest]--;
+	}
+	
+	FETCH_REDIRECT = FALSE;
+	RUN_FLAG = !EX_MEM.Bubble || !MEM_WB.Bubble;	//Drain instructions older than the last exit
+	for (t = 0; t < NUM_THREADS; t++){
+		if (t != ACTIVE_THREAD){
+			THREADS[t].current = THREADS[t].next;	//cycle() commits the active thread
+		}
+		if (THREADS[t].running){
+			RUN_FLAG = TRUE;
+		}
+	}
+}
+
+/************************************************************/
+/* the instruction of thread t in MEM/WB missed for cycles: squash the thread's   */
+/* younger instructions and let it fetch again once the miss is over                   */
+/************************************************************/
+void mt_park(int t, int cycles)
+{
+	Decoded_Inst d;
+	uint32_t resume;
+	int replay;
+	
+	decode_instruction(MEM_WB.IR, &d);
+	replay = d.is_load && !d.is_store && MEM_WB.PC != THREADS[t].replay_pc;
+	resume = replay ? MEM_WB.PC - 4 : MEM_WB.PC;
+	if (replay){
+		if (d.dest != 0){
+			PENDING_WRITES[t][d.dest]--;
+		}
+		insert_bubble(&MEM_WB);	//The load refetches and hits
+	}
+	if (!ID_EX.Bubble && ID_EX.TID == t){
+		decode_instruction(ID_EX.IR, &d);
+		if (d.dest != 0){
+			PENDING_WRITES[t][d.dest]--;
+		}
+		insert_bubble(&ID_EX);
+	}
+	if (!IF_ID.Bubble && IF_ID.TID == t){
+		insert_bubble(&IF_ID);
+	}
+	NEXT_STATE.PC = resume;
+	THREADS[t].replay_pc = replay ? resume + 4 : 0;
+	THREADS[t].wait = cycles;
+	MT_PARKS++;
+}
+
+/************************************************************/
+/* decode for the barrel pipeline, returns the thread that lost its slot or -1          */
+/* an instruction that would stall is squashed so another thread can use the slot */
+/************************************************************/
+int ID_mt()
+{
+	Decoded_Inst d;
+	int t = IF_ID.TID;
+	
+	if (IF_ID.Bubble){
+		ID();
+		return -1;
+	}
+	switch_thread(t);
+	if (!THREADS[t].running || (FETCH_REDIRECT && t == REDIRECT_TID)){
+		insert_bubble(&ID_EX);	//Fetched past the thread's exit or a taken branch
+		return -1;
+	}
+	
+	decode_instruction(IF_ID.IR, &d);
+	if ((d.reads_rs && PENDING_WRITES[t][d.rs]) || (d.reads_rt && PENDING_WRITES[t][d.rt])){
+		insert_bubble(&ID_EX);
+		NEXT_STATE.PC = IF_ID.PC - 4;	//Refetch it the next time the thread is picked
+		MT_SQUASHES++;
+		return t;
+	}
+	
+	ID();
+	if (!ID_EX.Bubble && d.reads_rs){
+		ID_EX.A = CURRENT_STATE.REGS[d.rs];	//SYSCALL reads $v0, not its rs field
+	}
+	if (d.dest != 0){
+		PENDING_WRITES[t][d.dest]++;
+	}
+	return -1;
+}
+
+/************************************************************/
+/* pick the thread to fetch from, -1 if none can fetch                                           */
+/************************************************************/
+int select_fetch_thread(int blocked)
+{
+	int inflight[MAX_THREADS];
+	int i, t, best = -1;
+	
+	if (FETCH_POLICY == FETCH_SWITCH_ON_STALL && LAST_FETCH_THREAD != blocked && THREADS[LAST_FETCH_THREAD].running &&
+		THREADS[LAST_FETCH_THREAD].wait == 0){
+		return LAST_FETCH_THREAD;
+	}
+	
+	memset(inflight, 0, sizeof(inflight));
+	if (FETCH_POLICY == FETCH_ICOUNT){
+		if (!ID_EX.Bubble) inflight[ID_EX.TID]++;
+		if (!EX_MEM.Bubble) inflight[EX_MEM.TID]++;
+		if (!MEM_WB.Bubble) inflight[MEM_WB.TID]++;
+	}
+	
+	for (i = 1; i <= NUM_THREADS; i++){
+		t = (LAST_FETCH_THREAD + i) % NUM_THREADS;
+		if (!THREADS[t].running || t == blocked || THREADS[t].wait > 0){
+			continue;
+		}
+		if (FETCH_POLICY != FETCH_ICOUNT){
+			return t;
+		}
+		if (best == -1 || inflight[t] < inflight[best]){
+			best = t;
+		}
+	}
+	return best;
+}
+
+/************************************************************/
+/* load a separate program for thread t at its own text offset                                */
+/************************************************************/
+void load_thread_program(int t, char *file)
+{
+	if (t < 1 || t >= MAX_THREADS){
+		printf("Thread must be between 1 and %d, thread 0 runs %s\n", MAX_THREADS - 1, prog_file);
+		return;
+	}
+	if (strlen(file) >= PROG_PATH_SIZE || access(file, R_OK) != 0){
+		printf("Error: Can't open program file %s\n", file);	//load_program_file would exit
+		return;
+	}
+	strcpy(THREADS[t].prog_file, file);
+	load_program_file(THREADS[t].prog_file, MEM_TEXT_BEGIN + t * THREAD_TEXT_STRIDE);
+	THREADS[t].text_offset = t * THREAD_TEXT_STRIDE;
+	if (t == ACTIVE_THREAD){
+		FETCH_OFFSET = THREADS[t].text_offset;
+	}
+}
+
+/************************************************************/
+/* clear the data caches, directory, message queues and core contexts                   */
+/************************************************************/
+void mc_reset()
+{
+	memset(CORES, 0, MC_CORES_USED * sizeof(Core_Context));	//Server jobs would copy all of it
+	if (MC_CORES_USED > 1){
+		memset(MC_QUEUES, 0, sizeof(MC_QUEUES));
+		memset(MC_DIRECTORY, 0, sizeof(MC_DIRECTORY));
+	}
+	memset(LL_VERSION, 0, sizeof(LL_VERSION));
+	MC_CORES_USED = 1;	//Core 0 backs the single-core data cache
+	CORE_ID = 0;
+	DCACHE = &CORES[0].dcache;
+	mem_stall = 0;
+	sb_reset();	//It drains into that cache
+	pf_reset();
+}
+
+/************************************************************/
+/* line of the data cache holding line address line, NULL on a miss                        */
+/************************************************************/
+Cache_Line *dcache_lookup(uint32_t line)
+{
+	uint32_t sets = DCACHE_KB * 1024 / DCACHE_LINE / DCACHE_ASSOC;
+	Cache_Line *way = &DCACHE->lines[(line % sets) * DCACHE_ASSOC];
+	int i;
+	
+	for (i = 0; i < DCACHE_ASSOC; i++){
+		if (way[i].state != MESI_I && way[i].tag == line){
+			return &way[i];
+		}
+	}
+	return NULL;
+}
+
+/************************************************************/
+/* access the data cache of this core, returns the extra cycles the access takes     */
+/************************************************************/
+int dcache_access(uint32_t addr, int write)
+{
+	uint32_t line = addr / DCACHE_LINE;
+	Cache_Line *victim;
+	
+	DCACHE->clock++;
+	victim = dcache_lookup(line);
+	if (victim != NULL){
+		victim->lru = DCACHE->clock;
+		if (victim->prefetched){
+			victim->prefetched = FALSE;
+			PF_USEFUL++;
+		}
+		if (!write || victim->state != MESI_S){
+			if (write){
+				victim->state = MESI_M;	//E -> M needs no message
+			}
+			DCACHE->hits++;
+			return 0;
+		}
+		DCACHE->upgrades++;	//S -> M, the other copies have to go
+		victim->state = mc_acquire(line, TRUE);
+		return DCACHE_MISS_LATENCY;
+	}
+	
+	DCACHE->misses++;
+	dcache_fill(line, write);
+	return DCACHE_MISS_LATENCY;
+}
+
+/************************************************************/
+/* bring a line into the data cache over the LRU way, returns that way              */
+/************************************************************/
+Cache_Line *dcache_fill(uint32_t line, int write)
+{
+	uint32_t sets = DCACHE_KB * 1024 / DCACHE_LINE / DCACHE_ASSOC;
+	Cache_Line *way, *victim;
+	int i;
+	
+	way = &DCACHE->lines[(line % sets) * DCACHE_ASSOC];
+	victim = &way[0];
+	for (i = 0; i < DCACHE_ASSOC; i++){
+		if (way[i].state == MESI_I){
+			victim = &way[i];
+			break;
+		}
+		if (way[i].lru < victim->lru){
+			victim = &way[i];
+		}
+	}
+	if (victim->state != MESI_I){
+		if (victim->state == MESI_M){
+			DCACHE->writebacks++;
+		}
+		if (victim->prefetched){
+			PF_USELESS++;
+		}
+		if (MC_CORES > 1){
+			atomic_fetch_and(&MC_DIRECTORY[victim->tag & (MC_DIR_ENTRIES - 1)], ~(1 << CORE_ID));
+		}
+	}
+	victim->tag = line;
+	victim->lru = DCACHE->clock;
+	victim->state = mc_acquire(line, write);
+	victim->prefetched = FALSE;
+	return victim;
+}
+
+/************************************************************/
+/* charge a load or store to the data cache, the pipeline freezes on a miss             */
+/************************************************************/
+void mem_access_timing(uint32_t pc, uint32_t addr, int write)
+{
+	if (addr >= MMIO_BEGIN){
+		return;	//Device registers are not cached
+	}
+	if (STACK_DIST){
+		sd_access(&SD_DATA, addr);
+	}
+	if (DIN_OUT.fp != NULL){
+		export_din(write, addr);
+	}
+	if (SB_ENTRIES > 0){
+		mem_stall += write ? sb_store(addr) : sb_load(pc, addr);
+	}
+	else if (PF_MODE != PF_NONE){
+		mem_stall += pf_access(pc, addr, write);
+	}
+	else if (DCACHE_KB > 0){
+		mem_stall += dcache_access(addr, write);
+	}
+}
+
+/************************************************************/
+/* empty the store buffer and clear its counters                                                       */
+/************************************************************/
+void sb_reset()
+{
+	SB_HEAD = SB_COUNT = 0;
+	SB_BUSY = 0;
+	SB_STORES = SB_MERGES = SB_FORWARDS = SB_DRAINS = SB_FULL_STALLS = 0;
+}
+
+/************************************************************/
+/* one cycle of background draining, runs even while the pipeline is frozen        */
+/************************************************************/
+void sb_tick()
+{
+	if (SB_BUSY > 0){
+		SB_BUSY--;
+	}
+	if (SB_BUSY == 0 && SB_COUNT > 0){
+		SB_BUSY = 1 + (DCACHE_KB > 0 ? dcache_access(SB_LINES[SB_HEAD] * DCACHE_LINE, TRUE) : 0);
+		SB_HEAD = (SB_HEAD + 1) % SB_MAX_ENTRIES;
+		SB_COUNT--;
+		SB_DRAINS++;
+	}
+}
+
+/************************************************************/
+/* retire a store into the buffer, returns the cycles the pipeline waits for room   */
+/************************************************************/
+uint32_t sb_store(uint32_t addr)
+{
+	uint32_t line = addr / DCACHE_LINE;
+	uint32_t stall = 0;
+	
+	SB_STORES++;
+	if (SB_COUNT > 0 && SB_LINES[(SB_HEAD + SB_COUNT - 1) % SB_MAX_ENTRIES] == line){
+		SB_MERGES++;	//Combines with the youngest entry
+		return 0;
+	}
+	if (SB_COUNT == SB_ENTRIES){	//Wait for the drain in flight, the head then leaves
+		stall = SB_BUSY;
+		SB_BUSY = 0;
+		sb_tick();
+		SB_BUSY += stall;
+		SB_FULL_STALLS += stall;
+	}
+	SB_LINES[(SB_HEAD + SB_COUNT) % SB_MAX_ENTRIES] = line;
+	SB_COUNT++;
+	return stall;
+}
+
+/************************************************************/
+/* a load to a buffered line is forwarded, others go to the data cache                   */
+/************************************************************/
+uint32_t sb_load(uint32_t pc, uint32_t addr)
+{
+	uint32_t line = addr / DCACHE_LINE;
+	int i;
+	
+	for (i = 0; i < SB_COUNT; i++){
+		if (SB_LINES[(SB_HEAD + i) % SB_MAX_ENTRIES] == line){
+			SB_FORWARDS++;
+			return 0;
+		}
+	}
+	if (PF_MODE != PF_NONE){
+		return pf_access(pc, addr, FALSE);
+	}
+	return DCACHE_KB > 0 ? dcache_access(addr, FALSE) : 0;
+}
+
+/************************************************************/
+/* Print store buffer counters                                                                                  */ 
+/************************************************************/
+void print_sb_stats(){
+	printf("-------------------------------------\n");
+	printf("Store Buffer\t\t: %d entries of %dB lines\n", SB_ENTRIES, DCACHE_LINE);
+	printf("# Stores / Merged\t: %u / %u\n", SB_STORES, SB_MERGES);
+	printf("# Drains\t\t: %u\n", SB_DRAINS);
+	printf("# Forwarded Loads\t: %u\n", SB_FORWARDS);
+	printf("# Full Stall Cycles\t: %u\n", SB_FULL_STALLS);
+}
+
+/************************************************************/
+/* drop in-flight prefetches, stream buffers and the stride table                         */
+/************************************************************/
+void pf_reset()
+{
+	PF_MSHR_COUNT = 0;
+	memset(PF_STRIDE_TABLE, 0, sizeof(PF_STRIDE_TABLE));
+	memset(PF_STREAM_BUFS, 0, sizeof(PF_STREAM_BUFS));
+	PF_CLOCK = 0;
+	PF_ISSUED = PF_DROPPED = PF_USEFUL = PF_LATE = PF_USELESS = PF_MISSES = 0;
+}
+
+/************************************************************/
+/* a demand access with a prefetcher in front of the data cache, returns the stall  */
+/************************************************************/
+int pf_access(uint32_t pc, uint32_t addr, int write)
+{
+	uint32_t line = addr / DCACHE_LINE;
+	Cache_Line *hit;
+	int stall, used;
+	
+	pf_complete();
+	hit = dcache_lookup(line);
+	stall = hit == NULL ? pf_claim(line, write) : -1;
+	if (stall >= 0){
+		pf_train(pc, addr, FALSE, TRUE);	//A prefetch served it, keep running ahead
+		return stall;
+	}
+	used = hit != NULL && hit->prefetched;
+	if (hit == NULL){
+		PF_MISSES++;
+	}
+	stall = dcache_access(addr, write);
+	pf_train(pc, addr, hit == NULL, used);
+	return stall;
+}
+
+/************************************************************/
+/* start fetching a line into an MSHR unless it is cached or already on its way      */
+/************************************************************/
+void pf_issue(uint32_t line)
+{
+	int i;
+	
+	if (dcache_lookup(line) != NULL){
+		return;
+	}
+	for (i = 0; i < PF_MSHR_COUNT; i++){
+		if (PF_MSHR[i].line == line){
+			return;
+		}
+	}
+	if (PF_MSHR_COUNT == PF_MSHRS){
+		PF_DROPPED++;
+		return;
+	}
+	PF_MSHR[PF_MSHR_COUNT].line = line;
+	PF_MSHR[PF_MSHR_COUNT].ready = CYCLE_COUNT + DCACHE_MISS_LATENCY;
+	PF_MSHR_COUNT++;
+	PF_ISSUED++;
+}
+
+/************************************************************/
+/* fill the cache with every prefetch that has arrived by now                               */
+/************************************************************/
+void pf_complete()
+{
+	int i = 0;
+	
+	while (i < PF_MSHR_COUNT){
+		if ((int32_t)(PF_MSHR[i].ready - CYCLE_COUNT) > 0){
+			i++;
+			continue;
+		}
+		if (dcache_lookup(PF_MSHR[i].line) == NULL){
+			DCACHE->clock++;
+			dcache_fill(PF_MSHR[i].line, FALSE)->prefetched = TRUE;
+		}
+		PF_MSHR[i] = PF_MSHR[--PF_MSHR_COUNT];
+	}
+}
+
+/************************************************************/
+/* a demand miss to a line an MSHR or stream buffer is fetching takes it over,     */
+/* returns the cycles left on that fetch, -1 if no prefetch covers the line            */
+/************************************************************/
+int pf_claim(uint32_t line, int write)
+{
+	Stream_Buffer *s;
+	uint32_t ready = 0;
+	int found = FALSE, i, j;
+	
+	for (i = 0; i < PF_MSHR_COUNT && !found; i++){
+		if (PF_MSHR[i].line == line){
+			ready = PF_MSHR[i].ready;
+			PF_MSHR[i] = PF_MSHR[--PF_MSHR_COUNT];
+			found = TRUE;
+		}
+	}
+	for (i = 0; i < PF_STREAMS && !found; i++){
+		s = &PF_STREAM_BUFS[i];
+		for (j = 0; j < s->count; j++){
+			if (s->lines[j].line == line){
+				break;
+			}
+		}
+		if (j == s->count){
+			continue;
+		}
+		ready = s->lines[j].ready;
+		PF_USELESS += j;	//The stream skipped the lines in front of it
+		memmove(&s->lines[0], &s->lines[j + 1], (s->count - j - 1) * sizeof(Prefetch_Fill));
+		s->count -= j + 1;
+		s->lru = ++PF_CLOCK;
+		pf_stream_fill(s);
+		found = TRUE;
+	}
+	if (!found){
+		return -1;
+	}
+	PF_USEFUL++;
+	DCACHE->clock++;
+	DCACHE->hits++;	//Counted as a hit, the miss went out with the prefetch
+	dcache_fill(line, write);
+	if ((int32_t)(ready - CYCLE_COUNT) > 0){
+		PF_LATE++;
+		return ready - CYCLE_COUNT;
+	}
+	return 0;
+}
+
+/************************************************************/
+/* show the prefetcher a demand access, miss if no prefetch covered it, used if    */
+/* it is the first use of a prefetched line                                                              */
+/************************************************************/
+void pf_train(uint32_t pc, uint32_t addr, int miss, int used)
+{
+	uint32_t line = addr / DCACHE_LINE;
+	Stride_Entry *e;
+	Stream_Buffer *s;
+	int i;
+	
+	switch (PF_MODE){
+		case PF_NEXT_LINE:
+			if (miss || used){
+				for (i = 0; i < PF_DEGREE; i++){
+					pf_issue(line + PF_DISTANCE + i);
+				}
+			}
+			break;
+			
+		case PF_STRIDE:
+			e = &PF_STRIDE_TABLE[(pc >> 2) % PF_STRIDE_ENTRIES];
+			if (e->pc != pc){
+				e->pc = pc;
+				e->stride = 0;
+				e->confidence = 0;
+			}
+			else if ((int32_t)(addr - e->addr) == e->stride && e->stride != 0){
+				if (e->confidence < 3){
+					e->confidence++;
+				}
+			}
+			else if (e->confidence > 0){
+				e->confidence--;
+			}
+			else{
+				e->stride = addr - e->addr;
+			}
+			e->addr = addr;
+			if (e->confidence >= 2){
+				for (i = 0; i < PF_DEGREE; i++){
+					pf_issue((addr + e->stride * (PF_DISTANCE + i)) / DCACHE_LINE);
+				}
+			}
+			break;
+			
+		case PF_STREAM:
+			if (!miss){
+				break;	//Streams only start on a miss, a claim tops its own stream up
+			}
+			s = &PF_STREAM_BUFS[0];
+			for (i = 1; i < PF_STREAMS; i++){
+				if (PF_STREAM_BUFS[i].lru < s->lru){
+					s = &PF_STREAM_BUFS[i];
+				}
+			}
+			PF_USELESS += s->count;	//Reallocate the least recently used stream
+			s->count = 0;
+			s->next = line + PF_DISTANCE;
+			s->lru = ++PF_CLOCK;
+			pf_stream_fill(s);
+			break;
+	}
+}
+
+/************************************************************/
+/* top a stream buffer up to degree lines                                                                */
+/************************************************************/
+void pf_stream_fill(Stream_Buffer *s)
+{
+	while (s->count < PF_DEGREE){
+		s->lines[s->count].line = s->next++;
+		s->lines[s->count].ready = CYCLE_COUNT + DCACHE_MISS_LATENCY;
+		s->count++;
+		PF_ISSUED++;
+	}
+}
+
+/************************************************************/
+/* Print prefetcher counters                                                                                  */ 
+/************************************************************/
+void print_pf_stats(){
+	char *names[] = { "none", "next-line", "stride", "stream" };
+	
+	printf("-------------------------------------\n");
+	printf("Prefetcher\t\t: %s, degree %d, distance %d\n", names[PF_MODE], PF_DEGREE, PF_DISTANCE);
+	printf("# Issued / Dropped\t: %u / %u\n", PF_ISSUED, PF_DROPPED);
+	printf("# Useful / Late\t\t: %u / %u\n", PF_USEFUL, PF_LATE);
+	printf("# Useless\t\t: %u\n", PF_USELESS);
+	printf("Accuracy\t\t: %.3f\n", PF_ISSUED ? (double)PF_USEFUL / PF_ISSUED : 0.0);
+	printf("Coverage\t\t: %.3f\n", (PF_USEFUL + PF_MISSES) ? (double)PF_USEFUL / (PF_USEFUL + PF_MISSES) : 0.0);
+	printf("Timeliness\t\t: %.3f\n", PF_USEFUL ? (double)(PF_USEFUL - PF_LATE) / PF_USEFUL : 0.0);
+}
+
+/************************************************************/
+/* drop a stack distance profile                                                                               */
+/************************************************************/
+void sd_reset(Sd_Profile *p)
+{
+	int k;
+	
+	free(p->table);
+	free(p->tree);
+	free(p->ws);
+	for (k = 0; k <= SD_MAX_LOG; k++){
+		free(p->ways[k]);
+	}
+	memset(p, 0, sizeof(Sd_Profile));
+}
+
+/************************************************************/
+/* profile one access: its stack distance, the caches and the working set         */
+/************************************************************/
+void sd_access(Sd_Profile *p, uint32_t addr)
+{
+	uint32_t line = addr / DCACHE_LINE, window = CYCLE_COUNT / SD_WINDOW;
+	uint32_t d, sets;
+	Sd_Entry *e;
+	int k, b;
+	
+	if (p->table == NULL){
+		p->table_size = 1024;
+		p->table = calloc(p->table_size, sizeof(Sd_Entry));
+		p->tree_size = SD_MIN_TREE;
+		p->tree = calloc(p->tree_size + 1, sizeof(uint32_t));
+		for (k = 0; k <= SD_MAX_LOG; k++){
+			sets = (1 << k) / DCACHE_ASSOC;
+			if (sets > 0){
+				p->ways[k] = calloc(sets * DCACHE_ASSOC, sizeof(uint32_t));
+			}
+		}
+	}
+	if (window != p->window){
+		sd_window_close(p, window);
+	}
+	if (p->now == p->tree_size){
+		sd_renumber(p);
+	}
+	e = sd_lookup(p, line);
+	p->accesses++;
+	if (e->line == 0){
+		e->line = line + 1;
+		p->lines++;
+		p->cold++;
+	}
+	else {
+		d = sd_distance(p, e->time);
+		for (b = 0; d != 0; b++, d >>= 1);	//0, 1, 2-3, 4-7, ...
+		p->hist[b]++;
+		sd_mark(p, e->time, -1);
+	}
+	if (e->window != window + 1){
+		e->window = window + 1;
+		p->window_lines++;
+	}
+	e->time = ++p->now;
+	sd_mark(p, e->time, 1);
+	sd_cache_access(p, line);
+}
+
+/************************************************************/
+/* lines accessed after time, the stack distance of the line accessed at time      */
+/************************************************************/
+uint32_t sd_distance(Sd_Profile *p, uint32_t time)
+{
+	uint32_t before = 0;
+	
+	for (; time > 0; time -= time & -time){
+		before += p->tree[time];
+	}
+	return p->lines - before;	//Every line has one mark
+}
+
+/************************************************************/
+/* add delta to the mark at time                                                                          */
+/************************************************************/
+void sd_mark(Sd_Profile *p, uint32_t time, int delta)
+{
+	for (; time <= p->tree_size; time += time & -time){
+		p->tree[time] += delta;
+	}
+}
+
+/************************************************************/
+/* order of two entries by latest access                                                                */
+/************************************************************/
+int sd_time_order(const void *a, const void *b)
+{
+	uint32_t ta = (*(Sd_Entry **)a)->time, tb = (*(Sd_Entry **)b)->time;
+	
+	return (ta > tb) - (ta < tb);
+}
+
+/************************************************************/
+/* out of times: number the lines 1..lines in access order and rebuild the tree     */
+/************************************************************/
+void sd_renumber(Sd_Profile *p)
+{
+	Sd_Entry **order = malloc(p->lines * sizeof(Sd_Entry *));
+	uint32_t i, j, n = 0;
+	
+	for (i = 0; i < p->table_size; i++){
+		if (p->table[i].line != 0){
+			order[n++] = &p->table[i];
+		}
+	}
+	qsort(order, n, sizeof(Sd_Entry *), sd_time_order);
+	for (i = 0; i < n; i++){
+		order[i]->time = i + 1;
+	}
+	free(order);
+	while (p->tree_size < 2 * n){
+		p->tree_size *= 2;	//Keep at least half the times free so this stays rare
+	}
+	free(p->tree);
+	p->tree = calloc(p->tree_size + 1, sizeof(uint32_t));
+	for (i = 1; i <= p->tree_size; i++){
+		p->tree[i] += i <= n;
+		j = i + (i & -i);
+		if (j <= p->tree_size){
+			p->tree[j] += p->tree[i];
+		}
+	}
+	p->now = n;
+}
+
+/************************************************************/
+/* the entry of a line, an empty one to fill if the line is new                       */
+/************************************************************/
+Sd_Entry *sd_lookup(Sd_Profile *p, uint32_t line)
+{
+	Sd_Entry *old;
+	uint32_t i, size, slot;
+	
+	if (2 * (p->lines + 1) > p->table_size){
+		old = p->table;
+		size = p->table_size;
+		p->table_size *= 2;
+		p->table = calloc(p->table_size, sizeof(Sd_Entry));
+		for (i = 0; i < size; i++){
+			if (old[i].line != 0){
+				slot = (old[i].line * 2654435761u) & (p->table_size - 1);
+				while (p->table[slot].line != 0){
+					slot = (slot + 1) & (p->table_size - 1);
+				}
+				p->table[slot] = old[i];
+			}
+		}
+		free(old);
+	}
+	slot = ((line + 1) * 2654435761u) & (p->table_size - 1);
+	while (p->table[slot].line != 0 && p->table[slot].line != line + 1){
+		slot = (slot + 1) & (p->table_size - 1);
+	}
+	return &p->table[slot];
+}
+
+/************************************************************/
+/* the access in the dcache_assoc-way LRU cache of every power of two size          */
+/************************************************************/
+void sd_cache_access(Sd_Profile *p, uint32_t line)
+{
+	uint32_t *way, sets;
+	int k, i;
+	
+	for (k = 0; k <= SD_MAX_LOG; k++){
+		if (p->ways[k] == NULL){
+			continue;
+		}
+		sets = (1 << k) / DCACHE_ASSOC;
+		way = &p->ways[k][(line % sets) * DCACHE_ASSOC];
+		for (i = 0; i < DCACHE_ASSOC - 1 && way[i] != line + 1; i++);
+		if (way[i] != line + 1){
+			p->misses[k]++;	//i is the LRU way
+		}
+		memmove(&way[1], &way[0], i * sizeof(uint32_t));
+		way[0] = line + 1;
+	}
+}
+
+/************************************************************/
+/* record the lines of the finished windows up to window                           */
+/************************************************************/
+void sd_window_close(Sd_Profile *p, uint32_t window)
+{
+	for (; p->window < window; p->window++){
+		if (p->ws_count == p->ws_size){
+			p->ws_size = p->ws_size ? 2 * p->ws_size : 1024;
+			p->ws = realloc(p->ws, p->ws_size * sizeof(uint32_t));
+		}
+		p->ws[p->ws_count++] = p->window_lines;
+		p->window_lines = 0;	//Windows without accesses have none
+	}
+}
+
+/************************************************************/
+/* misses of a fully associative LRU cache of 2^k lines                                      */
+/************************************************************/
+uint64_t sd_fa_misses(Sd_Profile *p, int k)
+{
+	uint64_t misses = p->cold;
+	int b;
+	
+	for (b = k + 1; b < SD_BUCKETS; b++){
+		misses += p->hist[b];	//Distances of at least 2^k
+	}
+	return misses;
+}
+
+/************************************************************/
+/* start exporting to file, - only closes the current file                                 */
+/************************************************************/
+int export_open(Export_Stream *s, char *file)
+{
+	char cmd[PROG_PATH_SIZE + 32];
+	size_t len = strlen(file);
+	int i;
+	
+	export_close(s);
+	if (strcmp(file, "-") == 0){
+		return TRUE;
+	}
+	s->fp = fopen(file, "wb");
+	if (s->fp != NULL && len > 3 && strcmp(file + len - 3, ".gz") == 0){
+		fclose(s->fp);	//Only checks that gzip can write it
+		s->fp = NULL;
+		if (len < PROG_PATH_SIZE && strchr(file, '\'') == NULL){
+			snprintf(cmd, sizeof(cmd), "gzip -1 -c > '%s'", file);
+			s->fp = popen(cmd, "w");
+			s->piped = TRUE;
+		}
+	}
+	if (s->fp == NULL){
+		printf("Error: Can't write trace %s\n", file);
+		s->piped = FALSE;
+		return FALSE;
+	}
+	for (i = 0; i < EXPORT_BUFS; i++){
+		s->buf[i] = malloc(EXPORT_BUF_SIZE);
+	}
+	if (pthread_create(&s->thread, NULL, export_main, s) != 0){
+		printf("Error: Can't start the writer of %s\n", file);
+		s->thread = 0;
+		export_close(s);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/************************************************************/
+/* write out what is buffered and close the file                                                */
+/************************************************************/
+void export_close(Export_Stream *s)
+{
+	int i;
+	
+	if (s->fp == NULL){
+		return;
+	}
+	if (s->buf[0] != NULL && s->thread != 0){
+		export_flush(s);
+		atomic_store_explicit(&s->quit, TRUE, memory_order_release);
+		pthread_join(s->thread, NULL);
+	}
+	if (s->piped){
+		pclose(s->fp);	//Waits for gzip to finish the file
+	}
+	else {
+		fclose(s->fp);
+	}
+	for (i = 0; i < EXPORT_BUFS; i++){
+		free(s->buf[i]);
+	}
+	memset(s, 0, sizeof(Export_Stream));
+}
+
+/************************************************************/
+/* close every export before exiting                                                                    */
+/************************************************************/
+void export_close_all()
+{
+	export_close(&DIN_OUT);
+	export_close(&BRANCH_OUT);
+}
+
+/************************************************************/
+/* hand over the partial buffer and wait until the writer has it all in the file     */
+/************************************************************/
+void export_flush(Export_Stream *s)
+{
+	if (s->fp == NULL){
+		return;
+	}
+	if (s->fill > 0){
+		export_handover(s);
+	}
+	while (atomic_load_explicit(&s->head, memory_order_acquire) != atomic_load_explicit(&s->tail, memory_order_relaxed)){
+		usleep(EXPORT_POLL_US);
+	}
+	fflush(s->fp);
+}
+
+/************************************************************/
+/* queue the buffer being filled, waiting for a free one if the writer is behind  */
+/************************************************************/
+void export_handover(Export_Stream *s)
+{
+	uint32_t tail = atomic_load_explicit(&s->tail, memory_order_relaxed);
+	
+	s->len[tail % EXPORT_BUFS] = s->fill;
+	atomic_store_explicit(&s->tail, ++tail, memory_order_release);
+	s->fill = 0;
+	while (tail - atomic_load_explicit(&s->head, memory_order_acquire) == EXPORT_BUFS){
+		sched_yield();	//The next buffer is still queued
+	}
+}
+
+/************************************************************/
+/* append one record                                                                                             */
+/************************************************************/
+void export_write(Export_Stream *s, const void *data, uint32_t n)
+{
+	if (s->fill + n > EXPORT_BUF_SIZE){
+		export_handover(s);
+	}
+	memcpy(s->buf[atomic_load_explicit(&s->tail, memory_order_relaxed) % EXPORT_BUFS] + s->fill, data, n);
+	s->fill += n;
+	s->records++;
+	s->bytes += n;
+}
+
+/************************************************************/
+/* writer thread: write the queued buffers in order                                             */
+/************************************************************/
+void *export_main(void *arg)
+{
+	Export_Stream *s = arg;
+	uint32_t head = 0;
+	
+	while (TRUE){
+		if (head != atomic_load_explicit(&s->tail, memory_order_acquire)){
+			fwrite(s->buf[head % EXPORT_BUFS], 1, s->len[head % EXPORT_BUFS], s->fp);
+			atomic_store_explicit(&s->head, ++head, memory_order_release);
+		}
+		else if (atomic_load_explicit(&s->quit, memory_order_acquire)){
+			break;
+		}
+		else {
+			usleep(EXPORT_POLL_US);
+		}
+	}
+	return NULL;
+}
+
+/************************************************************/
+/* din line: label (0 read, 1 write, 2 fetch) and hex address                            */
+/************************************************************/
+void export_din(int label, uint32_t addr)
+{
+	char line[12];
+	int n = 2, shift;
+	
+	line[0] = '0' + label;
+	line[1] = ' ';
+	for (shift = 28; shift > 0 && (addr >> shift) == 0; shift -= 4);
+	for (; shift >= 0; shift -= 4){
+		line[n++] = "0123456789abcdef"[(addr >> shift) & 0xF];
+	}
+	line[n++] = '\n';
+	export_write(&DIN_OUT, line, n);
+}
+
+/************************************************************/
+/* branch record of a branch or jump resolved in EX                                        */
+/************************************************************/
+void export_branch(uint32_t pc, Decoded_Inst *d, uint32_t next_pc)
+{
+	Branch_Record rec;
+	int uncond = d->opcode == 0x00 || d->opcode == 0x02 || d->opcode == 0x03;
+	
+	rec.pc = pc;
+	if (uncond){
+		rec.pc |= BRANCH_UNCOND | BRANCH_TAKEN;
+		rec.target = next_pc;
+	}
+	else {
+		rec.pc |= next_pc != pc + 4 ? BRANCH_TAKEN : 0;
+		rec.target = pc + 4 + (d->imm << 2);
+	}
+	export_write(&BRANCH_OUT, &rec, sizeof(rec));
+}
+
+/************************************************************/
+/* empty the instruction queue and start fetching at the current PC                     */
+/************************************************************/
+void fe_reset()
+{
+	IQ_HEAD = IQ_COUNT = 0;
+	FE_PC = CURRENT_STATE.PC;
+	FE_STALL = 0;
+	memset(ICACHE_TAGS, 0, sizeof(ICACHE_TAGS));
+	IQ_OCCUPANCY = 0;
+	FE_FETCHED = FE_BRANCHES = FE_MISPREDICTS = 0;
+	ICACHE_HITS = ICACHE_MISSES = 0;
+	FE_BOUND_CYCLES = BE_BOUND_CYCLES = 0;
+}
+
+/************************************************************/
+/* one cycle of the front end: fetch up to fetch_width words along the predicted    */
+/* path, a taken prediction or an instruction cache miss ends the group               */
+/************************************************************/
+void fe_fetch()
+{
+	Fetch_Entry *f;
+	uint32_t line, slot;
+	int n;
+	
+	if (FE_STALL > 0){
+		FE_STALL--;	//Waiting on the instruction cache
+	}
+	else{
+		for (n = 0; n < FETCH_WIDTH && IQ_COUNT < IQ_ENTRIES && !EXIT_PENDING; n++){
+			if (ICACHE_KB > 0){
+				line = FE_PC / DCACHE_LINE;
+				slot = line % (ICACHE_KB * 1024 / DCACHE_LINE);
+				if (ICACHE_TAGS[slot] != line + 1){
+					ICACHE_TAGS[slot] = line + 1;
+					ICACHE_MISSES++;
+					FE_STALL = DCACHE_MISS_LATENCY;
+					break;
+				}
+				ICACHE_HITS++;
+			}
+			f = &IQ[(IQ_HEAD + IQ_COUNT) % IQ_MAX_ENTRIES];
+			IQ_COUNT++;
+			f->PC = FE_PC;
+			f->IR = mem_read_32(FE_PC);
+			if (STACK_DIST){
+				sd_access(&SD_INST, FE_PC);
+			}
+			if (DIN_OUT.fp != NULL){
+				export_din(2, FE_PC);
+			}
+			f->next_pc = ooo_predict(f->PC, f->IR);
+			FE_PC = f->next_pc;
+			FE_FETCHED++;
+			if (f->next_pc != f->PC + 4){
+				break;	//Taken branch ends the fetch group
+			}
+		}
+	}
+	IQ_OCCUPANCY += IQ_COUNT;
+}
+
+/************************************************************/
+/* a mispredict or ERET squashes the queue, fetch restarts at pc                            */
+/* an instruction cache fill already in flight still has to finish                               */
+/************************************************************/
+void fe_redirect(uint32_t pc)
+{
+	IQ_HEAD = IQ_COUNT = 0;
+	FE_PC = pc;
+}
+
+/************************************************************/
+/* IF with the decoupled front end: move the oldest queued instruction into IF/ID  */
+/************************************************************/
+void fe_deliver()
+{
+	Fetch_Entry *f;
+	
+	if (stall > 0){
+		BE_BOUND_CYCLES++;	//IF/ID is held for a hazard
+		return;
+	}
+	if (IQ_COUNT == 0){
+		FE_BOUND_CYCLES++;
+		insert_bubble(&IF_ID);
+		return;
+	}
+	f = &IQ[IQ_HEAD];
+	IQ_HEAD = (IQ_HEAD + 1) % IQ_MAX_ENTRIES;
+	IQ_COUNT--;
+	IF_ID.IR = f->IR;
+	IF_ID.PC = f->PC + 4;
+	IF_ID.PredPC = f->next_pc;
+	NEXT_STATE.PC = f->next_pc;
+	IF_ID.Bubble = 0;
+	IF_ID.TID = ACTIVE_THREAD;
+	IF_ID.Exception = 0;
+}
+
+/************************************************************/
+/* Print front end counters                                                                                      */ 
+/************************************************************/
+void print_fe_stats(){
+	printf("-------------------------------------\n");
+	printf("Front End\t\t: %d-entry queue, %d wide fetch\n", IQ_ENTRIES, FETCH_WIDTH);
+	printf("# Fetched\t\t: %u\n", FE_FETCHED);
+	printf("Avg Queue Occupancy\t: %.2f\n", CYCLE_COUNT ? (double)IQ_OCCUPANCY / CYCLE_COUNT : 0.0);
+	printf("# Branches / Mispredicts: %u / %u\n", FE_BRANCHES, FE_MISPREDICTS);
+	if (ICACHE_KB > 0){
+		printf("I-Cache\t\t\t: %dKB direct mapped, %dB lines\n", ICACHE_KB, DCACHE_LINE);
+		printf("# Hits / Misses\t\t: %u / %u\n", ICACHE_HITS, ICACHE_MISSES);
+	}
+	printf("# Front-End Bound\t: %u\n", FE_BOUND_CYCLES);
+	printf("# Back-End Bound\t: %u\n", BE_BOUND_CYCLES);
+}
+
+/************************************************************/
+/* get a line for reading or writing, returns its MESI state                                         */
+/* the directory is a hashed presence-bit table, so lines that alias share an entry */
+/************************************************************/
+int mc_acquire(uint32_t line, int write)
+{
+	_Atomic uint16_t *entry = &MC_DIRECTORY[line & (MC_DIR_ENTRIES - 1)];
+	uint32_t me = 1 << CORE_ID;
+	uint32_t others;
+	int c;
+	
+	if (MC_CORES == 1){
+		return write ? MESI_M : MESI_E;
+	}
+	if (write){
+		others = atomic_exchange(entry, me) & ~me;
+	}
+	else{
+		others = atomic_fetch_or(entry, me) & ~me;
+	}
+	for (c = 0; c < MC_CORES; c++){
+		if (others & (1 << c)){
+			mc_send(c, line, write ? MSG_INVALIDATE : MSG_DOWNGRADE);
+		}
+	}
+	if (write){
+		return MESI_M;
+	}
+	return others ? MESI_S : MESI_E;
+}
+
+/************************************************************/
+/* post a coherence message to core to, waits while its queue is full                         */
+/************************************************************/
+void mc_send(int to, uint32_t line, uint32_t type)
+{
+	Msg_Ring *ring = &MC_QUEUES[to][CORE_ID];
+	uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	
+	while (tail - atomic_load_explicit(&ring->head, memory_order_acquire) == MC_QUEUE_SIZE){
+		mc_poll_messages();	//The receiver may be waiting on us
+		sched_yield();
+	}
+	ring->buf[tail % MC_QUEUE_SIZE] = (line << 2) | type;
+	atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+	CORES[CORE_ID].msgs_sent++;
+}
+
+/************************************************************/
+/* drain the queues of every sender to this core                                                         */
+/************************************************************/
+void mc_poll_messages()
+{
+	Msg_Ring *ring;
+	uint32_t head, tail;
+	int c;
+	
+	for (c = 0; c < MC_CORES; c++){
+		ring = &MC_QUEUES[CORE_ID][c];
+		head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+		tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+		while (head != tail){
+			mc_handle_message(ring->buf[head % MC_QUEUE_SIZE]);
+			head++;
+		}
+		atomic_store_explicit(&ring->head, head, memory_order_release);
+	}
+}
+
+/************************************************************/
+/* apply an invalidate or downgrade from another core                                               */
+/************************************************************/
+void mc_handle_message(uint32_t msg)
+{
+	Cache_Line *l;
+	
+	if (DCACHE_KB == 0){
+		return;
+	}
+	l = dcache_lookup(msg >> 2);
+	if (l == NULL){
+		return;	//Evicted meanwhile, or a directory alias
+	}
+	if (l->state == MESI_M){
+		DCACHE->writebacks++;
+	}
+	if ((msg & 0x3) == MSG_INVALIDATE){
+		l->state = MESI_I;
+		CORES[CORE_ID].invalidations++;
+	}
+	else{
+		l->state = MESI_S;
+	}
+}
+
+/************************************************************/
+/* LL, read a word and remember the version of its location                                    */
+/************************************************************/
+uint32_t load_linked(uint32_t addr)
+{
+	_Atomic uint32_t *version = &LL_VERSION[(addr >> 2) % LL_VERSIONS];
+	Core_Context *core = &CORES[CORE_ID];
+	uint32_t ver, value;
+	
+	do{
+		ver = atomic_load_explicit(version, memory_order_acquire);
+		value = mem_read_32(addr);
+	}while ((ver & 1) || atomic_load_explicit(version, memory_order_acquire) != ver);	//A store was in progress
+	core->ll_addr = addr;
+	core->ll_version = ver;
+	core->ll_valid = TRUE;
+	return value;
+}
+
+/************************************************************/
+/* SC, store only if nothing wrote the location since the LL, returns 1 on success  */
+/************************************************************/
+uint32_t store_conditional(uint32_t addr, uint32_t value)
+{
+	_Atomic uint32_t *version = &LL_VERSION[(addr >> 2) % LL_VERSIONS];
+	Core_Context *core = &CORES[CORE_ID];
+	uint32_t ver = core->ll_version;
+	
+	if (!core->ll_valid || core->ll_addr != addr || !atomic_compare_exchange_strong(version, &ver, ver + 1)){
+		core->ll_valid = FALSE;
+		core->sc_fail++;
+		return 0;
+	}
+	mem_write_32(addr, value);
+	atomic_store_explicit(version, ver + 2, memory_order_release);
+	core->ll_valid = FALSE;
+	core->sc_success++;
+	return 1;
+}
+
+/************************************************************/
+/* ordinary store (SB, SH or SW), with several cores it breaks the links other cores hold */
+/************************************************************/
+void store_word(Decoded_Inst *d, uint32_t addr, uint32_t value)
+{
+	_Atomic uint32_t *version;
+	uint32_t ver;
+	
+	if (MC_CORES == 1){
+		store_data(d, addr, value);
+		return;
+	}
+	version = &LL_VERSION[(addr >> 2) % LL_VERSIONS];
+	do{
+		ver = atomic_load_explicit(version, memory_order_relaxed) & ~1;	//Odd while another store is writing
+	}while (!atomic_compare_exchange_weak(version, &ver, ver + 1));
+	store_data(d, addr, value);
+	atomic_store_explicit(version, ver + 2, memory_order_release);
+}
+
+/************************************************************/
+/* move core c from its context into the state of this host thread                             */
+/************************************************************/
+void mc_load_core(int c)
+{
+	Core_Context *core = &CORES[c];
+	
+	CORE_ID = c;
+	DCACHE = &core->dcache;
+	CURRENT_STATE = core->current;
+	NEXT_STATE = core->next;
+	IF_ID = core->if_id;
+	ID_EX = core->id_ex;
+	EX_MEM = core->ex_mem;
+	MEM_WB = core->mem_wb;
+	stall = core->stall;
+	mem_stall = core->mem_stall;
+	EXIT_PENDING = core->exit_pending;
+	RUN_FLAG = core->running;
+	INSTRUCTION_COUNT = core->instructions;
+	CYCLE_COUNT = core->cycles;
+	HAZARD_STALL_CYCLES = core->hazard_stalls;
+	MEM_STALL_CYCLES = core->mem_stalls;
+	SKIPPED_CYCLES = core->skipped_cycles;
+	FLUSH_CYCLES = core->flush_cycles;
+}
+
+/************************************************************/
+/* store the state of this host thread into the context of core c                                */
+/************************************************************/
+void mc_save_core(int c)
+{
+	Core_Context *core = &CORES[c];
+	
+	core->current = CURRENT_STATE;
+	core->next = NEXT_STATE;
+	core->if_id = IF_ID;
+	core->id_ex = ID_EX;
+	core->ex_mem = EX_MEM;
+	core->mem_wb = MEM_WB;
+	core->stall = stall;
+	core->mem_stall = mem_stall;
+	core->exit_pending = EXIT_PENDING;
+	core->running = RUN_FLAG;
+	core->instructions = INSTRUCTION_COUNT;
+	core->cycles = CYCLE_COUNT;
+	core->hazard_stalls = HAZARD_STALL_CYCLES;
+	core->mem_stalls = MEM_STALL_CYCLES;
+	core->skipped_cycles = SKIPPED_CYCLES;
+	core->flush_cycles = FLUSH_CYCLES;
+}
+
+/************************************************************/
+/* sense-reversing barrier, the last core to arrive sets up the next quantum             */
+/************************************************************/
+void mc_barrier(int *sense)
+{
+	*sense = !*sense;
+	if (atomic_fetch_add(&MC_BARRIER_COUNT, 1) == MC_CORES - 1){
+		MC_REMAINING -= MC_STEP;
+		MC_STOP = atomic_load(&MC_RUNNING) == 0 || MC_REMAINING == 0;
+		MC_STEP = MC_REMAINING < (uint32_t)MC_QUANTUM ? MC_REMAINING : (uint32_t)MC_QUANTUM;
+		atomic_store(&MC_BARRIER_COUNT, 0);
+		atomic_store_explicit(&MC_BARRIER_SENSE, *sense, memory_order_release);
+		return;
+	}
+	while (atomic_load_explicit(&MC_BARRIER_SENSE, memory_order_acquire) != *sense){
+		mc_poll_messages();
+		sched_yield();
+	}
+}
+
+/************************************************************/
+/* host thread of one simulated core                                                                          */
+/************************************************************/
+void *mc_core_main(void *arg)
+{
+	int c = (int)(intptr_t)arg;
+	int sense = 0;
+	int was_running;
+	uint32_t i;
+	
+	mc_load_core(c);
+	while (!MC_STOP){
+		was_running = RUN_FLAG;
+		for (i = 0; i < MC_STEP && RUN_FLAG; i++){
+			cycle();
+			i += cycle_skip(MC_STEP - i - 1);	//Other cores are only waited for at the barrier
+		}
+		if (was_running && !RUN_FLAG){
+			atomic_fetch_sub(&MC_RUNNING, 1);
+		}
+		mc_barrier(&sense);
+	}
+	mc_save_core(c);
+	return NULL;
+}
+
+/************************************************************/
+/* run every core for up to num_cycles cycles, one host thread per core                    */
+/************************************************************/
+void mc_run(uint32_t num_cycles)
+{
+	pthread_t threads[MAX_CORES];
+	uint32_t cycles = 0;
+	int c, running = 0;
+	
+	if (CYCLE_COUNT == 0){	//First run, every core starts from the loaded program
+		MC_CORES_USED = MC_CORES;
+		for (c = 0; c < MC_CORES; c++){
+			CORES[c].current = CURRENT_STATE;
+			CORES[c].current.REGS[4] = c;	//$a0 holds the core number
+			CORES[c].next = CORES[c].current;
+			CORES[c].if_id = IF_ID;
+			CORES[c].id_ex = ID_EX;
+			CORES[c].ex_mem = EX_MEM;
+			CORES[c].mem_wb = MEM_WB;
+			CORES[c].running = TRUE;
+		}
+	}
+	else{
+		CORES[0].current = CURRENT_STATE;	//Pick up input/high/low commands
+		CORES[0].next = NEXT_STATE;
+	}
+	
+	for (c = 0; c < MC_CORES; c++){
+		running += CORES[c].running;
+	}
+	atomic_store(&MC_RUNNING, running);
+	atomic_store(&MC_BARRIER_COUNT, 0);
+	atomic_store(&MC_BARRIER_SENSE, 0);
+	MC_REMAINING = num_cycles;
+	MC_STEP = num_cycles < (uint32_t)MC_QUANTUM ? num_cycles : (uint32_t)MC_QUANTUM;
+	MC_STOP = running == 0;
+	
+	for (c = 0; c < MC_CORES; c++){
+		if (pthread_create(&threads[c], NULL, mc_core_main, (void *)(intptr_t)c) != 0){
+			printf("Error: Can't start host thread for core %d\n", c);
+			exit(-1);
+		}
+	}
+	for (c = 0; c < MC_CORES; c++){
+		pthread_join(threads[c], NULL);
+	}
+	
+	/* the command line shows core 0, counters cover every core */
+	CURRENT_STATE = CORES[0].current;
+	NEXT_STATE = CORES[0].next;
+	INSTRUCTION_COUNT = 0;
+	HAZARD_STALL_CYCLES = MEM_STALL_CYCLES = FLUSH_CYCLES = SKIPPED_CYCLES = 0;
+	RUN_FLAG = FALSE;
+	for (c = 0; c < MC_CORES; c++){
+		INSTRUCTION_COUNT += CORES[c].instructions;
+		HAZARD_STALL_CYCLES += CORES[c].hazard_stalls;
+		MEM_STALL_CYCLES += CORES[c].mem_stalls;
+		FLUSH_CYCLES += CORES[c].flush_cycles;
+		SKIPPED_CYCLES += CORES[c].skipped_cycles;
+		if (CORES[c].cycles > cycles){
+			cycles = CORES[c].cycles;
+		}
+		RUN_FLAG |= CORES[c].running;
+	}
+	CYCLE_COUNT = cycles;
+}
+
+/************************************************************/
+/* dump the registers of core c                                                                                   */
+/************************************************************/
+void cdump(int c)
+{
+	CPU_State saved;
+	
+	if (c < 0 || c >= MC_CORES){
+		printf("Invalid core\n");
+		return;
+	}
+	if (CYCLE_COUNT == 0 || c == 0){
+		rdump();	//Every core still shares the loaded state
+		return;
+	}
+	saved = CURRENT_STATE;
+	CURRENT_STATE = CORES[c].current;
+	rdump();
+	CURRENT_STATE = saved;
+}
+
+/************************************************************/
+/* clear the TLBs and coprocessor 0, build the page table and refill handler            */
+/************************************************************/
+void mmu_reset()
+{
+	uint32_t refill_handler[] = {
+		0x401B2000,	//MFC0 $k1, Context	(address of the PTE)
+		0x00000000, 0x00000000, 0x00000000,
+		0x8F7B0000,	//LW $k1, 0($k1)
+		0x00000000, 0x00000000, 0x00000000,
+		0x409B1000,	//MTC0 $k1, EntryLo0
+		0x42000006,	//TLBWR
+		0x42000018	//ERET
+	};
+	uint32_t vpn;
+	int i;
+	
+	memset(&ITLB, 0, sizeof(TLB_Model));
+	memset(&DTLB, 0, sizeof(TLB_Model));
+	ITLB.size = &ITLB_ENTRIES;
+	DTLB.size = &DTLB_ENTRIES;
+	memset(CP0, 0, sizeof(CP0));
+	REFILL_TLB = NULL;
+	EXCEPTION_TAKEN = FALSE;
+	FETCH_BLOCKED = FALSE;
+	FETCH_REDIRECT = FALSE;
+	TLB_REFILLS = 0;
+	PAGE_FAULTS = 0;
+	if (MMU_MODE == MMU_OFF){
+		return;
+	}
+	
+	for (vpn = 0; vpn < (MEM_KTEXT_BEGIN >> PAGE_SHIFT); vpn++){
+		mem_write_32(PAGE_TABLE_BASE + vpn * 4, (vpn << PTE_PFN_SHIFT) | PTE_DIRTY | PTE_VALID);	//Identity map every user page
+	}
+	if (MMU_MODE == MMU_SW_WALK){
+		for (i = 0; i < sizeof(refill_handler) / sizeof(uint32_t); i++){
+			mem_write_32(MEM_KTEXT_BEGIN + i * 4, refill_handler[i]);
+		}
+	}
+}
+
+/************************************************************/
+/* translate *addr in place, FALSE if a software refill has to run first                       */
+/************************************************************/
+int mmu_translate(TLB_Model *tlb, uint32_t *addr)
+{
+	uint32_t vpn = *addr >> PAGE_SHIFT;
+	uint32_t offset = *addr & ((1 << PAGE_SHIFT) - 1);
+	uint32_t sets = *tlb->size / TLB_ASSOC;
+	TLB_Entry *way;
+	uint32_t pte;
+	int i;
+	
+	if (*addr >= MEM_KTEXT_BEGIN){
+		return TRUE;	//Kernel segment is unmapped
+	}
+	tlb->clock++;
+	way = &tlb->entries[(vpn % sets) * TLB_ASSOC];
+	for (i = 0; i < TLB_ASSOC; i++){
+		if (way[i].valid && way[i].vpn == vpn){
+			way[i].lru = tlb->clock;
+			tlb->hits++;
+			*addr = (way[i].pfn << PAGE_SHIFT) | offset;
+			return TRUE;
+		}
+	}
+	
+	tlb->misses++;
+	if (MMU_MODE == MMU_SW_WALK){
+		REFILL_TLB = tlb;
+		return FALSE;
+	}
+	pte = mem_read_32(PAGE_TABLE_BASE + vpn * 4);	//Hardware walk
+	if (!(pte & PTE_VALID)){
+		printf("Page fault at 0x%08x\n", *addr);
+		PAGE_FAULTS++;
+		RUN_FLAG = FALSE;
+		return TRUE;
+	}
+	tlb_write(tlb, vpn, pte);
+	mem_stall += TLB_MISS_LATENCY;
+	*addr = ((pte >> PTE_PFN_SHIFT) << PAGE_SHIFT) | offset;
+	return TRUE;
+}
+
+/************************************************************/
+/* entry to replace for vpn: a stale copy, a free way or the LRU way of its set       */
+/************************************************************/
+TLB_Entry *tlb_victim(TLB_Model *tlb, uint32_t vpn)
+{
+	uint32_t sets = *tlb->size / TLB_ASSOC;
+	TLB_Entry *way = &tlb->entries[(vpn % sets) * TLB_ASSOC];
+	TLB_Entry *victim = &way[0];
+	int i;
+	
+	for (i = 0; i < TLB_ASSOC; i++){
+		if (!way[i].valid || way[i].vpn == vpn){
+			return &way[i];
+		}
+		if (way[i].lru < victim->lru){
+			victim = &way[i];
+		}
+	}
+	return victim;
+}
+
+/************************************************************/
+/* fill a TLB entry from an EntryLo formatted PTE                                                    */
+/************************************************************/
+void tlb_write(TLB_Model *tlb, uint32_t vpn, uint32_t entrylo)
+{
+	TLB_Entry *e = tlb_victim(tlb, vpn);
+	
+	e->vpn = vpn;
+	e->pfn = entrylo >> PTE_PFN_SHIFT;
+	e->valid = (entrylo & PTE_VALID) != 0;
+	e->lru = tlb->clock;
+}
+
+/************************************************************/
+/* raise a TLB refill exception for the instruction at epc                                        */
+/************************************************************/
+void take_exception(uint32_t cause, uint32_t epc, uint32_t badvaddr)
+{
+	CP0[CP0_EPC] = epc;
+	CP0[CP0_BADVADDR] = badvaddr;
+	CP0[CP0_CAUSE] = cause << 2;	//ExcCode field
+	CP0[CP0_ENTRYHI] = badvaddr & ~((1 << PAGE_SHIFT) - 1);
+	CP0[CP0_CONTEXT] = PAGE_TABLE_BASE + (badvaddr >> PAGE_SHIFT) * 4;
+	TLB_REFILLS++;
+	EXCEPTION_TAKEN = TRUE;
+}
+
+/************************************************************/
+/* squash the faulting and younger instructions and vector to the handler               */
+/************************************************************/
+void flush_for_exception()
+{
+	insert_bubble(&MEM_WB);
+	insert_bubble(&EX_MEM);
+	insert_bubble(&ID_EX);
+	insert_bubble(&IF_ID);
+	stall = 0;
+	FETCH_BLOCKED = FALSE;
+	FETCH_REDIRECT = FALSE;
+	EXCEPTION_TAKEN = FALSE;
+	pipe_reset();	//Squashed producers will not write back
+	NEXT_STATE.PC = MEM_KTEXT_BEGIN;
+}
+
+/************************************************************/
+/* run the loaded program as lanes instances at once; lane l starts from the    */
+/* current registers with $a0 = l, then applies line l of file                               */
+/************************************************************/
+void batch_run(int lanes, char *file)
+{
+	FILE *fp = NULL;
+	char line[512], *tok;
+	uint32_t reg;
+	int value, l, r, cut;
+	double start;
+	
+	if (lanes < 1 || lanes > BATCH_MAX_LANES){
+		printf("Lanes must be between 1 and %d\n", BATCH_MAX_LANES);
+		return;
+	}
+	if (strcmp(file, "-") != 0){
+		fp = fopen(file, "r");
+		if (fp == NULL){
+			printf("Error: Can't open lane input file %s\n", file);
+			return;
+		}
+	}
+	
+	memset(&BATCH, 0, sizeof(BATCH));	//Lanes past the last one stay masked off
+	BATCH_LANES = lanes;
+	for (l = 0; l < lanes; l++){
+		for (r = 0; r < MIPS_REGS; r++){
+			BATCH.regs[r][l] = CURRENT_STATE.REGS[r];
+		}
+		BATCH.regs[4][l] = l;	//$a0 holds the lane number
+		BATCH.pc[l] = CURRENT_STATE.PC;
+		BATCH.hi[l] = CURRENT_STATE.HI;
+		BATCH.lo[l] = CURRENT_STATE.LO;
+		BATCH.live[l] = TRUE;
+		if (fp == NULL || fgets(line, sizeof(line), fp) == NULL){
+			continue;
+		}
+		for (tok = strtok(line, " \t\r\n"); tok != NULL; tok = strtok(NULL, " \t\r\n")){
+			if (sscanf(tok, "%u=%i", &reg, &value) != 2 || reg == 0 || reg >= MIPS_REGS){
+				printf("Ignoring %s for lane %d, expected <reg>=<val>\n", tok, l);
+				continue;
+			}
+			BATCH.regs[reg][l] = value;
+		}
+	}
+	if (fp != NULL){
+		fclose(fp);
+	}
+	
+	BATCH_KERNEL = BATCH_SCALAR;
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_cpu_init();
+	if (BATCH_SIMD >= BATCH_SSE2 && __builtin_cpu_supports("sse2")){
+		BATCH_KERNEL = BATCH_SSE2;
+	}
+	if (BATCH_SIMD >= BATCH_AVX2 && __builtin_cpu_supports("avx2")){
+		BATCH_KERNEL = BATCH_AVX2;
+	}
+#endif
+	BATCH_STEPS = 0;
+	BATCH_LANE_INSTS = 0;
+	BATCH_LIMIT = CYCLE_LIMIT > 0 ? CYCLE_LIMIT : BATCH_INST_LIMIT;
+	start = host_time();
+	while (batch_step() > 0);
+	start = host_time() - start;
+	
+	printf("-------------------------------------\n");
+	printf("Batch of %d lanes finished (%s kernel)\n", lanes,
+		BATCH_KERNEL == BATCH_AVX2 ? "avx2" : (BATCH_KERNEL == BATCH_SSE2 ? "sse2" : "scalar"));
+	printf("-------------------------------------\n");
+	for (l = 0, cut = 0; l < lanes; l++){
+		if (BATCH.cut[l]){
+			printf("Lane %d cut off at %u instructions, PC 0x%08x\n", l, BATCH.instructions[l], BATCH.pc[l]);
+			cut++;
+		}
+	}
+	printf("# Issue Steps\t\t: %llu\n", (unsigned long long)BATCH_STEPS);
+	printf("# Lane Instructions\t: %llu\n", (unsigned long long)BATCH_LANE_INSTS);
+	printf("# Lanes Cut Off\t\t: %d\n", cut);
+	printf("SIMD Efficiency\t\t: %.3f\n", BATCH_STEPS ? (double)BATCH_LANE_INSTS / (BATCH_STEPS * lanes) : 0.0);
+	printf("Host Seconds\t\t: %.3f\n", start);
+	printf("Lane Instructions/sec\t: %.0f\n", start > 0 ? BATCH_LANE_INSTS / start : 0.0);
+	printf("-------------------------------------\n");
+}
+
+/************************************************************/
+/* issue the instruction at the lowest live PC for every lane sitting on it;   */
+/* lanes that branched ahead wait there, so divergent lanes reconverge    */
+/* returns the number of lanes still running, lanes at BATCH_LIMIT stop    */
+/************************************************************/
+int batch_step()
+{
+	Decoded_Inst d;
+	uint32_t pc = 0xFFFFFFFF, *a, *b, imm, va, vb, value, next_pc;
+	int l, op, live = 0, active = 0;
+	
+	for (l = 0; l < BATCH_LANES; l++){
+		if (BATCH.live[l] && BATCH.pc[l] < pc){
+			pc = BATCH.pc[l];
+		}
+	}
+	if (pc == 0xFFFFFFFF){
+		return 0;
+	}
+	for (l = 0; l < BATCH_LANES; l++){
+		BATCH.mask[l] = (BATCH.live[l] && BATCH.pc[l] == pc) ? 0xFFFFFFFF : 0;
+	}
+	decode_instruction(mem_read_32(pc), &d);
+	BATCH_STEPS++;
+	
+	if (batch_vector_op(&d, &op, &a, &b, &imm)){
+		if (d.dest != 0){
+			batch_kernel(op, BATCH.regs[d.dest], a, b, imm);
+		}
+		for (l = 0; l < BATCH_LANES; l++){
+			if (BATCH.mask[l]){
+				BATCH.pc[l] = pc + 4;
+				BATCH.instructions[l]++;
+				active++;
+			}
+		}
+	}
+	else{
+		for (l = 0; l < BATCH_LANES; l++){	//Memory, HI/LO and control flow one lane at a time
+			if (!BATCH.mask[l]){
+				continue;
+			}
+			va = BATCH.regs[d.rs][l];
+			vb = BATCH.regs[d.rt][l];
+			value = 0;
+			next_pc = pc + 4;
+			if (d.opcode == 0x00 && d.funct == 0x0C){	//SYSCALL
+				if (va == 0xa){
+					BATCH.live[l] = FALSE;
+				}
+			}
+			else if (d.is_load || d.is_store){
+				if (d.is_store){
+					store_data(&d, va + d.imm, vb);
+				}
+				value = (d.opcode == 0x38) ? 1 : load_data(&d, va + d.imm);	//SC never fails here
+			}
+			else if (d.opcode == 0x10){
+				printf("Lane %d: COP0 is not supported in batch mode, lane stopped\n", l);
+				BATCH.live[l] = FALSE;
+			}
+			else{
+				value = alu_compute(&d, pc, va, vb, &BATCH.hi[l], &BATCH.lo[l]);
+				if (d.is_branch){
+					next_pc = branch_resolve(&d, pc, va, vb);
+				}
+			}
+			if (d.dest != 0){
+				BATCH.regs[d.dest][l] = value;
+			}
+			BATCH.pc[l] = next_pc;
+			BATCH.instructions[l]++;
+			active++;
+		}
+	}
+	BATCH_LANE_INSTS += active;
+	for (l = 0; l < BATCH_LANES; l++){
+		if (BATCH.live[l] && BATCH.instructions[l] >= BATCH_LIMIT){
+			BATCH.live[l] = FALSE;	//Would not have exited within cycle_limit
+			BATCH.cut[l] = TRUE;
+		}
+		live += BATCH.live[l];
+	}
+	return live;
+}
+
+/************************************************************/
+/* map an instruction onto a vector ALU kernel, FALSE if it needs the per-lane path */
+/************************************************************/
+int batch_vector_op(Decoded_Inst *d, int *op, uint32_t **a, uint32_t **b, uint32_t *imm)
+{
+	*a = BATCH.regs[d->rs];
+	*b = NULL;
+	*imm = 0;
+	if (d->opcode == 0x00){
+		switch(d->funct){
+			case 0x00:	//SLL
+				*op = BOP_SLL;
+				break;
+			case 0x02:	//SRL
+				*op = BOP_SRL;
+				break;
+			case 0x03:	//SRA
+				*op = BOP_SRA;
+				break;
+			case 0x20:	//ADD
+			case 0x21:	//ADDU
+				*op = BOP_ADD;
+				break;
+			case 0x22:	//SUB
+			case 0x23:	//SUBU
+				*op = BOP_SUB;
+				break;
+			case 0x24:	//AND
+				*op = BOP_AND;
+				break;
+			case 0x25:	//OR
+				*op = BOP_OR;
+				break;
+			case 0x26:	//XOR
+				*op = BOP_XOR;
+				break;
+			case 0x27:	//NOR
+				*op = BOP_NOR;
+				break;
+			case 0x2A:	//SLT
+				*op = BOP_SLT;
+				break;
+			default:
+				return FALSE;
+		}
+		if (*op >= BOP_SLL){	//Shifts move rt by the shift amount
+			*a = BATCH.regs[d->rt];
+			*imm = d->sa;
+		}
+		else{
+			*b = BATCH.regs[d->rt];
+		}
+		return TRUE;
+	}
+	switch(d->opcode){
+		case 0x08:	//ADDI
+		case 0x09:	//ADDIU
+			*op = BOP_ADD;
+			*imm = d->imm;
+			return TRUE;
+		case 0x0A:	//SLTI
+			*op = BOP_SLT;
+			*imm = d->imm;
+			return TRUE;
+		case 0x0C:	//ANDI
+			*op = BOP_AND;
+			*imm = d->imm & 0x0000FFFF;
+			return TRUE;
+		case 0x0D:	//ORI
+			*op = BOP_OR;
+			*imm = d->imm & 0x0000FFFF;
+			return TRUE;
+		case 0x0E:	//XORI
+			*op = BOP_XOR;
+			*imm = d->imm & 0x0000FFFF;
+			return TRUE;
+		case 0x0F:	//LUI
+			*op = BOP_OR;
+			*a = BATCH.regs[0];
+			*imm = d->imm << 16;
+			return TRUE;
+		default:
+			return FALSE;
+	}
+}
+
+/************************************************************/
+/* dst = a op b in every masked lane, b NULL means the immediate              */
+/************************************************************/
+void batch_kernel(int op, uint32_t *dst, uint32_t *a, uint32_t *b, uint32_t imm)
+{
+	switch(BATCH_KERNEL){
+		case BATCH_AVX2:
+			batch_kernel_avx2(op, dst, a, b, imm);
+			break;
+		case BATCH_SSE2:
+			batch_kernel_sse2(op, dst, a, b, imm);
+			break;
+		default:
+			batch_kernel_scalar(op, dst, a, b, imm);
+			break;
+	}
+}
+
+void batch_kernel_scalar(int op, uint32_t *dst, uint32_t *a, uint32_t *b, uint32_t imm)
+{
+	int l, n = (BATCH_LANES + 7) & ~7;
+	uint32_t x, y, r;
+	
+	for (l = 0; l < n; l++){
+		x = a[l];
+		y = (b != NULL) ? b[l] : imm;
+		switch(op){
+			case BOP_ADD: r = x + y; break;
+			case BOP_SUB: r = x - y; break;
+			case BOP_AND: r = x & y; break;
+			case BOP_OR: r = x | y; break;
+			case BOP_XOR: r = x ^ y; break;
+			case BOP_NOR: r = ~(x | y); break;
+			case BOP_SLT: r = (int32_t)x < (int32_t)y; break;
+			case BOP_SLL: r = x << imm; break;
+			case BOP_SRL: r = x >> imm; break;
+			default: r = (uint32_t)((int32_t)x >> imm); break;
+		}
+		dst[l] = (r & BATCH.mask[l]) | (dst[l] & ~BATCH.mask[l]);
+	}
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse2")))
+void batch_kernel_sse2(int op, uint32_t *dst, uint32_t *a, uint32_t *b, uint32_t imm)
+{
+	int l, n = (BATCH_LANES + 7) & ~7;
+	__m128i x, y, r, m;
+	__m128i count = _mm_cvtsi32_si128(imm);
+	__m128i broadcast = _mm_set1_epi32(imm);
+	__m128i ones = _mm_set1_epi32(-1);
+	__m128i one = _mm_set1_epi32(1);
+	
+	for (l = 0; l < n; l += 4){
+		x = _mm_load_si128((__m128i *)&a[l]);
+		y = (b != NULL) ? _mm_load_si128((__m128i *)&b[l]) : broadcast;
+		switch(op){
+			case BOP_ADD: r = _mm_add_epi32(x, y); break;
+			case BOP_SUB: r = _mm_sub_epi32(x, y); break;
+			case BOP_AND: r = _mm_and_si128(x, y); break;
+			case BOP_OR: r = _mm_or_si128(x, y); break;
+			case BOP_XOR: r = _mm_xor_si128(x, y); break;
+			case BOP_NOR: r = _mm_xor_si128(_mm_or_si128(x, y), ones); break;
+			case BOP_SLT: r = _mm_and_si128(_mm_cmplt_epi32(x, y), one); break;
+			case BOP_SLL: r = _mm_sll_epi32(x, count); break;
+			case BOP_SRL: r = _mm_srl_epi32(x, count); break;
+			default: r = _mm_sra_epi32(x, count); break;
+		}
+		m = _mm_load_si128((__m128i *)&BATCH.mask[l]);
+		r = _mm_or_si128(_mm_and_si128(m, r), _mm_andnot_si128(m, _mm_load_si128((__m128i *)&dst[l])));
+		_mm_store_si128((__m128i *)&dst[l], r);
+	}
+}
+
+__attribute__((target("avx2")))
+void batch_kernel_avx2(int op, uint32_t *dst, uint32_t *a, uint32_t *b, uint32_t imm)
+{
+	int l, n = (BATCH_LANES + 7) & ~7;
+	__m256i x, y, r, m;
+	__m128i count = _mm_cvtsi32_si128(imm);
+	__m256i broadcast = _mm256_set1_epi32(imm);
+	__m256i ones = _mm256_set1_epi32(-1);
+	__m256i one = _mm256_set1_epi32(1);
+	
+	for (l = 0; l < n; l += 8){
+		x = _mm256_load_si256((__m256i *)&a[l]);
+		y = (b != NULL) ? _mm256_load_si256((__m256i *)&b[l]) : broadcast;
+		switch(op){
+			case BOP_ADD: r = _mm256_add_epi32(x, y); break;
+			case BOP_SUB: r = _mm256_sub_epi32(x, y); break;
+			case BOP_AND: r = _mm256_and_si256(x, y); break;
+			case BOP_OR: r = _mm256_or_si256(x, y); break;
+			case BOP_XOR: r = _mm256_xor_si256(x, y); break;
+			case BOP_NOR: r = _mm256_xor_si256(_mm256_or_si256(x, y), ones); break;
+			case BOP_SLT: r = _mm256_and_si256(_mm256_cmpgt_epi32(y, x), one); break;
+			case BOP_SLL: r = _mm256_sll_epi32(x, count); break;
+			case BOP_SRL: r = _mm256_srl_epi32(x, count); break;
+			default: r = _mm256_sra_epi32(x, count); break;
+		}
+		m = _mm256_load_si256((__m256i *)&BATCH.mask[l]);
+		r = _mm256_blendv_epi8(_mm256_load_si256((__m256i *)&dst[l]), r, m);
+		_mm256_store_si256((__m256i *)&dst[l], r);
+	}
+}
+#else
+void batch_kernel_sse2(int op, uint32_t *dst, uint32_t *a, uint32_t *b, uint32_t imm)
+{
+	batch_kernel_scalar(op, dst, a, b, imm);	//Never selected off x86
+}
+
+void batch_kernel_avx2(int op, uint32_t *dst, uint32_t *a, uint32_t *b, uint32_t imm)
+{
+	batch_kernel_scalar(op, dst, a, b, imm);
+}
+#endif
+
+/************************************************************/
+/* dump the registers of one batch lane                                                              */
+/************************************************************/
+void batch_dump(int lane)
+{
+	CPU_State saved = CURRENT_STATE;
+	uint32_t saved_instructions = INSTRUCTION_COUNT;
+	uint32_t saved_cycles = CYCLE_COUNT;
+	int r;
+	
+	if (lane < 0 || lane >= BATCH_LANES){
+		printf("Invalid lane\n");
+		return;
+	}
+	for (r = 0; r < MIPS_REGS; r++){
+		CURRENT_STATE.REGS[r] = BATCH.regs[r][lane];
+	}
+	CURRENT_STATE.PC = BATCH.pc[lane];
+	CURRENT_STATE.HI = BATCH.hi[lane];
+	CURRENT_STATE.LO = BATCH.lo[lane];
+	INSTRUCTION_COUNT = BATCH.instructions[lane];
+	CYCLE_COUNT = 0;	//Functional, no timing
+	rdump();
+	CURRENT_STATE = saved;
+	INSTRUCTION_COUNT = saved_instructions;
+	CYCLE_COUNT = saved_cycles;
+}
+
+/************************************************************/
+/* functional step: execute the instruction at state->PC and describe it in rec,   */
+/* returns FALSE once the exit SYSCALL has executed                                              */
+/************************************************************/
+int func_step(CPU_State *state, Trace_Record *rec)
+{
+	Decoded_Inst d;
+	uint32_t a, b, value = 0;
+	
+	rec->pc = state->PC;
+	rec->instruction = mem_read_32(state->PC);
+	rec->addr = 0;
+	rec->next_pc = state->PC + 4;
+	rec->flags = 0;
+	decode_instruction(rec->instruction, &d);
+	a = state->REGS[d.rs];
+	b = state->REGS[d.rt];
+	if (d.opcode == 0x00 && d.funct == 0x0C){	//SYSCALL
+		if (a == 0xA){
+			rec->flags |= TRACE_EXIT;
+		}
+	}
+	else if (d.is_load || d.is_store){
+		rec->addr = a + d.imm;
+		if (d.is_store){
+			store_data(&d, rec->addr, b);
+		}
+		if (d.is_load){
+			value = (d.opcode == 0x38) ? 1 : load_data(&d, rec->addr);	//SC always succeeds, single thread
+			if (rec->addr >= MMIO_BEGIN){
+				mmio_consume(rec->addr);
+			}
+		}
+	}
+	else{
+		value = alu_compute(&d, state->PC, a, b, &state->HI, &state->LO);
+		if (d.is_branch){
+			rec->next_pc = branch_resolve(&d, state->PC, a, b);
+		}
+	}
+	if (d.dest != 0){
+		state->REGS[d.dest] = value;
+	}
+	state->PC = rec->next_pc;
+	return !(rec->flags & TRACE_EXIT);
+}
+
+/************************************************************/
+/* functional engine thread: run the program ahead of the timing model         */
+/************************************************************/
+void *trace_producer(void *arg)
+{
+	Trace_Ring *ring = &TRACE_RING;
+	Trace_Record rec;
+	uint32_t tail = 0;
+	int more = TRUE;
+	
+	(void)arg;
+	PROF_ON = FALSE;	//PROF belongs to the timing thread
+	while (more){
+		more = func_step(&TRACE_STATE, &rec);
+		if (TRACE_OUT_FP != NULL){
+			fwrite(&rec, sizeof(Trace_Record), 1, TRACE_OUT_FP);
+		}
+		while (tail - atomic_load_explicit(&ring->head, memory_order_acquire) == TRACE_RING_SIZE){
+			if (atomic_load_explicit(&ring->stop, memory_order_relaxed)){
+				return NULL;
+			}
+			sched_yield();
+		}
+		ring->buf[tail % TRACE_RING_SIZE] = rec;
+		atomic_store_explicit(&ring->tail, ++tail, memory_order_release);
+	}
+	atomic_store_explicit(&ring->done, TRUE, memory_order_release);
+	return NULL;
+}
+
+/************************************************************/
+/* open the trace, or start the functional engine, on the first cycle                   */
+/************************************************************/
+int trace_start()
+{
+	uint32_t magic = TRACE_MAGIC;
+	
+	TRACE_STARTED = TRUE;
+	if (strcmp(TRACE_IN, "-") != 0){
+		TRACE_IN_FP = fopen(TRACE_IN, "rb");
+		if (TRACE_IN_FP == NULL || fread(&magic, sizeof(magic), 1, TRACE_IN_FP) != 1 || magic != TRACE_MAGIC){
+			printf("Error: %s is not a trace file\n", TRACE_IN);
+			return FALSE;
+		}
+		return TRUE;
+	}
+	if (TRACE_OUT[0] != '\0'){
+		TRACE_OUT_FP = fopen(TRACE_OUT, "wb");
+		if (TRACE_OUT_FP == NULL){
+			printf("Error: Can't write trace %s\n", TRACE_OUT);
+			return FALSE;
+		}
+		fwrite(&magic, sizeof(magic), 1, TRACE_OUT_FP);
+	}
+	TRACE_STATE = CURRENT_STATE;
+	memset(&TRACE_RING, 0, sizeof(Trace_Ring));
+	if (pthread_create(&TRACE_THREAD, NULL, trace_producer, NULL) != 0){
+		printf("Error: Can't start the functional engine\n");
+		return FALSE;
+	}
+	TRACE_THREADED = TRUE;
+	return TRUE;
+}
+
+/************************************************************/
+/* next record of the trace, FALSE at its end                                                         */
+/************************************************************/
+int trace_next(Trace_Record *rec)
+{
+	Trace_Ring *ring = &TRACE_RING;
+	uint32_t head;
+	
+	if (TRACE_IN_FP != NULL){
+		return fread(rec, sizeof(Trace_Record), 1, TRACE_IN_FP) == 1;
+	}
+	head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	while (head == atomic_load_explicit(&ring->tail, memory_order_acquire)){
+		if (atomic_load_explicit(&ring->done, memory_order_acquire) &&
+			head == atomic_load_explicit(&ring->tail, memory_order_acquire)){
+			return FALSE;
+		}
+		sched_yield();
+	}
+	*rec = ring->buf[head % TRACE_RING_SIZE];
+	atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+	return TRUE;
+}
+
+/************************************************************/
+/* stop the functional engine and close the trace files                                            */
+/************************************************************/
+void trace_finish()
+{
+	if (!TRACE_STARTED){
+		return;
+	}
+	if (TRACE_THREADED){
+		atomic_store_explicit(&TRACE_RING.stop, TRUE, memory_order_relaxed);
+		pthread_join(TRACE_THREAD, NULL);
+		TRACE_THREADED = FALSE;
+	}
+	if (TRACE_IN_FP != NULL){
+		fclose(TRACE_IN_FP);
+		TRACE_IN_FP = NULL;
+	}
+	if (TRACE_OUT_FP != NULL){
+		fclose(TRACE_OUT_FP);
+		TRACE_OUT_FP = NULL;
+	}
+	TRACE_STARTED = FALSE;
+}
+
+/************************************************************/
+/* drop any trace in flight, on reset and when the core model changes           */
+/************************************************************/
+void trace_reset()
+{
+	trace_finish();
+	TRACE_TICK = 0;
+	memset(REG_READY, 0, sizeof(REG_READY));
+	TRACE_WAIT = 0;
+	TRACE_EXITING = FALSE;
+}
+
+/************************************************************/
+/* trace-driven cycle: issue one record, or wait out the stalls the pipeline    */
+/* would have taken for the previous one                                                                */
+/************************************************************/
+void trace_cycle()
+{
+	Trace_Record rec;
+	
+	if (!TRACE_STARTED && !trace_start()){
+		trace_finish();
+		RUN_FLAG = FALSE;
+		return;
+	}
+	if (TRACE_WAIT > 0){
+		TRACE_WAIT--;
+		if (TRACE_WAIT == 0 && TRACE_EXITING){	//The exit SYSCALL reached WB
+			trace_finish();
+			if (strcmp(TRACE_IN, "-") == 0){
+				NEXT_STATE = TRACE_STATE;
+			}
+			RUN_FLAG = FALSE;
+		}
+		return;
+	}
+	if (!trace_next(&rec)){
+		printf("Trace ended without an exit SYSCALL\n");
+		trace_finish();
+		RUN_FLAG = FALSE;
+		return;
+	}
+	INSTRUCTION_COUNT++;
+	NEXT_STATE.PC = rec.next_pc;
+	TRACE_WAIT += record_penalty(&rec);
+}
+
+/************************************************************/
+/* cycles the single-issue pipeline loses on top of the one a record issues in:    */
+/* load-use bubbles, data cache misses, redirects and the drain after the exit      */
+/************************************************************/
+uint32_t record_penalty(Trace_Record *rec)
+{
+	Decoded_Inst d;
+	uint32_t stall = 0, miss;
+	
+	decode_instruction(rec->instruction, &d);
+	stall = pipe_hazard(&d, TRACE_TICK);	//Bubbles until the operands can be forwarded
+	HAZARD_STALL_CYCLES += stall;
+	TRACE_TICK += stall;
+	pipe_produce(&d, TRACE_TICK);
+	TRACE_TICK++;
+	if (DCACHE_KB > 0 && (d.is_load || d.is_store)){
+		miss = dcache_access(rec->addr, d.is_store);
+		stall += miss;
+		MEM_STALL_CYCLES += miss;
+	}
+	if (rec->next_pc != rec->pc + 4){
+		stall += REDIRECT_PENALTY;	//IF and ID squashed behind the redirect from EX
+		FLUSH_CYCLES += REDIRECT_PENALTY;
+		TRACE_TICK += REDIRECT_PENALTY;
+	}
+	if (rec->flags & TRACE_EXIT){
+		stall += EXIT_DRAIN_CYCLES;
+		FLUSH_CYCLES += REDIRECT_PENALTY;	//Fetch is squashed behind the exit as well
+		TRACE_EXITING = TRUE;
+	}
+	return stall;
+}
+
+/************************************************************/
+/* interval model: execute functionally and charge each instruction its pipeline   */
+/* penalties in one step, for up to num_cycles cycles                                                   */
+/************************************************************/
+void interval_run(uint32_t num_cycles)
+{
+	Trace_Record rec;
+	uint32_t k;
+	
+	while (num_cycles > 0 && RUN_FLAG){
+		if (TRACE_WAIT > 0){
+			k = TRACE_WAIT < num_cycles ? TRACE_WAIT : num_cycles;
+			TRACE_WAIT -= k;
+			CYCLE_COUNT += k;
+			num_cycles -= k;
+			if (TRACE_WAIT == 0 && TRACE_EXITING){
+				RUN_FLAG = FALSE;
+			}
+			continue;
+		}
+		func_step(&CURRENT_STATE, &rec);
+		INSTRUCTION_COUNT++;
+		TRACE_WAIT = record_penalty(&rec);
+		CYCLE_COUNT++;
+		num_cycles--;
+		if (STATS_PAGE != NULL && INSTRUCTION_COUNT % STATS_EVERY == 0){
+			stats_publish(STATS_RUNNING);
+		}
+	}
+	NEXT_STATE = CURRENT_STATE;
+}
+
+/************************************************************/
+/* copy the architectural state and every page written so far                                   */
+/************************************************************/
+void checkpoint_save(Checkpoint *cp)
+{
+	uint32_t page, n = 0;
+	uint8_t *p;
+	
+	cp->state = CURRENT_STATE;
+	for (page = 0; page < MEM_PAGES; page++){
+		n += MEM_DIRTY[page];
+	}
+	cp->page_addr = malloc(n * sizeof(uint32_t));
+	cp->pages = malloc((size_t)n * MEM_PAGE_SIZE);
+	cp->num_pages = 0;
+	for (page = 0; page < MEM_PAGES && cp->num_pages < n; page++){
+		if (MEM_DIRTY[page] && (p = mem_page(page << MEM_PAGE_SHIFT)) != NULL){
+			cp->page_addr[cp->num_pages] = page << MEM_PAGE_SHIFT;
+			memcpy(cp->pages + (size_t)cp->num_pages * MEM_PAGE_SIZE, p, MEM_PAGE_SIZE);
+			cp->num_pages++;
+		}
+	}
+}
+
+/************************************************************/
+/* reset the machine and put a checkpoint back in place                                             */
+/************************************************************/
+void checkpoint_restore(Checkpoint *cp)
+{
+	uint32_t i;
+	
+	reset();
+	for (i = 0; i < cp->num_pages; i++){
+		memcpy(mem_page(cp->page_addr[i]), cp->pages + (size_t)i * MEM_PAGE_SIZE, MEM_PAGE_SIZE);
+	}
+	CURRENT_STATE = cp->state;
+	NEXT_STATE = CURRENT_STATE;
+	ooo_reset();	//These copy the start PC
+	fe_reset();
+	mt_reset();
+	lockstep_reset();
+}
+
+void checkpoint_free(Checkpoint *cp)
+{
+	free(cp->page_addr);
+	free(cp->pages);
+	cp->page_addr = NULL;
+	cp->pages = NULL;
+	cp->num_pages = 0;
+}
+
+/************************************************************/
+/* integer hash, drives the projection and the k-means seeding                             */
+/************************************************************/
+uint32_t sp_hash(uint32_t x)
+{
+	x ^= x >> 16;
+	x *= 0x7FEB352D;
+	x ^= x >> 15;
+	x *= 0x846CA68B;
+	x ^= x >> 16;
+	return x;
+}
+
+/************************************************************/
+/* add count executions of the block at leader to a projected vector                     */
+/* each block gets a fixed random direction in [-1,1)^SP_DIMS                                   */
+/************************************************************/
+void sp_add_block(float *vec, uint32_t leader, uint32_t count)
+{
+	uint32_t r;
+	int j;
+	
+	for (j = 0; j < SP_DIMS; j++){
+		r = sp_hash(leader * SP_DIMS + j + SP_SEED);
+		vec[j] += count * ((r >> 8) / 8388608.0f - 1.0f);
+	}
+}
+
+float sp_distance(float *a, float *b)
+{
+	float d = 0, t;
+	int j;
+	
+	for (j = 0; j < SP_DIMS; j++){
+		t = a[j] - b[j];
+		d += t * t;
+	}
+	return d;
+}
+
+/************************************************************/
+/* k-means++ seeding then Lloyd iterations, returns the number of clusters             */
+/************************************************************/
+int sp_kmeans(float *vecs, int n, int k, int *cluster, float *cent)
+{
+	double *near = malloc(n * sizeof(double));
+	double total, pick;
+	uint32_t rng = sp_hash(SP_SEED);
+	int count[SP_MAX_K];
+	int i, j, c, best, it, changed;
+	float d, bestd;
+	
+	if (k > n){
+		k = n;
+	}
+	memcpy(cent, vecs + (rng % n) * SP_DIMS, SP_DIMS * sizeof(float));
+	for (c = 1; c < k; c++){	//Next seed is an interval picked with probability ~ distance^2
+		total = 0;
+		for (i = 0; i < n; i++){
+			near[i] = sp_distance(vecs + i * SP_DIMS, cent);
+			for (j = 1; j < c; j++){
+				d = sp_distance(vecs + i * SP_DIMS, cent + j * SP_DIMS);
+				near[i] = d < near[i] ? d : near[i];
+			}
+			total += near[i];
+		}
+		rng = sp_hash(rng);
+		pick = rng / 4294967296.0 * total;
+		for (i = 0; i < n - 1 && pick >= near[i]; i++){
+			pick -= near[i];
+		}
+		memcpy(cent + c * SP_DIMS, vecs + i * SP_DIMS, SP_DIMS * sizeof(float));
+	}
+	for (i = 0; i < n; i++){
+		cluster[i] = -1;
+	}
+	for (it = 0; it < SP_ITERATIONS; it++){
+		changed = 0;
+		for (i = 0; i < n; i++){
+			best = 0;
+			bestd = sp_distance(vecs + i * SP_DIMS, cent);
+			for (c = 1; c < k; c++){
+				d = sp_distance(vecs + i * SP_DIMS, cent + c * SP_DIMS);
+				if (d < bestd){
+					bestd = d;
+					best = c;
+				}
+			}
+			changed += cluster[i] != best;
+			cluster[i] = best;
+		}
+		if (changed == 0){
+			break;
+		}
+		memset(cent, 0, k * SP_DIMS * sizeof(float));
+		memset(count, 0, sizeof(count));
+		for (i = 0; i < n; i++){
+			count[cluster[i]]++;
+			for (j = 0; j < SP_DIMS; j++){
+				cent[cluster[i] * SP_DIMS + j] += vecs[i * SP_DIMS + j];
+			}
+		}
+		for (c = 0; c < k; c++){
+			for (j = 0; j < SP_DIMS && count[c] > 0; j++){
+				cent[c * SP_DIMS + j] /= count[c];
+			}
+		}
+	}
+	free(near);
+	return k;
+}
+
+/************************************************************/
+/* profile the program, pick one interval per phase, run those on the detailed core  */
+/* from checkpoints and rebuild whole-program CPI from the phase weights              */
+/************************************************************/
+void simpoint_run(uint32_t interval, int k, char *file)
+{
+	Checkpoint start;
+	SimPoint points[SP_MAX_K], tmp;
+	Trace_Record rec;
+	Decoded_Inst d;
+	float cent[SP_MAX_K * SP_DIMS];
+	float *vecs = NULL, *vec = NULL;
+	int *cluster;
+	int n = 0, cap = 0, i, j, c, more = TRUE;
+	uint32_t leader, count = 0, length = 0, total = 0, last = 0, pos;
+	float dist, bestd;
+	double cpi = 0, detailed = 0;
+	FILE *fp;
+	
+	if (CYCLE_COUNT != 0 || INSTRUCTION_COUNT != 0){
+		printf("simpoint starts from the freshly loaded program, use reset\n");
+		return;
+	}
+	if (MC_CORES > 1 || NUM_THREADS > 1 || MMU_MODE != MMU_OFF || CORE_MODEL == CORE_INTERVAL){
+		printf("simpoint needs a single-thread, single-core, cycle-level core without the MMU\n");
+		return;
+	}
+	if (interval == 0 || k < 1 || k > SP_MAX_K){
+		printf("simpoint needs a non-zero interval and between 1 and %d phases\n", SP_MAX_K);
+		return;
+	}
+	
+	/* profile: one basic-block vector per interval, normalised by its length */
+	checkpoint_save(&start);
+	leader = CURRENT_STATE.PC;
+	while (more && total != 0xFFFFFFFF){
+		if (length == 0){
+			if (n == cap){
+				cap = cap ? cap * 2 : 64;
+				vecs = realloc(vecs, cap * SP_DIMS * sizeof(float));
+			}
+			vec = vecs + n++ * SP_DIMS;
+			memset(vec, 0, SP_DIMS * sizeof(float));
+		}
+		more = func_step(&CURRENT_STATE, &rec);
+		count++;
+		length++;
+		total++;
+		decode_instruction(rec.instruction, &d);
+		if (d.is_branch || rec.next_pc != rec.pc + 4 || !more || length == interval){
+			sp_add_block(vec, leader, count);
+			leader = rec.next_pc;
+			count = 0;
+		}
+		if (length == interval || !more){
+			for (j = 0; j < SP_DIMS; j++){
+				vec[j] /= length;
+			}
+			last = length;
+			length = 0;
+		}
+	}
+	
+	/* phases: the interval nearest each centroid represents it, weighted by instructions */
+	cluster = malloc(n * sizeof(int));
+	k = sp_kmeans(vecs, n, k, cluster, cent);
+	for (c = 0; c < k; c++){
+		points[c].weight = 0;
+		bestd = -1;
+		for (i = 0; i < n; i++){
+			if (cluster[i] != c){
+				continue;
+			}
+			points[c].weight += (i == n - 1 ? last : interval) / (double)total;
+			dist = sp_distance(vecs + i * SP_DIMS, cent + c * SP_DIMS);
+			if (bestd < 0 || dist < bestd){
+				bestd = dist;
+				points[c].interval = i;
+			}
+		}
+	}
+	for (c = j = 0; c < k; c++){	//Drop clusters k-means left empty
+		if (points[c].weight > 0){
+			points[j++] = points[c];
+		}
+	}
+	k = j;
+	for (i = 1; i < k; i++){	//Order by position so one functional pass reaches them all
+		tmp = points[i];
+		for (j = i; j > 0 && points[j - 1].interval > tmp.interval; j--){
+			points[j] = points[j - 1];
+		}
+		points[j] = tmp;
+	}
+	
+	/* checkpoints: fast-forward functionally to the start of each point */
+	checkpoint_restore(&start);
+	pos = 0;
+	for (c = 0; c < k; c++){
+		while (pos < points[c].interval * interval){
+			func_step(&CURRENT_STATE, &rec);
+			pos++;
+		}
+		checkpoint_save(&points[c].start);
+	}
+	
+	/* detailed: one interval per point */
+	for (c = 0; c < k; c++){
+		checkpoint_restore(&points[c].start);
+		while (RUN_FLAG && INSTRUCTION_COUNT < interval){
+			cycle();
+		}
+		points[c].instructions = INSTRUCTION_COUNT;
+		points[c].cycles = CYCLE_COUNT;
+		cpi += points[c].weight * CYCLE_COUNT / (INSTRUCTION_COUNT ? INSTRUCTION_COUNT : 1);
+		detailed += CYCLE_COUNT;
+		checkpoint_free(&points[c].start);
+	}
+	checkpoint_restore(&start);	//Leave the program ready to run from the beginning
+	checkpoint_free(&start);
+	
+	printf("SimPoint: %u instructions in %d intervals of %u, %d phases\n", total, n, interval, k);
+	printf("Point\tInterval\tWeight\tInstructions\tCycles\t\tCPI\n");
+	for (c = 0; c < k; c++){
+		printf("%d\t%u\t\t%.4f\t%u\t\t%u\t\t%.3f\n", c, points[c].interval, points[c].weight, points[c].instructions,
+			points[c].cycles, points[c].instructions ? (double)points[c].cycles / points[c].instructions : 0.0);
+	}
+	printf("Estimated CPI\t\t: %.3f\n", cpi);
+	printf("Estimated Cycles\t: %.0f\n", cpi * total);
+	printf("Detailed Cycles Run\t: %.0f\n", detailed);
+	if (file != NULL){
+		fp = fopen(file, "w");
+		if (fp == NULL){
+			printf("Error: Can't write %s\n", file);
+		}
+		else{
+			fprintf(fp, "# interval %u\n", interval);
+			for (c = 0; c < k; c++){
+				fprintf(fp, "%u %.6f\n", points[c].interval, points[c].weight);
+			}
+			fclose(fp);
+		}
+	}
+	free(cluster);
+	free(vecs);
+}
+
+/************************************************************/
+/* fold one word into a fingerprint                                                                           */
+/************************************************************/
+uint64_t fp_mix(uint64_t hash, uint32_t word)
+{
+	int i;
+	
+	for (i = 0; i < 4; i++){
+		hash = (hash ^ ((word >> (8 * i)) & 0xFF)) * FP_PRIME;
+	}
+	return hash;
+}
+
+/************************************************************/
+/* fold a committed instruction into the commit hash, value is what it wrote to      */
+/* d->dest and addr the effective address of a store                                                */
+/************************************************************/
+void commit_hash(uint32_t pc, Decoded_Inst *d, uint32_t value, uint32_t addr)
+{
+	uint32_t word = 0;
+	
+	COMMIT_HASH = fp_mix(COMMIT_HASH, pc);
+	if (d->dest != 0){
+		COMMIT_HASH = fp_mix(fp_mix(COMMIT_HASH, d->dest), value);
+	}
+	else{
+		value = 0;
+	}
+	if (d->is_store){
+		word = mem_read_32(addr & ~3);	//Younger stores have not reached memory yet
+		COMMIT_HASH = fp_mix(fp_mix(COMMIT_HASH, addr), word);
+	}
+	else{
+		addr = 0;
+	}
+	COMMIT_COUNT++;
+	if (COMMIT_LOG_FP != NULL){
+		fprintf(COMMIT_LOG_FP, "%08x %2u %08x %08x %08x\n", pc, d->dest, value, addr, word);
+	}
+}
+
+/************************************************************/
+/* hash of the registers and the content of every touched page that is not zero  */
+/************************************************************/
+uint64_t state_hash()
+{
+	uint64_t hash = FP_SEED;
+	uint32_t page, i, *words;
+	uint8_t *p;
+	
+	for (i = 1; i < MIPS_REGS; i++){
+		hash = fp_mix(hash, CURRENT_STATE.REGS[i]);
+	}
+	hash = fp_mix(fp_mix(hash, CURRENT_STATE.HI), CURRENT_STATE.LO);
+	for (page = 0; page < MEM_PAGES; page++){
+		if (!MEM_DIRTY[page] || (p = mem_page(page << MEM_PAGE_SHIFT)) == NULL){
+			continue;
+		}
+		words = (uint32_t *)p;
+		for (i = 0; i < MEM_PAGE_SIZE / 4 && words[i] == 0; i++);
+		if (i == MEM_PAGE_SIZE / 4){
+			continue;	//Written back to zero, same as never touched
+		}
+		hash = fp_mix(hash, page);
+		for (i = 0; i < MEM_PAGE_SIZE / 4; i++){
+			hash = fp_mix(hash, words[i]);
+		}
+	}
+	return hash;
+}
+
+/************************************************************/
+/* Print the fingerprint of the run so far                                                               */ 
+/************************************************************/
+void print_fingerprint(){
+	if (!FINGERPRINT){
+		printf("Set fingerprint 1 before the first cycle\n");
+		return;
+	}
+	if (COMMIT_LOG_FP != NULL){
+		fflush(COMMIT_LOG_FP);
+	}
+	printf("Fingerprint\t\t: %u %016llx %016llx\n", COMMIT_COUNT, (unsigned long long)COMMIT_HASH,
+		(unsigned long long)state_hash());
+}
+
+/************************************************************/
+/* run up to num_instructions (0 for all) on the functional engine, the reference */
+/* for fingerprints; the timing models continue from where it stops                      */
+/************************************************************/
+void func_run(uint32_t num_instructions)
+{
+	Trace_Record rec;
+	Decoded_Inst d;
+	uint32_t n;
+	int more = TRUE;
+	
+	if (CYCLE_COUNT != 0 || NUM_THREADS > 1 || MC_CORES > 1){
+		printf("func runs a single-thread, single-core program before the first cycle, use reset\n");
+		return;
+	}
+	for (n = 0; RUN_FLAG && more && (num_instructions == 0 || n < num_instructions); n++){
+		more = func_step(&CURRENT_STATE, &rec);
+		INSTRUCTION_COUNT++;
+		if (FINGERPRINT){
+			decode_instruction(rec.instruction, &d);
+			commit_hash(rec.pc, &d, CURRENT_STATE.REGS[d.dest], rec.addr);
+		}
+	}
+	if (!more){
+		RUN_FLAG = FALSE;	//The exit SYSCALL ran
+	}
+	NEXT_STATE = CURRENT_STATE;
+	ooo_reset();
+	fe_reset();
+	mt_reset();
+	lockstep_reset();
+	console_flush();
+	printf("Functional run stopped at PC 0x%08x after %u instructions\n", CURRENT_STATE.PC, INSTRUCTION_COUNT);
+}
+
+/************************************************************/
+/* start the lockstep model from the current architectural state                           */
+/************************************************************/
+void lockstep_reset()
+{
+	LS_STATE = CURRENT_STATE;
+	LS_CHECKED = 0;
+	LS_FAILED = FALSE;
+}
+
+/************************************************************/
+/* step the lockstep model over the instruction the timing model committed at pc,   */
+/* value is what it wrote to d->dest and addr the effective address of a load or store */
+/************************************************************/
+void lockstep_check(uint32_t pc, Decoded_Inst *d, uint32_t value, uint32_t addr)
+{
+	uint32_t a, b, want = 0, word, i;
+	uint32_t next_pc = pc + 4;
+	int exit = FALSE;
+	char what[32];
+	
+	if (LS_FAILED){
+		return;
+	}
+	if (pc != LS_STATE.PC){
+		lockstep_fail(pc, "PC", LS_STATE.PC, pc);
+		return;
+	}
+	a = LS_STATE.REGS[d->rs];
+	b = LS_STATE.REGS[d->rt];
+	if (d->opcode == 0x00 && d->funct == 0x0C){	//SYSCALL
+		exit = (a == 0xA);
+	}
+	else if (d->is_load || d->is_store){
+		if (addr != a + d->imm){
+			lockstep_fail(pc, "address", a + d->imm, addr);
+			return;
+		}
+		if (addr >= MMIO_BEGIN){
+			want = value;	//Device registers are not replayed, the model takes what the core saw
+		}
+		else{
+			if (d->is_store){
+				word = mem_read_32(addr & ~0x3);	//Younger stores have not reached memory yet
+				if (merge_store(d, addr, word, b) != word){
+					lockstep_fail(pc, "stored word", merge_store(d, addr, word, b), word);
+					return;
+				}
+			}
+			if (d->is_load){
+				want = (d->opcode == 0x38) ? 1 : load_data(d, addr);	//SC always succeeds, single thread
+			}
+		}
+	}
+	else{
+		want = alu_compute(d, pc, a, b, &LS_STATE.HI, &LS_STATE.LO);
+		if (d->is_branch){
+			next_pc = branch_resolve(d, pc, a, b);
+		}
+	}
+	if (d->dest != 0){
+		if (value != want){
+			snprintf(what, sizeof(what), "$r%u", d->dest);
+			lockstep_fail(pc, what, want, value);
+			return;
+		}
+		LS_STATE.REGS[d->dest] = want;
+	}
+	LS_STATE.PC = next_pc;
+	LS_CHECKED++;
+	if (exit || LS_CHECKED % LS_SWEEP == 0){	//A write to a register the instruction does not name
+		for (i = 1; i < MIPS_REGS; i++){
+			if (NEXT_STATE.REGS[i] != LS_STATE.REGS[i]){
+				snprintf(what, sizeof(what), "$r%u (register sweep)", i);
+				lockstep_fail(pc, what, LS_STATE.REGS[i], NEXT_STATE.REGS[i]);
+				return;
+			}
+		}
+	}
+}
+
+/************************************************************/
+/* report the first difference between the timing model and the lockstep model      */
+/************************************************************/
+void lockstep_fail(uint32_t pc, const char *what, uint32_t want, uint32_t got)
+{
+	printf("Lockstep mismatch at commit %u, cycle %u\n", LS_CHECKED + 1, CYCLE_COUNT);
+	printf("\t0x%08x\t", pc);
+	print_instruction(pc);
+	printf("\t%s: want 0x%08x, got 0x%08x\n", what, want, got);
+	printf("\tfunctional model: PC 0x%08x, HI 0x%08x, LO 0x%08x\n", LS_STATE.PC, LS_STATE.HI, LS_STATE.LO);
+	LS_FAILED = TRUE;
+	RUN_FLAG = FALSE;
+}
+
+/************************************************************/
+/* read a device register, without side effects                                                     */
+/************************************************************/
+uint32_t mmio_read(uint32_t address)
+{
+	switch(address & ~0x3){
+		case MMIO_RX_CTRL:
+			return CONSOLE_RX_NEXT >= 0;
+		case MMIO_RX_DATA:
+			return CONSOLE_RX_NEXT >= 0 ? (uint32_t)CONSOLE_RX_NEXT : 0;
+		case MMIO_TX_CTRL:
+			return 1;	//Buffered, never busy
+		case MMIO_CYCLES:
+			return CYCLE_COUNT;
+		case MMIO_INSTS:
+			return INSTRUCTION_COUNT;
+		case MMIO_ROI:
+			return ROI_OPEN;
+		default:
+			return 0;
+	}
+}
+
+/************************************************************/
+/* write a device register                                                                                      */
+/************************************************************/
+void mmio_write(uint32_t address, uint32_t value)
+{
+	Roi_Counters now;
+	
+	switch(address & ~0x3){
+		case MMIO_TX_DATA:
+			pthread_mutex_lock(&CONSOLE_LOCK);
+			CONSOLE_TX[CONSOLE_TX_LEN++] = value & 0xFF;	//SB lands in the low byte
+			CONSOLE_TX_BYTES++;
+			if (CONSOLE_TX_LEN == CONSOLE_BUF_SIZE){
+				console_flush();
+			}
+			pthread_mutex_unlock(&CONSOLE_LOCK);
+			break;
+		case MMIO_ROI:
+			if (value != 0 && !ROI_OPEN){
+				roi_counters(&ROI_START);
+				ROI_OPEN = TRUE;
+				ROI_REGIONS++;
+			}
+			else if (value == 0 && ROI_OPEN){
+				roi_counters(&now);
+				ROI_TOTAL.cycles += now.cycles - ROI_START.cycles;
+				ROI_TOTAL.instructions += now.instructions - ROI_START.instructions;
+				ROI_TOTAL.hazard_stalls += now.hazard_stalls - ROI_START.hazard_stalls;
+				ROI_TOTAL.mem_stalls += now.mem_stalls - ROI_START.mem_stalls;
+				ROI_TOTAL.flush_cycles += now.flush_cycles - ROI_START.flush_cycles;
+				ROI_OPEN = FALSE;
+			}
+			break;
+	}
+}
+
+/************************************************************/
+/* a load from address committed, take the console byte it read                          */
+/************************************************************/
+void mmio_consume(uint32_t address)
+{
+	if ((address & ~0x3) == MMIO_RX_DATA && CONSOLE_RX_NEXT >= 0){
+		CONSOLE_RX_NEXT = getc(CONSOLE_IN_FP);	//EOF is -1, nothing waiting
+	}
+}
+
+/************************************************************/
+/* send buffered console output and rewind the input, clear the regions of interest */
+/************************************************************/
+void console_reset()
+{
+	console_flush();
+	CONSOLE_TX_BYTES = 0;
+	CONSOLE_RX_NEXT = -1;
+	if (CONSOLE_IN_FP != NULL){
+		rewind(CONSOLE_IN_FP);
+		CONSOLE_RX_NEXT = getc(CONSOLE_IN_FP);
+	}
+	ROI_OPEN = FALSE;
+	ROI_REGIONS = 0;
+	memset(&ROI_TOTAL, 0, sizeof(Roi_Counters));
+}
+
+/************************************************************/
+/* send buffered console output, with the cores stopped or CONSOLE_LOCK held       */
+/************************************************************/
+void console_flush()
+{
+	FILE *fp = CONSOLE_OUT_FP != NULL ? CONSOLE_OUT_FP : stdout;
+	
+	if (CONSOLE_TX_LEN > 0){
+		fwrite(CONSOLE_TX, 1, CONSOLE_TX_LEN, fp);
+		CONSOLE_TX_LEN = 0;
+		fflush(fp);
+	}
+}
+
+/************************************************************/
+/* the counters a region of interest covers                                                            */
+/************************************************************/
+void roi_counters(Roi_Counters *c)
+{
+	c->cycles = CYCLE_COUNT;
+	c->instructions = INSTRUCTION_COUNT;
+	c->hazard_stalls = HAZARD_STALL_CYCLES;
+	c->mem_stalls = MEM_STALL_CYCLES;
+	c->flush_cycles = FLUSH_CYCLES;
+}
+
+/************************************************************/
+/* Print the stages of the pipeline and the latencies derived from them                    */ 
+/************************************************************/
+void print_pipe_shape(){
+	printf("Pipeline Stages\t\t: IF x%d, ID, EX x%d, MEM x%d, WB (%d deep)\n", IF_STAGES, EX_STAGES, MEM_STAGES,
+		IF_STAGES + EX_STAGES + MEM_STAGES + 2);
+	printf("Forwarding Latency\t: ALU %u, load %u (ticks from EX to a dependent EX)\n", ALU_LATENCY, LOAD_LATENCY);
+	printf("Taken Branch Penalty\t: %u\n", REDIRECT_PENALTY);
+}
+
+/************************************************************/
+/* Print the counters of the regions of interest, an open one counts up to now     */ 
+/************************************************************/
+void print_roi_stats(){
+	Roi_Counters t = ROI_TOTAL, now;
+	
+	if (ROI_OPEN){
+		roi_counters(&now);
+		t.cycles += now.cycles - ROI_START.cycles;
+		t.instructions += now.instructions - ROI_START.instructions;
+		t.hazard_stalls += now.hazard_stalls - ROI_START.hazard_stalls;
+		t.mem_stalls += now.mem_stalls - ROI_START.mem_stalls;
+		t.flush_cycles += now.flush_cycles - ROI_START.flush_cycles;
+	}
+	printf("Regions of Interest\t: %u%s\n", ROI_REGIONS, ROI_OPEN ? ", the last still open" : "");
+	printf("# ROI Cycles\t\t: %u\n", t.cycles);
+	printf("# ROI Instructions\t: %u\n", t.instructions);
+	printf("ROI IPC\t\t\t: %.3f\n", t.cycles ? (double)t.instructions / t.cycles : 0.0);
+	if (CORE_MODEL != CORE_OOO && t.instructions > 0){
+		printf("ROI CPI Breakdown\t: %.3f base + %.3f hazard + %.3f memory + %.3f flush\n",
+			(double)(t.cycles - t.hazard_stalls - t.mem_stalls - t.flush_cycles) / t.instructions,
+			(double)t.hazard_stalls / t.instructions, (double)t.mem_stalls / t.instructions,
+			(double)t.flush_cycles / t.instructions);
+	}
+}
+
+/************************************************************/
+/* run a gdb session on 127.0.0.1:port until gdb detaches or kills the program    */
+/************************************************************/
+void gdb_serve(int port)
+{
+	struct sockaddr_in addr;
+	char pkt[GDB_PACKET_SIZE], reply[2 * GDB_PACKET_SIZE];
+	int server, one = 1;
+	
+	if (CYCLE_COUNT != 0 || NUM_THREADS > 1 || MC_CORES > 1){
+		printf("gdb attaches to a single-thread, single-core program before the first cycle, use reset\n");
+		return;
+	}
+	server = socket(AF_INET, SOCK_STREAM, 0);
+	if (server < 0){
+		printf("Error: Can't create socket\n");
+		return;
+	}
+	setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);	//Local debugging only
+	if (bind(server, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(server, 1) < 0){
+		printf("Error: Can't listen on 127.0.0.1:%d\n", port);
+		close(server);
+		return;
+	}
+	printf("Waiting for gdb on 127.0.0.1:%d (target remote :%d)\n", port, port);
+	fflush(stdout);
+	GDB_FD = accept(server, NULL, NULL);
+	close(server);
+	if (GDB_FD < 0){
+		printf("Error: accept failed\n");
+		return;
+	}
+	GDB_NO_ACK = FALSE;
+	GDB_NUM_POINTS = 0;
+	GDB_IN_LEN = GDB_IN_POS = 0;
+	NEXT_STATE = CURRENT_STATE;
+	while (gdb_recv_packet(pkt) >= 0){
+		reply[0] = '\0';
+		if (!gdb_handle_packet(pkt, reply)){
+			break;
+		}
+		gdb_send_packet(reply);
+		if (strcmp(pkt, "QStartNoAckMode") == 0){
+			GDB_NO_ACK = TRUE;
+		}
+	}
+	close(GDB_FD);
+	GDB_FD = -1;
+	NEXT_STATE = CURRENT_STATE;
+	ooo_reset();	//The timing models pick up where gdb left the program
+	fe_reset();
+	mt_reset();
+	lockstep_reset();
+	console_flush();
+	printf("gdb session closed at PC 0x%08x after %u instructions\n", CURRENT_STATE.PC, INSTRUCTION_COUNT);
+}
+
+/************************************************************/
+/* next byte from gdb, -1 once the connection is gone                                             */
+/************************************************************/
+int gdb_getc()
+{
+	if (GDB_IN_POS == GDB_IN_LEN){
+		GDB_IN_LEN = recv(GDB_FD, GDB_INBUF, sizeof(GDB_INBUF), 0);
+		GDB_IN_POS = 0;
+		if (GDB_IN_LEN <= 0){
+			GDB_IN_LEN = 0;
+			return -1;
+		}
+	}
+	return (unsigned char)GDB_INBUF[GDB_IN_POS++];
+}
+
+/************************************************************/
+/* read one $packet#xx into buf and acknowledge it, returns its length or -1        */
+/* a ^C outside a packet comes back as the one byte packet "\003"                       */
+/************************************************************/
+int gdb_recv_packet(char *buf)
+{
+	unsigned char sum;
+	int ch, len;
+	char check[3];
+	
+	while (1){
+		do {
+			ch = gdb_getc();
+			if (ch == 0x03){
+				buf[0] = 0x03;
+				buf[1] = '\0';
+				return 1;
+			}
+		} while (ch >= 0 && ch != '$');
+		if (ch < 0){
+			return -1;
+		}
+		sum = 0;
+		len = 0;
+		while ((ch = gdb_getc()) >= 0 && ch != '#'){
+			if (len < GDB_PACKET_SIZE - 1){
+				buf[len++] = ch;
+			}
+			sum += ch;
+		}
+		if (ch < 0 || (check[0] = gdb_getc()) < 0 || (check[1] = gdb_getc()) < 0){
+			return -1;
+		}
+		check[2] = '\0';
+		buf[len] = '\0';
+		if (GDB_NO_ACK){
+			return len;
+		}
+		if (strtoul(check, NULL, 16) == sum){
+			send(GDB_FD, "+", 1, 0);
+			return len;
+		}
+		send(GDB_FD, "-", 1, 0);	//Ask for it again
+	}
+}
+
+/************************************************************/
+/* send $data#xx, waiting for the + unless acks are off                                           */
+/************************************************************/
+void gdb_send_packet(const char *data)
+{
+	char frame[2 * GDB_PACKET_SIZE + 8];
+	unsigned char sum = 0;
+	int len, i, ch;
+	
+	len = strlen(data);
+	frame[0] = '$';
+	for (i = 0; i < len; i++){
+		frame[i + 1] = data[i];
+		sum += (unsigned char)data[i];
+	}
+	sprintf(frame + len + 1, "#%02x", sum);
+	do {
+		send(GDB_FD, frame, len + 4, 0);
+		if (GDB_NO_ACK){
+			return;
+		}
+		ch = gdb_getc();
+		if (ch >= 0 && ch != '+' && ch != '-'){
+			GDB_IN_POS--;	//No ack, leave the byte for the next packet
+		}
+	} while (ch == '-');
+}
+
+/************************************************************/
+/* register n in gdb's numbering                                                                              */
+/************************************************************/
+uint32_t gdb_reg_read(int n)
+{
+	switch (n){
+		case 32: return CP0[12];	//Status
+		case 33: return CURRENT_STATE.LO;
+		case 34: return CURRENT_STATE.HI;
+		case 35: return CP0[CP0_BADVADDR];
+		case 36: return CP0[CP0_CAUSE];
+		case 37: return CURRENT_STATE.PC;
+		default: return CURRENT_STATE.REGS[n];
+	}
+}
+
+void gdb_reg_write(int n, uint32_t value)
+{
+	switch (n){
+		case 32: CP0[12] = value; break;
+		case 33: CURRENT_STATE.LO = value; break;
+		case 34: CURRENT_STATE.HI = value; break;
+		case 35: CP0[CP0_BADVADDR] = value; break;
+		case 36: CP0[CP0_CAUSE] = value; break;
+		case 37: CURRENT_STATE.PC = value; break;
+		default:
+			if (n > 0){
+				CURRENT_STATE.REGS[n] = value;	//$zero stays zero
+			}
+			break;
+	}
+	NEXT_STATE = CURRENT_STATE;
+}
+
+/************************************************************/
+/* insert or remove a Z point, FALSE if the table is full or it was not set            */
+/************************************************************/
+int gdb_point(int type, uint32_t addr, uint32_t len, int insert)
+{
+	int i;
+	
+	for (i = 0; i < GDB_NUM_POINTS; i++){
+		if (GDB_POINTS[i].type == type && GDB_POINTS[i].addr == addr && GDB_POINTS[i].len == len){
+			if (!insert){
+				GDB_POINTS[i] = GDB_POINTS[--GDB_NUM_POINTS];
+			}
+			return TRUE;
+		}
+	}
+	if (!insert || GDB_NUM_POINTS == GDB_MAX_POINTS){
+		return FALSE;
+	}
+	GDB_POINTS[GDB_NUM_POINTS].type = type;
+	GDB_POINTS[GDB_NUM_POINTS].addr = addr;
+	GDB_POINTS[GDB_NUM_POINTS].len = len;
+	GDB_NUM_POINTS++;
+	return TRUE;
+}
+
+/************************************************************/
+/* execute until a breakpoint, watchpoint, ^C or exit (one instruction if step)   */
+/* and put the stop reply in reply                                                                            */
+/************************************************************/
+void gdb_resume(int step, char *reply)
+{
+	Trace_Record rec;
+	Decoded_Inst d;
+	struct pollfd pfd;
+	uint32_t steps = 0, size;
+	int i, more;
+	
+	pfd.fd = GDB_FD;
+	pfd.events = POLLIN;
+	while (1){
+		if (!RUN_FLAG){
+			sprintf(reply, "W00");
+			return;
+		}
+		more = func_step(&CURRENT_STATE, &rec);
+		INSTRUCTION_COUNT++;
+		if (GDB_NUM_POINTS > 0 || FINGERPRINT){
+			decode_instruction(rec.instruction, &d);
+		}
+		if (FINGERPRINT){
+			commit_hash(rec.pc, &d, CURRENT_STATE.REGS[d.dest], rec.addr);
+		}
+		if (!more){
+			RUN_FLAG = FALSE;	//The exit SYSCALL ran
+			sprintf(reply, "W00");
+			return;
+		}
+		for (i = 0; i < GDB_NUM_POINTS; i++){
+			if (GDB_POINTS[i].type < 2 || !(d.is_load || d.is_store)){
+				continue;
+			}
+			size = (d.opcode == 0x20 || d.opcode == 0x28) ? 1 : (d.opcode == 0x21 || d.opcode == 0x29) ? 2 : 4;	//No LBU or LHU yet
+			if (rec.addr + size <= GDB_POINTS[i].addr || rec.addr >= GDB_POINTS[i].addr + GDB_POINTS[i].len){
+				continue;
+			}
+			if ((GDB_POINTS[i].type == 2 && d.is_store) || (GDB_POINTS[i].type == 3 && d.is_load) ||
+				GDB_POINTS[i].type == 4){
+				sprintf(reply, "T05%s:%08x;", GDB_POINTS[i].type == 2 ? "watch" :
+					GDB_POINTS[i].type == 3 ? "rwatch" : "awatch", rec.addr);
+				return;
+			}
+		}
+		if (step){
+			sprintf(reply, "S05");
+			return;
+		}
+		for (i = 0; i < GDB_NUM_POINTS; i++){
+			if (GDB_POINTS[i].type < 2 && GDB_POINTS[i].addr == CURRENT_STATE.PC){
+				sprintf(reply, "T05%s:;", GDB_POINTS[i].type == 0 ? "swbreak" : "hwbreak");
+				return;
+			}
+		}
+		if (++steps % GDB_POLL_STEPS == 0 && poll(&pfd, 1, 0) > 0){
+			if (gdb_getc() == 0x03){
+				sprintf(reply, "S02");	//SIGINT
+				return;
+			}
+		}
+	}
+}
+
+/************************************************************/
+/* answer one packet, FALSE once gdb has detached or killed the program             */
+/************************************************************/
+int gdb_handle_packet(char *pkt, char *reply)
+{
+	uint32_t addr, len, value, i;
+	unsigned long reg;
+	uint8_t *byte;
+	char *p;
+	int n, type;
+	
+	switch (pkt[0]){
+		case 0x03:
+		case '?':
+			sprintf(reply, RUN_FLAG ? "S05" : "W00");
+			break;
+			
+		case 'g':
+			for (n = 0; n < GDB_NUM_REGS; n++){
+				value = gdb_reg_read(n);
+				sprintf(reply + 8 * n, "%02x%02x%02x%02x", value & 0xFF, (value >> 8) & 0xFF,
+					(value >> 16) & 0xFF, value >> 24);
+			}
+			break;
+			
+		case 'G':
+			for (n = 0; n < GDB_NUM_REGS && strlen(pkt + 1) >= 8 * (n + 1); n++){
+				value = 0;
+				for (i = 0; i < 4; i++){
+					sscanf(pkt + 1 + 8 * n + 2 * i, "%2x", &len);
+					value |= len << (8 * i);
+				}
+				gdb_reg_write(n, value);
+			}
+			sprintf(reply, "OK");
+			break;
+			
+		case 'p':
+			reg = strtoul(pkt + 1, NULL, 16);
+			if (reg >= GDB_NUM_REGS){
+				sprintf(reply, "xxxxxxxx");	//Floating point, not modelled
+				break;
+			}
+			value = gdb_reg_read(reg);
+			sprintf(reply, "%02x%02x%02x%02x", value & 0xFF, (value >> 8) & 0xFF, (value >> 16) & 0xFF, value >> 24);
+			break;
+			
+		case 'P':
+			reg = strtoul(pkt + 1, &p, 16);
+			value = 0;
+			for (i = 0; i < 4 && *p != '\0' && strlen(p + 1) >= 2 * (i + 1); i++){
+				sscanf(p + 1 + 2 * i, "%2x", &len);
+				value |= len << (8 * i);
+			}
+			if (reg < GDB_NUM_REGS){
+				gdb_reg_write(reg, value);
+			}
+			sprintf(reply, "OK");
+			break;
+			
+		case 'm':	//Straight from the backing store
+			if (sscanf(pkt + 1, "%x,%x", &addr, &len) != 2 || len > GDB_PACKET_SIZE / 2){
+				sprintf(reply, "E01");
+				break;
+			}
+			for (i = 0; i < len; i++){
+				byte = mem_page(addr + i);
+				if (byte == NULL){
+					break;
+				}
+				sprintf(reply + 2 * i, "%02x", *byte);
+			}
+			if (i == 0 && len > 0){
+				sprintf(reply, "E14");
+			}
+			break;
+			
+		case 'M':
+			p = strchr(pkt, ':');
+			if (p == NULL || sscanf(pkt + 1, "%x,%x", &addr, &len) != 2 || strlen(p + 1) < 2 * len){
+				sprintf(reply, "E01");
+				break;
+			}
+			for (i = 0; i < len; i++){
+				byte = mem_page(addr + i);
+				if (byte == NULL){
+					break;
+				}
+				sscanf(p + 1 + 2 * i, "%2x", &value);
+				*byte = value;
+				MEM_DIRTY[(addr + i) >> MEM_PAGE_SHIFT] = 1;
+			}
+			sprintf(reply, i == len ? "OK" : "E14");
+			break;
+			
+		case 'c':
+		case 's':
+			if (pkt[1] != '\0'){
+				CURRENT_STATE.PC = strtoul(pkt + 1, NULL, 16);
+			}
+			gdb_resume(pkt[0] == 's', reply);
+			NEXT_STATE = CURRENT_STATE;
+			break;
+			
+		case 'Z':
+		case 'z':
+			if (sscanf(pkt + 1, "%d,%x,%x", &type, &addr, &len) != 3 || type > 4){
+				break;	//Empty reply, not supported
+			}
+			if (type < 2){
+				len = 4;	//kind is the instruction size
+			}
+			sprintf(reply, gdb_point(type, addr, len, pkt[0] == 'Z') ? "OK" : "E01");
+			break;
+			
+		case 'q':
+			if (strncmp(pkt, "qSupported", 10) == 0){
+				sprintf(reply, "PacketSize=%x;QStartNoAckMode+;swbreak+;hwbreak+", GDB_PACKET_SIZE - 1);
+			}
+			else if (strcmp(pkt, "qAttached") == 0){
+				sprintf(reply, "1");
+			}
+			break;
+			
+		case 'Q':
+			if (strcmp(pkt, "QStartNoAckMode") == 0){
+				sprintf(reply, "OK");	//Acks stop once this reply is acknowledged
+			}
+			break;
+			
+		case 'H':
+			sprintf(reply, "OK");	//One thread
+			break;
+			
+		case 'D':
+			gdb_send_packet("OK");
+			return FALSE;
+			
+		case 'k':
+			RUN_FLAG = FALSE;
+			return FALSE;
+	}
+	return TRUE;
+}
+
+/************************************************************/
+/* the cached image of a program file, NULL if not cached or the file changed */
+/************************************************************/
+Program_Image *image_find(char *file)
+{
+	struct stat st;
+	int i;
+	
+	if (NUM_IMAGES == 0 || stat(file, &st) != 0){
+		return NULL;
+	}
+	for (i = 0; i < NUM_IMAGES; i++){
+		if (strcmp(IMAGES[i].file, file) == 0){
+			if (IMAGES[i].mtime != st.st_mtime || IMAGES[i].size != st.st_size){
+				return NULL;
+			}
+			IMAGES[i].hits++;
+			return &IMAGES[i];
+		}
+	}
+	return NULL;
+}
+
+/************************************************************/
+/* parse a program file into the cache, NULL if it can't be read            */
+/************************************************************/
+Program_Image *image_load(char *file)
+{
+	Program_Image *image;
+	struct stat st;
+	FILE *fp;
+	uint32_t word, cap = 1024;
+	int i;
+	
+	if ((image = image_find(file)) != NULL){
+		return image;
+	}
+	if (strlen(file) >= PROG_PATH_SIZE || (fp = fopen(file, "r")) == NULL || fstat(fileno(fp), &st) != 0){
+		return NULL;
+	}
+	for (i = 0; i < NUM_IMAGES; i++){
+		if (strcmp(IMAGES[i].file, file) == 0){
+			break;	//Stale, parse it again in place
+		}
+	}
+	if (i == NUM_IMAGES){
+		if (NUM_IMAGES < IMAGE_CACHE_SIZE){
+			NUM_IMAGES++;
+		}else {
+			i = IMAGE_NEXT_EVICT;
+			IMAGE_NEXT_EVICT = (IMAGE_NEXT_EVICT + 1) % IMAGE_CACHE_SIZE;
+		}
+	}
+	image = &IMAGES[i];
+	free(image->words);
+	memset(image, 0, sizeof(Program_Image));
+	strcpy(image->file, file);
+	image->mtime = st.st_mtime;
+	image->size = st.st_size;
+	image->words = malloc(cap * sizeof(uint32_t));
+	while (fscanf(fp, "%x\n", &word) == 1){
+		if (image->num_words == cap){
+			cap *= 2;
+			image->words = realloc(image->words, cap * sizeof(uint32_t));
+		}
+		image->words[image->num_words++] = word;
+	}
+	fclose(fp);
+	return image;
+}
+
+/************************************************************/
+/* run jobs from a Unix socket until one asks for shutdown                  */
+/************************************************************/
+void server_run(char *path, int workers)
+{
+	struct sockaddr_un addr;
+	char line[SERVER_LINE_SIZE], file[PROG_PATH_SIZE];
+	struct timeval timeout = { SERVER_HEADER_SECONDS, 0 };
+	int fd, slot, busy, end;
+	uint32_t next_id = 1;
+	pid_t pid;
+	
+	if (CYCLE_COUNT != 0){
+		printf("the server forks jobs from a simulator before the first cycle, use reset\n");
+		return;
+	}
+	if (DIN_OUT.fp != NULL || BRANCH_OUT.fp != NULL){
+		printf("Jobs set their own din_out and branch_out, close these first\n");
+		return;
+	}
+	if (workers < 1 || workers > SERVER_MAX_WORKERS){
+		printf("Invalid number of workers %d, 1 to %d\n", workers, SERVER_MAX_WORKERS);
+		return;
+	}
+	if (strlen(path) >= sizeof(addr.sun_path)){
+		printf("Error: socket path %s is too long\n", path);
+		return;
+	}
+	SERVER_FD = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (SERVER_FD < 0){
+		printf("Error: Can't create socket\n");
+		return;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	unlink(path);	//A server that died leaves its socket behind
+	if (bind(SERVER_FD, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(SERVER_FD, SOMAXCONN) < 0){
+		printf("Error: Can't listen on %s\n", path);
+		close(SERVER_FD);
+		SERVER_FD = -1;
+		return;
+	}
+	console_flush();
+	signal(SIGPIPE, SIG_IGN);	//A client that hangs up must not stop the server
+	SERVER_JOBS_RUN = SERVER_JOBS_FAILED = 0;
+	memset(SERVER_JOBS, 0, sizeof(SERVER_JOBS));
+	printf("Serving jobs on %s, %d at a time\n", path, workers);
+	fflush(stdout);
+	
+	while (1){
+		for (busy = 0, slot = 0; slot < workers; slot++){
+			busy += SERVER_JOBS[slot].pid != 0;
+		}
+		server_reap(busy == workers);	//Full, wait for a job to finish
+		fd = accept(SERVER_FD, NULL, NULL);
+		if (fd < 0){
+			continue;
+		}
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		if (server_read_line(fd, line, sizeof(line)) <= 0){
+			close(fd);
+			continue;
+		}
+		if (strcmp(line, "shutdown") == 0){
+			send(fd, "Server shutting down\n", 21, MSG_NOSIGNAL);
+			close(fd);
+			break;
+		}
+		end = 0;
+		if (sscanf(line, "job %255s%n", file, &end) != 1 || (line[end] != '\0' && line[end] != ' ' && line[end] != '\t') ||
+			image_load(file) == NULL){	//A name longer than file would run its prefix
+			dprintf(fd, "Error: expected job <program> [<option>=<val> ...], got %s\n", line);
+			close(fd);
+			continue;
+		}
+		for (slot = 0; SERVER_JOBS[slot].pid != 0; slot++);
+		fflush(stdout);	//Or the job repeats what is buffered
+		pid = fork();
+		if (pid == 0){
+			server_job(fd, next_id, line, file);
+		}
+		close(fd);
+		if (pid < 0){
+			printf("Error: Can't fork job %u\n", next_id);
+			continue;
+		}
+		SERVER_JOBS[slot].pid = pid;
+		SERVER_JOBS[slot].id = next_id++;
+		strcpy(SERVER_JOBS[slot].file, file);
+		printf("job %u: %s (pid %d)\n", SERVER_JOBS[slot].id, file, (int)pid);
+		fflush(stdout);
+	}
+	close(SERVER_FD);
+	SERVER_FD = -1;
+	unlink(path);
+	signal(SIGPIPE, SIG_DFL);
+	for (busy = 1; busy; ){
+		server_reap(TRUE);
+		for (busy = 0, slot = 0; slot < SERVER_MAX_WORKERS; slot++){
+			busy += SERVER_JOBS[slot].pid != 0;
+		}
+	}
+	printf("Server stopped after %u jobs (%u failed), %d programs cached\n", SERVER_JOBS_RUN, SERVER_JOBS_FAILED, NUM_IMAGES);
+}
+
+/************************************************************/
+/* read one line byte by byte, so the rest stays for the job, -1 on error    */
+/************************************************************/
+int server_read_line(int fd, char *buf, int size)
+{
+	int len = 0;
+	char c;
+	
+	while (len < size - 1){
+		if (recv(fd, &c, 1, 0) != 1){
+			return -1;
+		}
+		if (c == '\n'){
+			break;
+		}
+		if (c != '\r'){
+			buf[len++] = c;
+		}
+	}
+	buf[len] = '\0';
+	return len;
+}
+
+/************************************************************/
+/* collect finished jobs, waiting for one if block is set                         */
+/************************************************************/
+void server_reap(int block)
+{
+	pid_t pid;
+	int status, slot;
+	
+	while ((pid = waitpid(-1, &status, block ? 0 : WNOHANG)) > 0){
+		for (slot = 0; slot < SERVER_MAX_WORKERS; slot++){
+			if (SERVER_JOBS[slot].pid == pid){
+				break;
+			}
+		}
+		if (slot == SERVER_MAX_WORKERS){
+			continue;
+		}
+		SERVER_JOBS_RUN++;
+		if (WIFEXITED(status) && WEXITSTATUS(status) == 0){
+			printf("job %u: done\n", SERVER_JOBS[slot].id);
+		}else {
+			SERVER_JOBS_FAILED++;
+			if (WIFSIGNALED(status)){
+				printf("job %u: killed by signal %d%s\n", SERVER_JOBS[slot].id, WTERMSIG(status),
+					WTERMSIG(status) == SIGALRM ? " (time limit)" : "");
+			}else {
+				printf("job %u: exit status %d\n", SERVER_JOBS[slot].id, WEXITSTATUS(status));
+			}
+		}
+		fflush(stdout);
+		SERVER_JOBS[slot].pid = 0;
+		block = FALSE;	//One is enough, take the rest as they come
+	}
+}
+
+/************************************************************/
+/* a job ran out of time: tell the client, the server sees the signal        */
+/************************************************************/
+void server_timeout(int sig)
+{
+	static const char msg[] = "\nJob stopped: time limit\n";
+	
+	if (write(STDOUT_FILENO, msg, sizeof(msg) - 1) < 0){
+		//Client is gone
+	}
+	signal(sig, SIG_DFL);
+	raise(sig);
+}
+
+/************************************************************/
+/* the forked job: load the program file the server checked, apply the options  */
+/* on its job line and run its commands                                                                 */
+/************************************************************/
+void server_job(int fd, uint32_t id, char *line, char *file)
+{
+	char *token, *value;
+	
+	close(SERVER_FD);
+	signal(SIGPIPE, SIG_DFL);	//A job whose client hangs up stops
+	STATS_PAGE = NULL;	//The server's page stays the server's, stats_shm=1 gives the job its own
+	__fpurge(stdin);	//Drop what the server read ahead of its own commands
+	dup2(fd, STDIN_FILENO);
+	dup2(fd, STDOUT_FILENO);
+	close(fd);
+	setvbuf(stdout, NULL, _IOLBF, 0);	//Results stream back as they are printed
+	printf("Job %u: %s\n", id, line);
+	
+	strtok(line, " \t");	//job
+	strtok(NULL, " \t");	//file
+	strcpy(prog_file, file);
+	reset();
+	while ((token = strtok(NULL, " \t")) != NULL){
+		value = strchr(token, '=');
+		if (value == NULL){
+			printf("Ignoring argument %s, expected <option>=<val>\n", token);
+			continue;
+		}
+		*value++ = '\0';
+		if (strcmp(token, "seconds") == 0){
+			signal(SIGALRM, server_timeout);
+			alarm(atoi(value));	//Wall clock limit
+			continue;
+		}
+		set_option(token, value);
+	}
+	while (1){
+		handle_command();	//quit or the end of the stream exits
+	}
+}
+
+/************************************************************/
+/* Initialize Memory                                                                                                    */ 
+/************************************************************/
+void initialize() { 
+	init_memory();
+	insert_bubble(&IF_ID);
+	insert_bubble(&ID_EX);
+	insert_bubble(&EX_MEM);
+	insert_bubble(&MEM_WB);
+	insert_bubble(&IF_ID_S1);
+	insert_bubble(&ID_EX_S1);
+	insert_bubble(&EX_MEM_S1);
+	insert_bubble(&MEM_WB_S1);
+	CURRENT_STATE.PC = MEM_TEXT_BEGIN;
+	NEXT_STATE = CURRENT_STATE;
+	ooo_reset();
+	fe_reset();
+	mt_reset();
+	mc_reset();
+	mmu_reset();
+	COMMIT_HASH = FP_SEED;
+	COMMIT_COUNT = 0;
+	lockstep_reset();
+	console_reset();
+	pipe_reset();
+	sd_reset(&SD_INST);
+	sd_reset(&SD_DATA);
+	FETCH_REFILL = IF_STAGES - 1;	//The first instruction fills the extra fetch stages
+	EXIT_DRAIN = 0;
+	RUN_FLAG = TRUE;
+}
+
+/************************************************************/
+/* Print the program loaded into memory (in MIPS assembly format)    */ 
+/************************************************************/
+void print_program(){
+	/*IMPLEMENT THIS*/
+	int i;
+	uint32_t addr;
+	
+	for(i=0; i<PROGRAM_SIZE; i++){
+		addr = MEM_TEXT_BEGIN + (i*4);
+		printf("[0x%x]\t", addr);
+		print_instruction(addr);
+	}
+}
+
+/************************************************************/
+/* Print the instruction at given memory address (in MIPS assembly format)    */
+/************************************************************/
+void print_instruction(uint32_t addr){
+	uint32_t instruction, opcode, function, rs, rt, rd, sa, immediate, target;
+	
+	instruction = mem_read_32(addr);
+	
+	opcode = (instruction & 0xFC000000) >> 26;
+	function = instruction & 0x0000003F;
+	rs = (instruction & 0x03E00000) >> 21;
+	rt = (instruction & 0x001F0000) >> 16;
+	rd = (instruction & 0x0000F800) >> 11;
+	sa = (instruction & 0x000007C0) >> 6;
+	immediate = instruction & 0x0000FFFF;
+	target = instruction & 0x03FFFFFF;
+	
+	if(opcode == 0x00){
+		/*R format instructions here*/
+		
+		switch(function){
+			case 0x00:
+				printf("SLL $r%u, $r%u, 0x%x\n", rd, rt, sa);
+				break;
+			case 0x02:
+				printf("SRL $r%u, $r%u, 0x%x\n", rd, rt, sa);
+				break;
+			case 0x03:
+				printf("SRA $r%u, $r%u, 0x%x\n", rd, rt, sa);
+				break;
+			case 0x08:
+				printf("JR $r%u\n", rs);
+				break;
+			case 0x09:
+				if(rd == 31){
+					printf("JALR $r%u\n", rs);
+				}
+				else{
+					printf("JALR $r%u, $r%u\n", rd, rs);
+				}
+				break;
+			case 0x0C:
+				printf("SYSCALL\n");
+				break;
+			case 0x10:
+				printf("MFHI $r%u\n", rd);
+				break;
+			case 0x11:
+				printf("MTHI $r%u\n", rs);
+				break;
+			case 0x12:
+				printf("MFLO $r%u\n", rd);
+				break;
+			case 0x13:
+				printf("MTLO $r%u\n", rs);
+				break;
+			case 0x18:
+				printf("MULT $r%u, $r%u\n", rs, rt);
+				break;
+			case 0x19:
+				printf("MULTU $r%u, $r%u\n", rs, rt);
+				break;
+			case 0x1A:
+				printf("DIV $r%u, $r%u\n", rs, rt);
+				break;
+			case 0x1B:
+				printf("DIVU $r%u, $r%u\n", rs, rt);
+				break;
+			case 0x20:
+				printf("ADD $r%u, $r%u, $r%u\n", rd, rs, rt);
 				break;
 			case 0x21:
 				printf("ADDU $r%u, $r%u, $r%u\n", rd, rs, rt);
@@ -1169,121 +6912,1060 @@ void print_instruction(uint32_t addr){
 		}
 	}
 	else{
-		switch(opcode){
-			case 0x01:
-				if(rt == 0){
-					printf("BLTZ $r%u, 0x%x\n", rs, immediate<<2);
-				}
-				else if(rt == 1){
-					printf("BGEZ $r%u, 0x%x\n", rs, immediate<<2);
-				}
-				break;
-			case 0x02:
-				printf("J 0x%x\n", (addr & 0xF0000000) | (target<<2));
-				break;
-			case 0x03:
-				printf("JAL 0x%x\n", (addr & 0xF0000000) | (target<<2));
-				break;
-			case 0x04:
-				printf("BEQ $r%u, $r%u, 0x%x\n", rs, rt, immediate<<2);
-				break;
-			case 0x05:
-				printf("BNE $r%u, $r%u, 0x%x\n", rs, rt, immediate<<2);
-				break;
-			case 0x06:
-				printf("BLEZ $r%u, 0x%x\n", rs, immediate<<2);
-				break;
-			case 0x07:
-				printf("BGTZ $r%u, 0x%x\n", rs, immediate<<2);
-				break;
-			case 0x08:
-				printf("ADDI $r%u, $r%u, 0x%x\n", rt, rs, immediate);
-				break;
-			case 0x09:
-				printf("ADDIU $r%u, $r%u, 0x%x\n", rt, rs, immediate);
-				break;
-			case 0x0A:
-				printf("SLTI $r%u, $r%u, 0x%x\n", rt, rs, immediate);
-				break;
-			case 0x0C:
-				printf("ANDI $r%u, $r%u, 0x%x\n", rt, rs, immediate);
-				break;
-			case 0x0D:
-				printf("ORI $r%u, $r%u, 0x%x\n", rt, rs, immediate);
-				break;
-			case 0x0E:
-				printf("XORI $r%u, $r%u, 0x%x\n", rt, rs, immediate);
-				break;
-			case 0x0F:
-				printf("LUI $r%u, 0x%x\n", rt, immediate);
-				break;
-			case 0x20:
-				printf("LB $r%u, 0x%x($r%u)\n", rt, immediate, rs);
-				break;
-			case 0x21:
-				printf("LH $r%u, 0x%x($r%u)\n", rt, immediate, rs);
-				break;
-			case 0x23:
-				printf("LW $r%u, 0x%x($r%u)\n", rt, immediate, rs);
-				break;
-			case 0x28:
-				printf("SB $r%u, 0x%x($r%u)\n", rt, immediate, rs);
-				break;
-			case 0x29:
-				printf("SH $r%u, 0x%x($r%u)\n", rt, immediate, rs);
-				break;
-			case 0x2B:
-				printf("SW $r%u, 0x%x($r%u)\n", rt, immediate, rs);
-				break;
-			default:
-				printf("Instruction is not implemented!\n");
-				break;
+		switch(opcode){
+			case 0x01:
+				if(rt == 0){
+					printf("BLTZ $r%u, 0x%x\n", rs, immediate<<2);
+				}
+				else if(rt == 1){
+					printf("BGEZ $r%u, 0x%x\n", rs, immediate<<2);
+				}
+				break;
+			case 0x02:
+				printf("J 0x%x\n", (addr & 0xF0000000) | (target<<2));
+				break;
+			case 0x03:
+				printf("JAL 0x%x\n", (addr & 0xF0000000) | (target<<2));
+				break;
+			case 0x04:
+				printf("BEQ $r%u, $r%u, 0x%x\n", rs, rt, immediate<<2);
+				break;
+			case 0x05:
+				printf("BNE $r%u, $r%u, 0x%x\n", rs, rt, immediate<<2);
+				break;
+			case 0x06:
+				printf("BLEZ $r%u, 0x%x\n", rs, immediate<<2);
+				break;
+			case 0x07:
+				printf("BGTZ $r%u, 0x%x\n", rs, immediate<<2);
+				break;
+			case 0x08:
+				printf("ADDI $r%u, $r%u, 0x%x\n", rt, rs, immediate);
+				break;
+			case 0x09:
+				printf("ADDIU $r%u, $r%u, 0x%x\n", rt, rs, immediate);
+				break;
+			case 0x0A:
+				printf("SLTI $r%u, $r%u, 0x%x\n", rt, rs, immediate);
+				break;
+			case 0x0C:
+				printf("ANDI $r%u, $r%u, 0x%x\n", rt, rs, immediate);
+				break;
+			case 0x0D:
+				printf("ORI $r%u, $r%u, 0x%x\n", rt, rs, immediate);
+				break;
+			case 0x0E:
+				printf("XORI $r%u, $r%u, 0x%x\n", rt, rs, immediate);
+				break;
+			case 0x0F:
+				printf("LUI $r%u, 0x%x\n", rt, immediate);
+				break;
+			case 0x20:
+				printf("LB $r%u, 0x%x($r%u)\n", rt, immediate, rs);
+				break;
+			case 0x21:
+				printf("LH $r%u, 0x%x($r%u)\n", rt, immediate, rs);
+				break;
+			case 0x23:
+				printf("LW $r%u, 0x%x($r%u)\n", rt, immediate, rs);
+				break;
+			case 0x28:
+				printf("SB $r%u, 0x%x($r%u)\n", rt, immediate, rs);
+				break;
+			case 0x29:
+				printf("SH $r%u, 0x%x($r%u)\n", rt, immediate, rs);
+				break;
+			case 0x2B:
+				printf("SW $r%u, 0x%x($r%u)\n", rt, immediate, rs);
+				break;
+			case 0x10:
+				if (rs == 0x00){
+					printf("MFC0 $r%u, $%u\n", rt, rd);
+				}
+				else if (rs == 0x04){
+					printf("MTC0 $r%u, $%u\n", rt, rd);
+				}
+				else if (function == 0x06){
+					printf("TLBWR\n");
+				}
+				else if (function == 0x18){
+					printf("ERET\n");
+				}
+				break;
+			case 0x30:
+				printf("LL $r%u, 0x%x($r%u)\n", rt, immediate, rs);
+				break;
+			case 0x38:
+				printf("SC $r%u, 0x%x($r%u)\n", rt, immediate, rs);
+				break;
+			default:
+				printf("Instruction is not implemented!\n");
+				break;
+		}
+	}
+}
+
+/************************************************************/
+/* Print the current pipeline                                                                                    */ 
+/************************************************************/
+void show_pipeline(){
+	/*IMPLEMENT THIS*/
+	printf("\nCurrent PC: %X", CURRENT_STATE.PC);
+	printf("\nIF/ID.IR:  %X  instruction:   ", IF_ID.IR);
+	print_instruction(CURRENT_STATE.PC);
+	printf("\nIF/ID.PC: %X\n\n", IF_ID.PC );
+	
+	printf("\nID/EX.IR: %X    instruction:   ", ID_EX.IR);
+	print_instruction(CURRENT_STATE.PC);
+	printf("\nID/EX.IR:  %X", ID_EX.IR);
+	printf("\nID/EX.A:  %X",ID_EX.A);
+	printf("\nID/EX.B:  %X\n\n",ID_EX.B);
+	
+	printf("\nEX/MEM.IR:  %X", EX_MEM.IR);
+	printf("\nEX/MEM.A:  %X", EX_MEM.A);
+	printf("\nEX/MEM.B:  %X",EX_MEM.B);
+	printf("\nEX/MEM.ALUOutput:  %X\n\n",EX_MEM.ALUOutput);
+	
+	printf("\nMEM/WB.IR:  %X",MEM_WB.IR);
+	printf("\nMEM/WB.ALUOutput:  %X",MEM_WB.ALUOutput);
+	printf("\nMEM/WB.LMD:  %X\n\n",MEM_WB.LMD );
+}
+
+/************************************************************/
+/* Numeric simulator options                                                                                   */ 
+/************************************************************/
+typedef struct Sim_Option_Struct{
+	char *name;
+	int *value;
+	int min, max;
+} Sim_Option;
+
+Sim_Option SIM_OPTIONS[] = {
+	{ "issue", &ISSUE_WIDTH, 1, MAX_ISSUE_WIDTH },
+	{ "rob", &OOO_ROB_SIZE, 1, OOO_MAX_ROB },
+	{ "rs", &OOO_RS_SIZE, 1, OOO_MAX_RS },
+	{ "lsq", &OOO_LSQ_SIZE, 1, OOO_MAX_LSQ },
+	{ "ooo_width", &OOO_WIDTH, 1, OOO_MAX_WIDTH },
+	{ "muldiv_lat", &OOO_MULDIV_LATENCY, 1, 100 },
+	{ "mem_lat", &OOO_MEM_LATENCY, 1, 1000 },
+	{ "threads", &NUM_THREADS, 1, MAX_THREADS },
+	{ "cores", &MC_CORES, 1, MAX_CORES },
+	{ "quantum", &MC_QUANTUM, 1, 1000000 },
+	{ "dcache", &DCACHE_KB, 0, 2048 },
+	{ "dcache_assoc", &DCACHE_ASSOC, 1, 16 },
+	{ "dcache_line", &DCACHE_LINE, 4, 256 },
+	{ "miss_lat", &DCACHE_MISS_LATENCY, 1, 1000 },
+	{ "itlb", &ITLB_ENTRIES, 1, TLB_MAX_ENTRIES },
+	{ "dtlb", &DTLB_ENTRIES, 1, TLB_MAX_ENTRIES },
+	{ "tlb_assoc", &TLB_ASSOC, 1, TLB_MAX_ENTRIES },
+	{ "tlb_lat", &TLB_MISS_LATENCY, 1, 1000 },
+	{ "host_pipe", &HOST_PIPE, 0, 1 },
+	{ "store_buffer", &SB_ENTRIES, 0, SB_MAX_ENTRIES },
+	{ "prefetch_degree", &PF_DEGREE, 1, PF_MAX_DEGREE },
+	{ "prefetch_distance", &PF_DISTANCE, 1, 64 },
+	{ "fetch_queue", &IQ_ENTRIES, 0, IQ_MAX_ENTRIES },
+	{ "fetch_width", &FETCH_WIDTH, 1, MAX_FETCH_WIDTH },
+	{ "icache", &ICACHE_KB, 0, 2048 },
+	{ "fingerprint", &FINGERPRINT, 0, 1 },
+	{ "lockstep", &LOCKSTEP, 0, 1 },
+	{ "if_stages", &IF_STAGES, 1, MAX_STAGE_DEPTH },
+	{ "ex_stages", &EX_STAGES, 1, MAX_STAGE_DEPTH },
+	{ "mem_stages", &MEM_STAGES, 1, MAX_STAGE_DEPTH },
+	{ "stack_dist", &STACK_DIST, 0, 1 },
+	{ "sd_window", &SD_WINDOW, 1, 1000000000 },
+	{ NULL, NULL, 0, 0 }
+};
+
+/************************************************************/
+/* Set a simulator option                                                                                           */ 
+/************************************************************/
+void set_option(char *name, char *value){
+	int val = strtol(value, NULL, 0);
+	int i, old;
+	
+	if (strcmp(name, "verbose") == 0){
+		VERBOSE = val;	//Only affects output, so it may change mid-run
+		printf("verbose set to %d\n", val);
+		return;
+	}
+	
+	if (strcmp(name, "stats_shm") == 0){
+		if (val){
+			stats_open();
+		}
+		else{
+			stats_close();
+		}
+		return;
+	}
+	
+	if (strcmp(name, "batch_simd") == 0){
+		if (strcmp(value, "auto") == 0){
+			BATCH_SIMD = BATCH_AUTO;
+		}
+		else if (strcmp(value, "scalar") == 0){
+			BATCH_SIMD = BATCH_SCALAR;
+		}
+		else if (strcmp(value, "sse2") == 0){
+			BATCH_SIMD = BATCH_SSE2;
+		}
+		else if (strcmp(value, "avx2") == 0){
+			BATCH_SIMD = BATCH_AVX2;
+		}
+		else{
+			printf("Unknown batch kernel: %s (auto, scalar, sse2 or avx2)\n", value);
+			return;
+		}
+		printf("Batch kernel set to %s\n", value);
+		return;
+	}
+	
+	if (strcmp(name, "stats_every") == 0){
+		if (val < 1){
+			printf("stats_every must be at least 1\n");
+			return;
+		}
+		STATS_EVERY = val;
+		printf("stats_every set to %d\n", val);
+		return;
+	}
+	
+	if (strcmp(name, "skip") == 0){
+		SKIP_IDLE = val != 0;
+		printf("Cycle skipping %s\n", SKIP_IDLE ? "on" : "off");
+		return;
+	}
+	
+	if (strcmp(name, "console_out") == 0){
+		console_flush();
+		if (CONSOLE_OUT_FP != NULL){
+			fclose(CONSOLE_OUT_FP);
+			CONSOLE_OUT_FP = NULL;
+		}
+		if (strcmp(value, "-") != 0){
+			CONSOLE_OUT_FP = fopen(value, "w");
+			if (CONSOLE_OUT_FP == NULL){
+				printf("Error: Can't open console output %s\n", value);
+				return;
+			}
+		}
+		printf("Console output set to %s\n", value);
+		return;
+	}
+	
+	if (strcmp(name, "din_out") == 0 || strcmp(name, "branch_out") == 0){
+		Export_Stream *s = name[0] == 'd' ? &DIN_OUT : &BRANCH_OUT;
+		uint32_t magic = BRANCH_MAGIC;
+		
+		if (strcmp(value, "-") != 0 && (CORE_MODEL != CORE_PIPELINE || MC_CORES > 1 || HOST_PIPE)){
+			printf("Trace export follows IF, EX and MEM of the single-core pipeline\n");
+			return;
+		}
+		if (!export_open(s, value)){
+			return;
+		}
+		if (s == &BRANCH_OUT && s->fp != NULL){
+			export_write(s, &magic, sizeof(magic));
+			s->records = 0;
+		}
+		printf("%s set to %s\n", name, value);
+		return;
+	}
+	
+	if (strcmp(name, "sd_out") == 0){
+		if (SD_OUT_FP != NULL && SD_OUT_FP != stdout){
+			fclose(SD_OUT_FP);
+		}
+		SD_OUT_FP = stdout;
+		if (strcmp(value, "-") != 0){
+			SD_OUT_FP = fopen(value, "w");
+			if (SD_OUT_FP == NULL){
+				printf("Error: Can't open stack distance output %s\n", value);
+				return;
+			}
+		}
+		printf("Stack distance output set to %s\n", value);
+		return;
+	}
+	
+	if (strcmp(name, "cycle_limit") == 0){
+		CYCLE_LIMIT = strtoul(value, NULL, 0);
+		printf("cycle_limit set to %u\n", CYCLE_LIMIT);
+		return;
+	}
+	
+	if (CYCLE_COUNT != 0){
+		printf("Options can only be changed before the first cycle, use reset\n");
+		return;
+	}
+	
+	if (strcmp(name, "core") == 0){
+		old = CORE_MODEL;
+		if (strcmp(value, "pipeline") == 0){
+			CORE_MODEL = CORE_PIPELINE;
+		}
+		else if (strcmp(value, "ooo") == 0){
+			CORE_MODEL = CORE_OOO;
+		}
+		else if (strcmp(value, "trace") == 0){
+			CORE_MODEL = CORE_TRACE;
+		}
+		else if (strcmp(value, "interval") == 0){
+			CORE_MODEL = CORE_INTERVAL;
+		}
+		else{
+			printf("Unknown core: %s (pipeline, ooo, trace or interval)\n", value);
+			return;
+		}
+		if (!check_config()){
+			CORE_MODEL = old;
+			return;
+		}
+		ooo_reset();
+		trace_reset();
+		printf("Core model set to %s\n", value);
+		return;
+	}
+	
+	if (strcmp(name, "prefetch") == 0){
+		old = PF_MODE;
+		if (strcmp(value, "none") == 0){
+			PF_MODE = PF_NONE;
+		}
+		else if (strcmp(value, "next") == 0){
+			PF_MODE = PF_NEXT_LINE;
+		}
+		else if (strcmp(value, "stride") == 0){
+			PF_MODE = PF_STRIDE;
+		}
+		else if (strcmp(value, "stream") == 0){
+			PF_MODE = PF_STREAM;
+		}
+		else{
+			printf("Unknown prefetcher: %s (none, next, stride or stream)\n", value);
+			return;
+		}
+		if (!check_config()){
+			PF_MODE = old;
+			return;
+		}
+		pf_reset();
+		printf("Prefetcher set to %s\n", value);
+		return;
+	}
+	
+	if (strcmp(name, "commit_log") == 0){
+		if (COMMIT_LOG_FP != NULL){
+			fclose(COMMIT_LOG_FP);
+			COMMIT_LOG_FP = NULL;
+		}
+		if (strcmp(value, "-") != 0){
+			COMMIT_LOG_FP = fopen(value, "w");
+			if (COMMIT_LOG_FP == NULL){
+				printf("Error: Can't open commit log %s\n", value);
+				return;
+			}
+			FINGERPRINT = TRUE;
+		}
+		printf("Commit log set to %s\n", value);
+		return;
+	}
+	
+	if (strcmp(name, "console_in") == 0){
+		if (CONSOLE_IN_FP != NULL){
+			fclose(CONSOLE_IN_FP);
+			CONSOLE_IN_FP = NULL;
+		}
+		if (strcmp(value, "-") != 0){
+			CONSOLE_IN_FP = fopen(value, "r");
+			if (CONSOLE_IN_FP == NULL){
+				printf("Error: Can't open console input %s\n", value);
+			}
+		}
+		CONSOLE_RX_NEXT = CONSOLE_IN_FP != NULL ? getc(CONSOLE_IN_FP) : -1;
+		printf("Console input set to %s\n", value);
+		return;
+	}
+	
+	if ((strcmp(name, "trace_in") == 0 || strcmp(name, "trace_out") == 0) && strlen(value) >= PROG_PATH_SIZE){
+		printf("Error: %s path is longer than %d characters, %s unchanged\n", name, PROG_PATH_SIZE - 1, name);
+		return;
+	}
+	
+	if (strcmp(name, "trace_in") == 0){
+		strcpy(TRACE_IN, value);
+		printf("Trace input set to %s\n", value);
+		return;
+	}
+	
+	if (strcmp(name, "trace_out") == 0){
+		strcpy(TRACE_OUT, strcmp(value, "-") == 0 ? "" : value);
+		printf("Trace output set to %s\n", value);
+		return;
+	}
+	
+	if (strcmp(name, "fetch") == 0){
+		if (strcmp(value, "rr") == 0){
+			FETCH_POLICY = FETCH_ROUND_ROBIN;
+		}
+		else if (strcmp(value, "stall") == 0){
+			FETCH_POLICY = FETCH_SWITCH_ON_STALL;
+		}
+		else if (strcmp(value, "icount") == 0){
+			FETCH_POLICY = FETCH_ICOUNT;
+		}
+		else{
+			printf("Unknown fetch policy: %s (rr, stall or icount)\n", value);
+			return;
+		}
+		printf("Fetch policy set to %s\n", value);
+		return;
+	}
+	
+	if (strcmp(name, "mmu") == 0){
+		old = MMU_MODE;
+		if (strcmp(value, "off") == 0){
+			MMU_MODE = MMU_OFF;
+		}
+		else if (strcmp(value, "hw") == 0){
+			MMU_MODE = MMU_HW_WALK;
+		}
+		else if (strcmp(value, "sw") == 0){
+			MMU_MODE = MMU_SW_WALK;
+		}
+		else{
+			printf("Unknown MMU mode: %s (off, hw or sw)\n", value);
+			return;
+		}
+		if (!check_config()){
+			MMU_MODE = old;
+			return;
+		}
+		mmu_reset();
+		printf("MMU set to %s\n", value);
+		return;
+	}
+	
+	for (i = 0; SIM_OPTIONS[i].name != NULL; i++){
+		if (strcmp(name, SIM_OPTIONS[i].name) == 0){
+			if (val < SIM_OPTIONS[i].min || val > SIM_OPTIONS[i].max){
+				printf("%s must be between %d and %d\n", name, SIM_OPTIONS[i].min, SIM_OPTIONS[i].max);
+				return;
+			}
+			old = *SIM_OPTIONS[i].value;
+			*SIM_OPTIONS[i].value = val;
+			if (!check_config()){
+				*SIM_OPTIONS[i].value = old;
+				return;
+			}
+			ooo_reset();
+			if (SIM_OPTIONS[i].value == &NUM_THREADS){
+				mt_reset();
+			}
+			mc_reset();
+			mmu_reset();
+			printf("%s set to %d\n", name, val);
+			return;
+		}
+	}
+	printf("Unknown option: %s\n", name);
+}
+
+/************************************************************/
+/* Reject option combinations the models do not support                                     */ 
+/************************************************************/
+int check_config(){
+	if (NUM_THREADS > 1 && (ISSUE_WIDTH > 1 || CORE_MODEL != CORE_PIPELINE)){
+		printf("Multithreading requires the single-issue pipeline core\n");
+		return FALSE;
+	}
+	if (MC_CORES > 1 && (ISSUE_WIDTH > 1 || NUM_THREADS > 1 || CORE_MODEL != CORE_PIPELINE)){
+		printf("Multicore requires the single-issue, single-thread pipeline core\n");
+		return FALSE;
+	}
+	if ((CORE_MODEL == CORE_TRACE || CORE_MODEL == CORE_INTERVAL) && (ISSUE_WIDTH > 1 || NUM_THREADS > 1 || MC_CORES > 1)){
+		printf("Trace and interval timing model the single-issue, single-thread, single-core pipeline\n");
+		return FALSE;
+	}
+	if (SB_ENTRIES > 0 && (CORE_MODEL != CORE_PIPELINE || MC_CORES > 1)){
+		printf("The store buffer is modelled for the single-core pipeline\n");
+		return FALSE;
+	}
+	if (PF_MODE != PF_NONE && (CORE_MODEL != CORE_PIPELINE || MC_CORES > 1 || DCACHE_KB == 0)){
+		printf("Prefetching needs the data cache of the single-core pipeline\n");
+		return FALSE;
+	}
+	if (FINGERPRINT && (MC_CORES > 1 || HOST_PIPE || CORE_MODEL == CORE_TRACE || CORE_MODEL == CORE_INTERVAL)){
+		printf("Fingerprints need one core and a model that commits values (pipeline or ooo)\n");
+		return FALSE;
+	}
+	if (PIPE_DEEP && (CORE_MODEL == CORE_OOO || ISSUE_WIDTH > 1 || NUM_THREADS > 1 || MC_CORES > 1 || HOST_PIPE)){
+		printf("Deeper stage groups are modelled for the single-issue, single-thread, single-core pipeline and the trace and interval cores\n");
+		return FALSE;
+	}
+	if (LOCKSTEP && (MC_CORES > 1 || NUM_THREADS > 1 || HOST_PIPE || MMU_MODE != MMU_OFF ||
+		CORE_MODEL == CORE_TRACE || CORE_MODEL == CORE_INTERVAL)){
+		printf("Lockstep checks the single-thread, single-core pipeline or ooo core without the MMU\n");
+		return FALSE;
+	}
+	if (IQ_ENTRIES > 0){
+		if (CORE_MODEL != CORE_PIPELINE || ISSUE_WIDTH > 1 || NUM_THREADS > 1 || MC_CORES > 1 || MMU_MODE != MMU_OFF){
+			printf("The fetch queue feeds the single-issue, single-thread, single-core pipeline without the MMU\n");
+			return FALSE;
+		}
+		if (ICACHE_KB > 0 && ((DCACHE_LINE & (DCACHE_LINE - 1)) != 0 || ICACHE_KB * 1024 / DCACHE_LINE > CACHE_MAX_LINES)){
+			printf("Instruction cache needs a power of two line size and at most %d lines\n", CACHE_MAX_LINES);
+			return FALSE;
+		}
+	}
+	else if (ICACHE_KB > 0){
+		printf("The instruction cache is only modelled with the fetch queue\n");
+		return FALSE;
+	}
+	if (HOST_PIPE && (CORE_MODEL != CORE_PIPELINE || ISSUE_WIDTH > 1 || NUM_THREADS > 1 || MC_CORES > 1 ||
+		MMU_MODE != MMU_OFF || SB_ENTRIES > 0 || PF_MODE != PF_NONE || IQ_ENTRIES > 0)){
+		printf("host_pipe splits the plain single-issue, single-thread, single-core pipeline\n");
+		return FALSE;
+	}
+	if (MMU_MODE != MMU_OFF){
+		if (CORE_MODEL != CORE_PIPELINE || ISSUE_WIDTH > 1 || NUM_THREADS > 1 || MC_CORES > 1){
+			printf("The MMU requires the single-issue, single-thread, single-core pipeline\n");
+			return FALSE;
+		}
+		if (ITLB_ENTRIES % TLB_ASSOC != 0 || DTLB_ENTRIES % TLB_ASSOC != 0){
+			printf("TLB entries must be a multiple of tlb_assoc\n");
+			return FALSE;
+		}
+	}
+	if ((DIN_OUT.fp != NULL || BRANCH_OUT.fp != NULL) && (CORE_MODEL != CORE_PIPELINE || MC_CORES > 1 || HOST_PIPE)){
+		printf("Trace export follows IF, EX and MEM of the single-core pipeline\n");
+		return FALSE;
+	}
+	if (STACK_DIST && (CORE_MODEL != CORE_PIPELINE || MC_CORES > 1 || HOST_PIPE)){
+		printf("The stack distance profile follows IF and MEM of the single-core pipeline\n");
+		return FALSE;
+	}
+	if (DCACHE_KB > 0){
+		if (CORE_MODEL == CORE_OOO){
+			printf("The data cache is only modelled for the pipeline core, the ooo core uses mem_lat\n");
+			return FALSE;
+		}
+		if ((DCACHE_LINE & (DCACHE_LINE - 1)) != 0 || DCACHE_KB * 1024 / DCACHE_LINE > CACHE_MAX_LINES ||
+			DCACHE_KB * 1024 / DCACHE_LINE < DCACHE_ASSOC){
+			printf("Data cache needs a power of two line size and between assoc and %d lines\n", CACHE_MAX_LINES);
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/************************************************************/
+/* Print performance counters                                                                                */ 
+/************************************************************/
+void print_stats(){
+	printf("-------------------------------------\n");
+	printf("Performance Counters\n");
+	printf("-------------------------------------\n");
+	printf("# Cycles Executed\t: %u\n", CYCLE_COUNT);
+	printf("# Instructions Executed\t: %u\n", INSTRUCTION_COUNT);
+	printf("IPC\t\t\t: %.3f\n", CYCLE_COUNT ? (double)INSTRUCTION_COUNT / CYCLE_COUNT : 0.0);
+	if (CORE_MODEL != CORE_OOO){
+		printf("# Hazard Stall Cycles\t: %u\n", HAZARD_STALL_CYCLES);
+		printf("# Memory Stall Cycles\t: %u\n", MEM_STALL_CYCLES);
+		printf("# Branch Flush Cycles\t: %u\n", FLUSH_CYCLES);
+		if (SKIPPED_CYCLES > 0){
+			printf("# Skipped Cycles\t: %u\n", SKIPPED_CYCLES);
+		}
+		if (INSTRUCTION_COUNT > 0){
+			printf("CPI Breakdown\t\t: %.3f base + %.3f hazard + %.3f memory + %.3f flush\n",
+				(double)(CYCLE_COUNT - HAZARD_STALL_CYCLES - MEM_STALL_CYCLES - FLUSH_CYCLES) / INSTRUCTION_COUNT,
+				(double)HAZARD_STALL_CYCLES / INSTRUCTION_COUNT, (double)MEM_STALL_CYCLES / INSTRUCTION_COUNT,
+				(double)FLUSH_CYCLES / INSTRUCTION_COUNT);
+		}
+	}
+	if (PIPE_DEEP){
+		print_pipe_shape();
+	}
+	if (ISSUE_WIDTH == 2){
+		printf("# Issue Cycles\t\t: %u\n", ISSUE_CYCLES);
+		printf("# Dual Issue Cycles\t: %u\n", DUAL_ISSUE_CYCLES);
+		printf("Dual Issue Rate\t\t: %.3f\n", ISSUE_CYCLES ? (double)DUAL_ISSUE_CYCLES / ISSUE_CYCLES : 0.0);
+	}
+	if (CORE_MODEL == CORE_OOO){
+		print_ooo_stats();
+	}
+	if (NUM_THREADS > 1){
+		print_mt_stats();
+	}
+	if (DCACHE_KB > 0 && MC_CORES == 1){
+		print_cache_stats();
+	}
+	if (SB_ENTRIES > 0){
+		print_sb_stats();
+	}
+	if (PF_MODE != PF_NONE){
+		print_pf_stats();
+	}
+	if (IQ_ENTRIES > 0){
+		print_fe_stats();
+	}
+	if (STACK_DIST){
+		print_sd_stats();
+	}
+	if (DIN_OUT.fp != NULL || BRANCH_OUT.fp != NULL){
+		print_export_stats();
+	}
+	if (FINGERPRINT){
+		print_fingerprint();
+	}
+	if (LOCKSTEP){
+		printf("Lockstep Commits Checked\t: %u%s\n", LS_CHECKED, LS_FAILED ? ", stopped at a mismatch" : "");
+	}
+	if (ROI_REGIONS > 0 && MC_CORES == 1){
+		print_roi_stats();
+	}
+	if (CONSOLE_TX_BYTES > 0){
+		printf("# Console Bytes Sent\t: %u\n", CONSOLE_TX_BYTES);
+	}
+	if (MC_CORES > 1){
+		print_mc_stats();
+	}
+	if (MMU_MODE != MMU_OFF){
+		print_mmu_stats();
+	}
+	print_host_stats();
+	printf("-------------------------------------\n");
+}
+
+/************************************************************/
+/* Monotonic host clock in seconds                                                                              */ 
+/************************************************************/
+double host_time(){
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/************************************************************/
+/* Print host throughput: simulated work per wall second and peak memory     */ 
+/************************************************************/
+void print_host_stats(){
+	struct rusage usage;
+	double instructions = INSTRUCTION_COUNT;
+	double cycles = CYCLE_COUNT;
+	int c;
+	
+	if (MC_CORES > 1){
+		instructions = cycles = 0;
+		for (c = 0; c < MC_CORES; c++){	//All cores together
+			instructions += CORES[c].instructions;
+			cycles += CORES[c].cycles;
+		}
+	}
+	getrusage(RUSAGE_SELF, &usage);
+	printf("Host Seconds\t\t: %.3f\n", HOST_SECONDS);
+	printf("Sim Instructions/sec\t: %.0f\n", HOST_SECONDS > 0 ? instructions / HOST_SECONDS : 0.0);
+	printf("Sim Cycles/sec\t\t: %.0f\n", HOST_SECONDS > 0 ? cycles / HOST_SECONDS : 0.0);
+	printf("Peak RSS (KB)\t\t: %ld\n", usage.ru_maxrss);
+}
+
+/************************************************************/
+/* Host tick counter of the stage profiler                                                          */ 
+/************************************************************/
+uint64_t prof_ticks(){
+#if defined(STAGE_PROF) && (defined(__x86_64__) || defined(__i386__))
+	return __rdtsc();	//TSC ticks
+#else
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;	//ns
+#endif
+}
+
+/************************************************************/
+/* Add one timed sample to a profiler slot                                                          */ 
+/************************************************************/
+void prof_record(int slot, uint64_t ticks){
+	Prof_Slot *p = &PROF[slot];
+	int b = 0;
+	
+	if (p->samples == 0 || ticks < p->min){
+		p->min = ticks;
+	}
+	if (ticks > p->max){
+		p->max = ticks;
+	}
+	p->samples++;
+	p->ticks += ticks;
+	while (b < PROF_BUCKETS - 1 && (ticks >> (b + 1)) != 0){
+		b++;
+	}
+	p->hist[b]++;
+}
+
+/************************************************************/
+/* Print host time per stage, memory access and loader phase           */ 
+/************************************************************/
+void print_profile(){
+#ifdef STAGE_PROF
+	char *names[] = { "WB", "MEM", "EX", "ID", "IF", "mem_read_32", "mem_write_32", "initialize", "load_program" };
+	uint64_t stage_ticks = 0;
+	int i, b;
+	
+	for (i = PROF_WB; i <= PROF_IF; i++){
+		stage_ticks += PROF[i].ticks;
+	}
+	printf("-------------------------------------\n");
+#if defined(__x86_64__) || defined(__i386__)
+	printf("Host Profile in TSC ticks (1 in %d cycles sampled)\n", PROF_SAMPLE_PERIOD);
+#else
+	printf("Host Profile in ns (1 in %d cycles sampled)\n", PROF_SAMPLE_PERIOD);
+#endif
+	printf("-------------------------------------\n");
+	printf("[Slot]\t\t[Samples]\t[Mean]\t[Min]\t[Max]\t[Stage %%]\n");
+	for (i = 0; i < PROF_SLOTS; i++){
+		Prof_Slot *p = &PROF[i];
+		
+		if (p->samples == 0){
+			continue;
+		}
+		printf("%-12s\t%llu\t\t%.1f\t%llu\t%llu\t", names[i], (unsigned long long)p->samples,
+			(double)p->ticks / p->samples, (unsigned long long)p->min, (unsigned long long)p->max);
+		if (i <= PROF_IF && stage_ticks > 0){
+			printf("%.1f\n", 100.0 * p->ticks / stage_ticks);
+		}
+		else {
+			printf("-\n");
+		}
+		printf("\thistogram:");
+		for (b = 0; b < PROF_BUCKETS; b++){	//Bucket b holds [2^b, 2^(b+1)) ticks
+			if (p->hist[b]){
+				printf(" <%llu:%llu", 2ULL << b, (unsigned long long)p->hist[b]);
+			}
+		}
+		printf("\n");
+	}
+	printf("-------------------------------------\n");
+#else
+	printf("Built without STAGE_PROF, use make prof\n");
+#endif
+}
+
+/************************************************************/
+/* Create the shared stats page /mu-mips.<pid> for mu-mips-top          */ 
+/************************************************************/
+void stats_open(){
+	int fd;
+	char *name;
+	
+	if (STATS_PAGE != NULL){
+		return;
+	}
+	snprintf(STATS_SHM_NAME, sizeof(STATS_SHM_NAME), "/%s%d", STATS_SHM_PREFIX, (int)getpid());
+	fd = shm_open(STATS_SHM_NAME, O_CREAT | O_RDWR, 0644);
+	if (fd < 0 || ftruncate(fd, sizeof(Stats_Page)) != 0){
+		printf("Error: Can't create shared stats page %s\n", STATS_SHM_NAME);
+		if (fd >= 0){
+			close(fd);
+			shm_unlink(STATS_SHM_NAME);
+		}
+		return;
+	}
+	STATS_PAGE = mmap(NULL, sizeof(Stats_Page), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (STATS_PAGE == MAP_FAILED){
+		STATS_PAGE = NULL;
+		shm_unlink(STATS_SHM_NAME);
+		printf("Error: Can't map shared stats page %s\n", STATS_SHM_NAME);
+		return;
+	}
+	STATS_OWNER = getpid();
+	STATS_PAGE->magic = STATS_MAGIC;
+	STATS_PAGE->pid = getpid();
+	name = strrchr(prog_file, '/');	//Server jobs name programs by full path
+	snprintf(STATS_PAGE->program, sizeof(STATS_PAGE->program), "%.*s", (int)sizeof(STATS_PAGE->program) - 1, name != NULL ? name + 1 : prog_file);
+	atexit(stats_close);
+	stats_publish(CYCLE_COUNT == 0 ? STATS_IDLE : (RUN_FLAG ? STATS_PAUSED : STATS_HALTED));
+	printf("Publishing stats in %s every %d cycles\n", STATS_SHM_NAME, STATS_EVERY);
+}
+
+/************************************************************/
+/* Remove the shared stats page, only in the process that created it     */ 
+/************************************************************/
+void stats_close(){
+	if (STATS_PAGE == NULL){
+		return;
+	}
+	munmap(STATS_PAGE, sizeof(Stats_Page));
+	STATS_PAGE = NULL;
+	if (STATS_OWNER == getpid()){
+		shm_unlink(STATS_SHM_NAME);
+	}
+}
+
+/************************************************************/
+/* Copy the counters into the shared page under its seqlock             */ 
+/************************************************************/
+void stats_publish(uint32_t state){
+	Stats_Page *p = STATS_PAGE;
+	uint32_t seq;
+	
+	if (p == NULL || CORE_ID != 0){	//Core 0 speaks for a multicore run
+		return;
+	}
+	seq = atomic_load_explicit(&p->seq, memory_order_relaxed);
+	atomic_store_explicit(&p->seq, seq + 1, memory_order_relaxed);	//Odd, readers retry
+	atomic_thread_fence(memory_order_release);
+	p->state = state;
+	p->pc = CURRENT_STATE.PC;
+	p->core_model = CORE_MODEL;
+	p->issue_width = ISSUE_WIDTH;
+	p->threads = NUM_THREADS;
+	p->cores = MC_CORES;
+	p->cycles = CYCLE_COUNT;
+	p->instructions = INSTRUCTION_COUNT;
+	p->hazard_stalls = HAZARD_STALL_CYCLES;
+	p->mem_stalls = MEM_STALL_CYCLES;
+	p->flush_cycles = FLUSH_CYCLES;
+	p->host_seconds = HOST_SECONDS;
+	atomic_store_explicit(&p->seq, seq + 2, memory_order_release);
+}
+
+/************************************************************/
+/* Print TLB counters                                                                                                */ 
+/************************************************************/
+void print_mmu_stats(){
+	TLB_Model *tlbs[] = { &ITLB, &DTLB };
+	char *names[] = { "ITLB", "DTLB" };
+	int i;
+	
+	printf("-------------------------------------\n");
+	printf("MMU\t\t\t: %s, %d-way TLBs\n", MMU_MODE == MMU_HW_WALK ? "hardware walk" : "software refill", TLB_ASSOC);
+	for (i = 0; i < 2; i++){
+		printf("%s Entries / Reach\t: %d / %dKB\n", names[i], *tlbs[i]->size, *tlbs[i]->size << (PAGE_SHIFT - 10));
+		printf("%s Hits / Misses\t: %u / %u\n", names[i], tlbs[i]->hits, tlbs[i]->misses);
+		printf("%s Miss Rate\t\t: %.4f\n", names[i], (tlbs[i]->hits + tlbs[i]->misses) ? (double)tlbs[i]->misses / (tlbs[i]->hits + tlbs[i]->misses) : 0.0);
+	}
+	if (MMU_MODE == MMU_SW_WALK){
+		printf("# Refill Exceptions\t: %u\n", TLB_REFILLS);
+	}
+	else{
+		printf("# Walk Cycles\t\t: %u\n", (ITLB.misses + DTLB.misses - PAGE_FAULTS) * TLB_MISS_LATENCY);
+	}
+	printf("# Page Faults\t\t: %u\n", PAGE_FAULTS);
+}
+
+/************************************************************/
+/* lines a stream touched in working set window w                                           */
+/************************************************************/
+uint32_t sd_window_lines(Sd_Profile *p, uint32_t w)
+{
+	if (w < p->ws_count){
+		return p->ws[w];
+	}
+	return (p->table != NULL && w == p->window) ? p->window_lines : 0;
+}
+
+/************************************************************/
+/* miss ratio of a count over a stream, 0 before its first access                      */
+/************************************************************/
+double sd_ratio(Sd_Profile *p, uint64_t misses)
+{
+	return p->accesses ? (double)misses / p->accesses : 0.0;
+}
+
+/************************************************************/
+/* Print what the trace exports have written                                                        */ 
+/************************************************************/
+void print_export_stats(){
+	printf("-------------------------------------\n");
+	if (DIN_OUT.fp != NULL){
+		printf("# din Records\t\t: %llu (%.1f MB%s)\n", (unsigned long long)DIN_OUT.records,
+			DIN_OUT.bytes / 1048576.0, DIN_OUT.piped ? " before gzip" : "");
+	}
+	if (BRANCH_OUT.fp != NULL){
+		printf("# Branch Records\t: %llu (%.1f MB%s)\n", (unsigned long long)BRANCH_OUT.records,
+			BRANCH_OUT.bytes / 1048576.0, BRANCH_OUT.piped ? " before gzip" : "");
+	}
+}
+
+/************************************************************/
+/* Print the miss ratio curves and the working set of both streams                */ 
+/************************************************************/
+void print_sd_stats(){
+	Sd_Profile *ip = &SD_INST, *dp = &SD_DATA;
+	uint32_t windows = CYCLE_COUNT / SD_WINDOW + 1, w, i_lines, d_lines, i_peak = 0, d_peak = 0;
+	uint64_t bytes, i_sum = 0, d_sum = 0;
+	int k, kmin;
+	
+	for (kmin = 0; (1 << kmin) < DCACHE_ASSOC; kmin++);
+	printf("-------------------------------------\n");
+	printf("Stack Distance Profile\t: %dB lines, LRU, fully associative and %d-way\n", DCACHE_LINE, DCACHE_ASSOC);
+	printf("# Accesses (I / D)\t: %llu / %llu\n", (unsigned long long)ip->accesses, (unsigned long long)dp->accesses);
+	printf("Footprint (I / D)\t: %u / %u lines\n", ip->lines, dp->lines);
+	printf("[Size]\t\t[I FA]\t[I %d-way]\t[D FA]\t[D %d-way]\t(miss ratio)\n", DCACHE_ASSOC, DCACHE_ASSOC);
+	for (k = kmin; k <= SD_MAX_LOG; k++){
+		bytes = (uint64_t)DCACHE_LINE << k;
+		if (bytes < 1024){
+			printf("%lluB\t\t", (unsigned long long)bytes);
+		}else if (bytes < 1024 * 1024){
+			printf("%lluKB\t\t", (unsigned long long)(bytes >> 10));
+		}else {
+			printf("%lluMB\t\t", (unsigned long long)(bytes >> 20));
+		}
+		printf("%.4f\t%.4f\t\t%.4f\t%.4f\n", sd_ratio(ip, sd_fa_misses(ip, k)), sd_ratio(ip, ip->misses[k]),
+			sd_ratio(dp, sd_fa_misses(dp, k)), sd_ratio(dp, dp->misses[k]));
+		if (sd_fa_misses(ip, k) == ip->cold && ip->misses[k] == ip->cold &&
+			sd_fa_misses(dp, k) == dp->cold && dp->misses[k] == dp->cold){
+			break;	//Both footprints fit, only cold misses from here on
+		}
+	}
+	for (w = 0; w < windows; w++){
+		i_lines = sd_window_lines(ip, w);
+		d_lines = sd_window_lines(dp, w);
+		i_sum += i_lines;
+		d_sum += d_lines;
+		i_peak = i_lines > i_peak ? i_lines : i_peak;
+		d_peak = d_lines > d_peak ? d_lines : d_peak;
+	}
+	printf("Working Set (I / D)\t: %.1f / %.1f lines per %d cycles, peak %u / %u (%u windows)\n",
+		(double)i_sum / windows, (double)d_sum / windows, SD_WINDOW, i_peak, d_peak, windows);
+	
+	if (SD_OUT_FP == NULL){
+		return;
+	}
+	if (SD_OUT_FP != stdout){
+		fflush(SD_OUT_FP);
+		rewind(SD_OUT_FP);	//Each stats rewrites the file
+		if (ftruncate(fileno(SD_OUT_FP), 0) != 0){
+			printf("Error: Can't rewrite the stack distance output\n");
+			return;
 		}
 	}
+	fprintf(SD_OUT_FP, "# miss ratio of LRU caches with %dB lines\n", DCACHE_LINE);
+	fprintf(SD_OUT_FP, "# size_bytes i_fa i_%dway d_fa d_%dway\n", DCACHE_ASSOC, DCACHE_ASSOC);
+	for (k = kmin; k <= SD_MAX_LOG; k++){
+		fprintf(SD_OUT_FP, "%llu %.6f %.6f %.6f %.6f\n", (unsigned long long)DCACHE_LINE << k,
+			sd_ratio(ip, sd_fa_misses(ip, k)), sd_ratio(ip, ip->misses[k]),
+			sd_ratio(dp, sd_fa_misses(dp, k)), sd_ratio(dp, dp->misses[k]));
+	}
+	fprintf(SD_OUT_FP, "\n# lines touched per %d cycles\n", SD_WINDOW);
+	fprintf(SD_OUT_FP, "# window first_cycle i_lines d_lines\n");
+	for (w = 0; w < windows; w++){
+		fprintf(SD_OUT_FP, "%u %llu %u %u\n", w, (unsigned long long)w * SD_WINDOW, sd_window_lines(ip, w), sd_window_lines(dp, w));
+	}
+	fflush(SD_OUT_FP);
 }
 
 /************************************************************/
-/* Print the current pipeline                                                                                    */ 
+/* Print data cache counters of the single core                                                      */ 
 /************************************************************/
-void show_pipeline(){
-	/*IMPLEMENT THIS*/
-	printf("\nCurrent PC: %X", CURRENT_STATE.PC);
-	printf("\nIF/ID.IR:  %X  instruction:   ", IF_ID.IR);
-	print_instruction(CURRENT_STATE.PC);
-	printf("\nIF/ID.PC: %X\n\n", IF_ID.PC );
+void print_cache_stats(){
+	Cache_Model *c = &CORES[0].dcache;
 	
-	printf("\nID/EX.IR: %X    instruction:   ", ID_EX.IR);
-	print_instruction(CURRENT_STATE.PC);
-	printf("\nID/EX.IR:  %X", ID_EX.IR);
-	printf("\nID/EX.A:  %X",ID_EX.A);
-	printf("\nID/EX.B:  %X\n\n",ID_EX.B);
+	printf("-------------------------------------\n");
+	printf("D-Cache\t\t\t: %dKB, %d-way, %dB lines\n", DCACHE_KB, DCACHE_ASSOC, DCACHE_LINE);
+	printf("# Hits / Misses\t\t: %u / %u\n", c->hits, c->misses);
+	printf("Miss Rate\t\t: %.3f\n", (c->hits + c->misses) ? (double)c->misses / (c->hits + c->misses) : 0.0);
+	printf("# Writebacks\t\t: %u\n", c->writebacks);
+}
+
+/************************************************************/
+/* Print per-core counters of the multicore model                                                   */ 
+/************************************************************/
+void print_mc_stats(){
+	Core_Context *core;
+	uint32_t msgs = 0, invs = 0;
+	int c;
 	
-	printf("\nEX/MEM.IR:  %X", EX_MEM.IR);
-	printf("\nEX/MEM.A:  %X", EX_MEM.A);
-	printf("\nEX/MEM.B:  %X",EX_MEM.B);
-	printf("\nEX/MEM.ALUOutput:  %X\n\n",EX_MEM.ALUOutput);
+	printf("-------------------------------------\n");
+	printf("Cores / Quantum\t\t: %d / %d\n", MC_CORES, MC_QUANTUM);
+	if (DCACHE_KB > 0){
+		printf("D-Cache\t\t\t: %dKB, %d-way, %dB lines (MESI)\n", DCACHE_KB, DCACHE_ASSOC, DCACHE_LINE);
+	}
+	printf("[Core]\t[Instr]\t[Cycles]\t[IPC]\t[Hits]\t[Misses]\t[Upgr]\t[Msgs]\t[Invs]\t[SC ok/fail]\n");
+	for (c = 0; c < MC_CORES; c++){
+		core = &CORES[c];
+		printf("C%d%s\t%u\t%u\t\t%.3f\t%u\t%u\t\t%u\t%u\t%u\t%u/%u\n", c, core->running ? "" : "*",
+			core->instructions, core->cycles, core->cycles ? (double)core->instructions / core->cycles : 0.0,
+			core->dcache.hits, core->dcache.misses, core->dcache.upgrades,
+			core->msgs_sent, core->invalidations, core->sc_success, core->sc_fail);
+		msgs += core->msgs_sent;
+		invs += core->invalidations;
+	}
+	printf("(* finished)\n");
+	printf("# Coherence Messages\t: %u\n", msgs);
+	printf("# Invalidations\t\t: %u\n", invs);
+}
+
+/************************************************************/
+/* Print out-of-order core counters                                                                        */ 
+/************************************************************/
+void print_ooo_stats(){
+	printf("-------------------------------------\n");
+	printf("ROB Size / Width\t: %d / %d\n", OOO_ROB_SIZE, OOO_WIDTH);
+	printf("Avg ROB Occupancy\t: %.2f\n", CYCLE_COUNT ? (double)OOO_ROB_OCCUPANCY / CYCLE_COUNT : 0.0);
+	printf("Max ROB Occupancy\t: %d\n", OOO_ROB_MAX);
+	printf("Issue Utilization\t: %.3f\n", CYCLE_COUNT ? (double)OOO_ISSUED / ((double)CYCLE_COUNT * OOO_WIDTH) : 0.0);
+	printf("Memory Level Parallelism: %.2f\n", OOO_MLP_CYCLES ? (double)OOO_LOADS_INFLIGHT / OOO_MLP_CYCLES : 0.0);
+	printf("# Forwarded Loads\t: %u\n", OOO_FORWARDED_LOADS);
+	printf("# Branches\t\t: %u\n", OOO_BRANCHES);
+	printf("# Mispredicts\t\t: %u\n", OOO_MISPREDICTS);
+}
+
+/************************************************************/
+/* Print per-thread counters of the barrel pipeline                                                */ 
+/************************************************************/
+void print_mt_stats(){
+	char *policy[] = { "round robin", "switch on stall", "icount" };
+	int t;
 	
-	printf("\nMEM/WB.IR:  %X",MEM_WB.IR);
-	printf("\nMEM/WB.ALUOutput:  %X",MEM_WB.ALUOutput);
-	printf("\nMEM/WB.LMD:  %X\n\n",MEM_WB.LMD );
+	printf("-------------------------------------\n");
+	printf("Threads / Fetch Policy\t: %d / %s\n", NUM_THREADS, policy[FETCH_POLICY]);
+	printf("# ID Slots Given Away\t: %u\n", MT_SQUASHES);
+	printf("# Parked on Misses\t: %u\n", MT_PARKS);
+	printf("[Thread]\t[PC]\t\t[Instructions]\t[IPC]\n");
+	for (t = 0; t < NUM_THREADS; t++){
+		printf("T%d%s\t\t0x%08x\t%u\t\t%.3f\n", t, THREADS[t].running ? "" : "*",
+			(t == ACTIVE_THREAD) ? CURRENT_STATE.PC : THREADS[t].current.PC,
+			THREADS[t].instructions, CYCLE_COUNT ? (double)THREADS[t].instructions / CYCLE_COUNT : 0.0);
+	}
+	printf("(* finished)\n");
 }
 
 /***************************************************************/
 /* main                                                                                                                                   */
 /***************************************************************/
 int main(int argc, char *argv[]) {                              
+	char *option;
+	int i;
+	
 	printf("\n**************************\n");
 	printf("Welcome to MU-MIPS SIM...\n");
 	printf("**************************\n\n");
 	
 	if (argc < 2) {
-		printf("Error: You should provide input file.\nUsage: %s <input program> \n\n",  argv[0]);
+		printf("Error: You should provide input file.\nUsage: %s <input program> [<option>=<val> ...]\n\n",  argv[0]);
 		exit(1);
 	}
 
 	strcpy(prog_file, argv[1]);
-	initialize();
-	load_program();
+	PROF_CALL(PROF_INIT_MEMORY, initialize());
+	PROF_CALL(PROF_LOAD_PROGRAM, load_program());
+#ifdef STAGE_PROF
+	atexit(print_profile);
+#endif
+	for (i = 2; i < argc; i++){
+		option = strchr(argv[i], '=');
+		if (option == NULL){
+			printf("Ignoring argument %s, expected <option>=<val>\n", argv[i]);
+			continue;
+		}
+		*option = '\0';
+		set_option(argv[i], option + 1);
+	}
 	help();
 	while (1){
 		handle_command();
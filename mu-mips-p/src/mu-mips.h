@@ -1,8 +1,16 @@
 #include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "mu-mips-stats.h"
+
+/* state private to each simulated core, every host thread of the multicore model has its own copy */
+#define SIM_TLS __thread
 
 #define FALSE 0
 #define TRUE  1
 
+#define PROG_PATH_SIZE 256	/* program, trace and output file names, read with %255s */
+
 /******************************************************************************/
 /* MIPS memory layout                                                                                                                                      */
 /******************************************************************************/
@@ -18,6 +26,16 @@
 #define MEM_KDATA_BEGIN 0x90000000
 #define MEM_KDATA_END  0xFFFEFFFF
 
+/* device registers, word aligned, reads have no side effects except where noted */
+#define MMIO_BEGIN     0xFFFF0000
+#define MMIO_RX_CTRL   0xFFFF0000	/* bit 0 set while a console byte is waiting */
+#define MMIO_RX_DATA   0xFFFF0004	/* the waiting byte, a committed load takes it */
+#define MMIO_TX_CTRL   0xFFFF0008	/* bit 0 set when TX_DATA takes a byte, always */
+#define MMIO_TX_DATA   0xFFFF000C	/* a store sends its low byte to the console */
+#define MMIO_CYCLES    0xFFFF0010	/* cycles executed */
+#define MMIO_INSTS     0xFFFF0014	/* instructions executed */
+#define MMIO_ROI       0xFFFF0018	/* store 1 to open a region of interest, 0 to close it */
+
 /*stack and data segments occupy the same memory space. Stack grows backward (from higher address to lower address) */
 #define MEM_STACK_BEGIN 0x7FFFFFFF
 #define MEM_STACK_END  0x10010000
@@ -36,6 +54,12 @@ mem_region_t MEM_REGIONS[] = {
 };
 
 #define NUM_MEM_REGION 4
+
+/* pages ever written, so reset and checkpoints only touch those */
+#define MEM_PAGE_SHIFT 12
+#define MEM_PAGE_SIZE (1 << MEM_PAGE_SHIFT)
+#define MEM_PAGES (1 << (32 - MEM_PAGE_SHIFT))
+uint8_t MEM_DIRTY[MEM_PAGES];	/* bytes, not bits, so core threads can set them without a race */
 #define MIPS_REGS 32
 
 typedef struct CPU_State_Struct {
@@ -57,29 +81,853 @@ typedef struct CPU_Pipeline_Reg_Struct{
 	uint32_t RegisterRS;
 	uint32_t RegisterRT;
 	uint32_t RegWrite;
+	uint32_t Bubble;	/* latch holds no instruction */
+	uint32_t TID;	/* hardware thread that owns the instruction */
+	uint32_t Exception;	/* cause code taken when the latch reaches MEM, 0 if none */
+	uint32_t PredPC;	/* successor the decoupled front end fetched next */
 	
 } CPU_Pipeline_Reg;
 
+typedef struct Decoded_Inst_Struct{
+	uint32_t opcode, funct;
+	uint32_t rs, rt, rd, sa;
+	uint32_t imm;	/* sign extended immediate */
+	uint32_t target;	/* jump target field */
+	uint32_t dest;	/* register written back, 0 if none */
+	int reads_rs, reads_rt;
+	int reads_hilo, writes_hilo;
+	int is_load, is_store, is_branch;
+} Decoded_Inst;
+
 /***************************************************************/
 /* CPU State info.                                                                                                               */
 /***************************************************************/
 
-CPU_State CURRENT_STATE, NEXT_STATE;
-int RUN_FLAG;	/* run flag*/
-uint32_t INSTRUCTION_COUNT;
-uint32_t CYCLE_COUNT;
+SIM_TLS CPU_State CURRENT_STATE, NEXT_STATE;
+SIM_TLS int RUN_FLAG;	/* run flag*/
+SIM_TLS uint32_t INSTRUCTION_COUNT;
+SIM_TLS uint32_t CYCLE_COUNT;
 uint32_t PROGRAM_SIZE; /*in words*/
 
 
 /***************************************************************/
 /* Pipeline Registers.                                                                                                        */
 /***************************************************************/
-CPU_Pipeline_Reg IF_ID;
-CPU_Pipeline_Reg ID_EX;
-CPU_Pipeline_Reg EX_MEM;
-CPU_Pipeline_Reg MEM_WB;
+SIM_TLS CPU_Pipeline_Reg IF_ID;
+SIM_TLS CPU_Pipeline_Reg ID_EX;
+SIM_TLS CPU_Pipeline_Reg EX_MEM;
+SIM_TLS CPU_Pipeline_Reg MEM_WB;
+
+SIM_TLS int FETCH_REDIRECT;	/* a taken branch or ERET moved the PC, drop the fetch behind it */
+int REDIRECT_TID;	/* thread whose PC moved */
+SIM_TLS int EXIT_PENDING;	/* exit SYSCALL is draining, fetch no further */
+
+/* second issue slot, only used when ISSUE_WIDTH is 2 */
+CPU_Pipeline_Reg IF_ID_S1;
+CPU_Pipeline_Reg ID_EX_S1;
+CPU_Pipeline_Reg EX_MEM_S1;
+CPU_Pipeline_Reg MEM_WB_S1;
+
+/***************************************************************/
+/* Simulator configuration and statistics.                                                               */
+/***************************************************************/
+#define MAX_ISSUE_WIDTH 2
+
+int ISSUE_WIDTH = 1;
+int VERBOSE = 1;	/* per-cycle pipeline trace */
+double HOST_SECONDS;	/* host wall time spent inside run/runAll */
+SIM_TLS uint32_t HAZARD_STALL_CYCLES;	/* ID held for a load-use hazard */
+SIM_TLS uint32_t MEM_STALL_CYCLES;	/* pipeline frozen on a cache or TLB miss */
+SIM_TLS uint32_t FLUSH_CYCLES;	/* fetch slots squashed behind taken branches */
+Stats_Page *STATS_PAGE;	/* shared page for mu-mips-top, NULL unless stats_shm is set */
+char STATS_SHM_NAME[32];
+int STATS_OWNER;	/* pid that created it, forked server jobs inherit the mapping */
+int STATS_EVERY = 4096;	/* cycles between updates of the shared page */
+uint32_t ISSUE_CYCLES;	/* cycles in which ID issued at least one instruction */
+uint32_t DUAL_ISSUE_CYCLES;	/* cycles in which ID issued a pair */
+
+/***************************************************************/
+/* Pipeline shape. if_stages, ex_stages and mem_stages give the depth */
+/* of the fetch, execute and memory groups around the single ID and WB */
+/* stages. The stage functions still do the work once per instruction,*/
+/* and the timing of the deeper pipeline is derived from the depths:  */
+/* with full forwarding, an ALU result reaches a dependent instruction */
+/* ex_stages ticks after the producer entered EX and a load result    */
+/* ex_stages + mem_stages ticks after, and a branch resolved in the   */
+/* last EX stage squashes every fetch, ID and earlier EX slot behind  */
+/* it. REG_READY is the scoreboard ID checks, in ticks: cycles the   */
+/* pipeline advanced, so a frozen miss does not hide a hazard. The    */
+/* trace and interval cores use the same derivation.                   */
+/***************************************************************/
+#define MAX_STAGE_DEPTH 8	/* per group */
+#define PIPE_DEEP (IF_STAGES > 1 || EX_STAGES > 1 || MEM_STAGES > 1)
+#define ALU_LATENCY ((uint32_t)EX_STAGES)
+#define LOAD_LATENCY ((uint32_t)(EX_STAGES + MEM_STAGES))
+#define REDIRECT_PENALTY ((uint32_t)(IF_STAGES + EX_STAGES))	/* slots lost to a taken branch */
+#define EXIT_DRAIN_CYCLES ((uint32_t)(EX_STAGES + MEM_STAGES + 2))	/* exit SYSCALL from issue to WB, for the trace core */
+
+int IF_STAGES = 1;
+int EX_STAGES = 1;
+int MEM_STAGES = 1;
+SIM_TLS uint32_t PIPE_TICK;
+SIM_TLS uint32_t REG_READY[MIPS_REGS];	/* tick from which a register can be forwarded to EX */
+SIM_TLS uint32_t FETCH_REFILL;	/* bubbles IF still owes the deeper front end after a redirect */
+SIM_TLS uint32_t EXIT_DRAIN;	/* cycles the exit SYSCALL still spends in the extra EX and MEM stages */
+
+/***************************************************************/
+/* Cycle skipping. A single-issue pipeline that is back in exactly the  */
+/* state it had one loop iteration ago (registers, latches and stalls, */
+/* with no store and no miss in between) repeats that iteration until */
+/* something outside it changes, so whole iterations are credited in  */
+/* bulk up to the next event: the end of the run, cycle_limit, or the  */
+/* next multicore barrier. Frozen memory stalls collapse the same way. */
+/* Data cache hits and the LRU clock advance with the iterations; the */
+/* prefetchers train on every access, so they turn skipping off.        */
+/***************************************************************/
+typedef struct Loop_Snapshot_Struct{
+	uint32_t target;	/* backward branch target, 0 before the first one */
+	CPU_State state;
+	CPU_Pipeline_Reg if_id, id_ex, ex_mem, mem_wb;
+	int stall, exit_pending;
+	uint32_t writes, dcache_misses;
+	uint32_t cycles, instructions, hazard_stalls, mem_stalls, flush_cycles;
+	uint32_t dcache_hits, dcache_clock;
+} Loop_Snapshot;
+
+int SKIP_IDLE = TRUE;	/* skip option */
+uint32_t CYCLE_LIMIT;	/* cycle_limit option, run stops there, 0 for none */
+SIM_TLS Loop_Snapshot LOOP;
+SIM_TLS uint32_t LOOP_EDGE;	/* target of a backward branch taken this cycle */
+SIM_TLS uint32_t MEM_WRITES;	/* stores by this host thread */
+SIM_TLS uint32_t SKIPPED_CYCLES;	/* cycles credited without being simulated */
+
+/***************************************************************/
+/* Host-pipelined stages (host_pipe 1, experimental): MEM runs on a   */
+/* second host thread while WB, EX, ID and IF run on the main one.    */
+/* Each side only needs what the other produced a cycle earlier. MEM  */
+/* takes last cycle's EX/MEM latch, EX forwards from that same latch */
+/* rather than the MEM/WB latch MEM is filling, and the new MEM/WB    */
+/* latch is handed back at the end of the cycle.                              */
+/***************************************************************/
+#define PIPE_SPINS 64	/* polls before yielding the host CPU */
+
+typedef struct Host_Pipe_Struct{
+	_Atomic uint32_t go __attribute__((aligned(64)));	/* cycle handed to the MEM thread */
+	_Atomic uint32_t done __attribute__((aligned(64)));	/* last cycle it finished */
+	_Atomic int quit;
+	CPU_Pipeline_Reg in;	/* EX/MEM latch of the previous cycle */
+	CPU_Pipeline_Reg out;	/* MEM/WB latch MEM produced from it */
+	int mem_stall;	/* cycles the miss in this MEM freezes the pipeline */
+	uint32_t writes;	/* stores MEM made, for cycle skipping */
+} Host_Pipe;
+
+int HOST_PIPE;	/* host_pipe option */
+Host_Pipe PIPE;
+pthread_t PIPE_THREAD;
+int PIPE_RUNNING;
+uint32_t PIPE_SEQ;
+
+/***************************************************************/
+/* Host self-profiling, compiled in with -DSTAGE_PROF (make prof).           */
+/***************************************************************/
+#define PROF_WB 0
+#define PROF_MEM 1
+#define PROF_EX 2
+#define PROF_ID 3
+#define PROF_IF 4
+#define PROF_MEM_READ 5	/* mem_read_32 */
+#define PROF_MEM_WRITE 6	/* mem_write_32 */
+#define PROF_INIT_MEMORY 7	/* loader phases, always timed */
+#define PROF_LOAD_PROGRAM 8
+#define PROF_SLOTS 9
+#define PROF_BUCKETS 32	/* power-of-two histogram of host ticks */
+#define PROF_SAMPLE_PERIOD 16	/* time one simulated cycle in this many */
+
+typedef struct Prof_Slot_Struct {
+	uint64_t samples, ticks, min, max;
+	uint64_t hist[PROF_BUCKETS];
+} Prof_Slot;
+
+Prof_Slot PROF[PROF_SLOTS];
+SIM_TLS int PROF_ON = TRUE;	/* the current cycle is sampled */
+
+#ifdef STAGE_PROF
+#define PROF_CALL(slot, call) do { \
+		if (PROF_ON){ \
+			uint64_t prof_start = prof_ticks(); \
+			call; \
+			prof_record(slot, prof_ticks() - prof_start); \
+		} \
+		else { \
+			call; \
+		} \
+	} while (0)
+#else
+#define PROF_CALL(slot, call) call
+#endif
+
+#define CORE_PIPELINE 0
+#define CORE_OOO 1
+#define CORE_TRACE 2	/* pipeline timing driven by instruction records */
+#define CORE_INTERVAL 3	/* functional run with analytic pipeline penalties */
+
+int CORE_MODEL = CORE_PIPELINE;
+
+/***************************************************************/
+/* Out-of-order core (Tomasulo with reorder buffer).                                                */
+/***************************************************************/
+#define OOO_MAX_ROB 256
+#define OOO_MAX_RS 64
+#define OOO_MAX_LSQ 64
+#define OOO_MAX_WIDTH 8
+#define OOO_FETCH_QUEUE 32
+#define OOO_BP_ENTRIES 1024
+#define OOO_REG_HILO 32	/* HI and LO are renamed together as one extra register */
+#define OOO_NUM_REGS 33
+
+#define FU_ALU 0
+#define FU_MULDIV 1
+#define FU_BRANCH 2
+#define FU_CLASSES 3
+
+typedef struct ROB_Entry_Struct{
+	int busy;
+	int done;
+	uint32_t PC;
+	uint32_t IR;
+	Decoded_Inst d;
+	uint32_t value;	/* result for d.dest */
+	uint32_t hi, lo;	/* result for HI/LO writers */
+	uint32_t next_pc;	/* predicted, then resolved, successor */
+	int lsq;	/* LSQ entry of a load or store, -1 otherwise */
+} ROB_Entry;
+
+typedef struct RS_Entry_Struct{
+	int busy;
+	int rob;
+	int executing;
+	int remaining;	/* cycles left in the functional unit */
+	uint32_t Vj, Vk, Vhi, Vlo;
+	int Qj, Qk, Qhl;	/* producing ROB entry, -1 when the value is present */
+} RS_Entry;
+
+typedef struct LSQ_Entry_Struct{
+	int busy;
+	int rob;
+	uint32_t Vbase, Vdata;
+	int Qbase, Qdata;
+	int addr_ready;
+	uint32_t addr;
+	int accessing;	/* load in flight to memory */
+	int remaining;
+} LSQ_Entry;
+
+typedef struct Fetch_Entry_Struct{
+	uint32_t PC;
+	uint32_t IR;
+	uint32_t next_pc;	/* predicted successor */
+} Fetch_Entry;
+
+int OOO_ROB_SIZE = 64;
+int OOO_RS_SIZE = 16;	/* entries per functional unit class */
+int OOO_LSQ_SIZE = 32;
+int OOO_WIDTH = 4;	/* fetch, dispatch, issue and commit width */
+int OOO_MULDIV_LATENCY = 4;
+int OOO_MEM_LATENCY = 3;
+
+ROB_Entry ROB[OOO_MAX_ROB];
+int ROB_HEAD, ROB_COUNT;
+RS_Entry RS[FU_CLASSES][OOO_MAX_RS];
+LSQ_Entry LSQ[OOO_MAX_LSQ];
+int LSQ_HEAD, LSQ_COUNT;
+int RAT[OOO_NUM_REGS];	/* ROB entry producing each register, -1 when committed */
+Fetch_Entry FETCH_QUEUE[OOO_FETCH_QUEUE];
+int FQ_HEAD, FQ_COUNT;
+uint32_t FETCH_PC;
+uint8_t BP_COUNTERS[OOO_BP_ENTRIES];	/* 2-bit bimodal counters */
+uint32_t BTB[OOO_BP_ENTRIES];
+
+uint64_t OOO_ROB_OCCUPANCY;	/* summed every cycle */
+int OOO_ROB_MAX;
+uint64_t OOO_ISSUED;	/* micro-ops sent to functional units */
+uint64_t OOO_LOADS_INFLIGHT;	/* summed over cycles with a load in flight */
+uint32_t OOO_MLP_CYCLES;
+uint32_t OOO_BRANCHES, OOO_MISPREDICTS;
+uint32_t OOO_FORWARDED_LOADS;
+
+/***************************************************************/
+/* Fine-grained multithreading (barrel pipeline). A data cache miss    */
+/* parks only its own thread: a load is squashed with the thread's     */
+/* younger instructions and refetched once the line is in, a store     */
+/* completes and the thread resumes after it. The other threads keep  */
+/* issuing in the meantime.                                                                          */
+/***************************************************************/
+#define MAX_THREADS 8
+#define THREAD_TEXT_STRIDE 0x01000000	/* text offset of a thread running its own program */
+
+#define FETCH_ROUND_ROBIN 0
+#define FETCH_SWITCH_ON_STALL 1
+#define FETCH_ICOUNT 2
+
+typedef struct Thread_Context_Struct{
+	CPU_State current, next;
+	int running;
+	uint32_t text_offset;	/* added to the PC when fetching */
+	uint32_t instructions;
+	uint32_t wait;	/* cycles until a thread parked on a miss fetches again */
+	uint32_t replay_pc;	/* refetched load, it completes even if it misses again */
+	char prog_file[PROG_PATH_SIZE];	/* empty when running the main program */
+} Thread_Context;
+
+int NUM_THREADS = 1;
+int FETCH_POLICY = FETCH_ROUND_ROBIN;
+int ACTIVE_THREAD;	/* context currently held in CURRENT_STATE/NEXT_STATE */
+int LAST_FETCH_THREAD;
+uint32_t FETCH_OFFSET;
+Thread_Context THREADS[MAX_THREADS];
+uint8_t PENDING_WRITES[MAX_THREADS][MIPS_REGS];	/* issued but not written back */
+uint32_t MT_SQUASHES;	/* ID slots handed to another thread */
+uint32_t MT_PARKS;	/* threads parked on a data cache miss */
+
+/***************************************************************/
+/* L1 data cache (MESI states, also used single-core).                                               */
+/***************************************************************/
+#define CACHE_MAX_LINES 65536
+
+#define MESI_I 0
+#define MESI_S 1
+#define MESI_E 2
+#define MESI_M 3
+
+typedef struct Cache_Line_Struct{
+	uint32_t tag;	/* line address */
+	uint32_t lru;	/* last access time */
+	int state;
+	int prefetched;	/* filled by a prefetch and not referenced since */
+} Cache_Line;
+
+typedef struct Cache_Model_Struct{
+	Cache_Line lines[CACHE_MAX_LINES];
+	uint32_t clock;
+	uint32_t hits, misses, upgrades, writebacks;
+} Cache_Model;
+
+int DCACHE_KB = 0;	/* 0 disables the data cache */
+int DCACHE_ASSOC = 4;
+int DCACHE_LINE = 32;
+int DCACHE_MISS_LATENCY = 20;
+
+SIM_TLS Cache_Model *DCACHE;	/* cache of the core running on this host thread */
+SIM_TLS int mem_stall;	/* cycles the whole pipeline stays frozen on a miss */
+
+/***************************************************************/
+/* Store buffer (store_buffer <n>, pipeline core, one core). Stores   */
+/* retire into a FIFO of line entries and drain to the data cache one */
+/* at a time in the background; a store to the line at the tail merges */
+/* into it, loads to a buffered line are forwarded, and a store that   */
+/* finds the buffer full freezes the pipeline until the head drains.  */
+/* Memory itself is still written in MEM, the buffer is timing only.   */
+/***************************************************************/
+#define SB_MAX_ENTRIES 64
+
+int SB_ENTRIES = 0;	/* 0 disables the store buffer */
+uint32_t SB_LINES[SB_MAX_ENTRIES];	/* line address of each pending entry */
+int SB_HEAD, SB_COUNT;
+uint32_t SB_BUSY;	/* cycles left on the drain in flight */
+uint32_t SB_STORES, SB_MERGES, SB_FORWARDS, SB_DRAINS, SB_FULL_STALLS;
+
+/***************************************************************/
+/* Data prefetchers (prefetch next|stride|stream, pipeline core, one  */
+/* core, needs the data cache). next and stride prefetches wait in a  */
+/* small MSHR file and fill the cache once the miss latency has passed, */
+/* so they never block the pipeline; a demand miss to a line still in  */
+/* flight only waits for the rest of it. Stream buffers keep their    */
+/* lines outside the cache until a demand miss takes one. degree is    */
+/* the lines fetched per trigger and distance how far ahead they start */
+/* (in lines, or in strides for the stride prefetcher).                */
+/***************************************************************/
+#define PF_NONE 0
+#define PF_NEXT_LINE 1	/* on a miss or the first use of a prefetched line */
+#define PF_STRIDE 2	/* per load PC, once the same stride is seen twice */
+#define PF_STREAM 3
+
+#define PF_MSHRS 16
+#define PF_MAX_DEGREE 16
+#define PF_STRIDE_ENTRIES 64
+#define PF_STREAMS 4
+
+typedef struct Prefetch_Fill_Struct{
+	uint32_t line;
+	uint32_t ready;	/* cycle the fill arrives */
+} Prefetch_Fill;
+
+typedef struct Stride_Entry_Struct{
+	uint32_t pc;
+	uint32_t addr;	/* last address this load touched */
+	int32_t stride;
+	int confidence;	/* 0 to 3, prefetches from 2 up */
+} Stride_Entry;
+
+typedef struct Stream_Buffer_Struct{
+	Prefetch_Fill lines[PF_MAX_DEGREE];	/* oldest first */
+	int count;
+	uint32_t next;	/* next line the stream fetches */
+	uint32_t lru;
+} Stream_Buffer;
+
+int PF_MODE = PF_NONE;
+int PF_DEGREE = 1;
+int PF_DISTANCE = 1;
+Prefetch_Fill PF_MSHR[PF_MSHRS];
+int PF_MSHR_COUNT;
+Stride_Entry PF_STRIDE_TABLE[PF_STRIDE_ENTRIES];
+Stream_Buffer PF_STREAM_BUFS[PF_STREAMS];
+uint32_t PF_CLOCK;
+uint32_t PF_ISSUED, PF_DROPPED;	/* dropped: MSHRs were full */
+uint32_t PF_USEFUL, PF_LATE;	/* demand accesses a prefetch served, late ones still waited */
+uint32_t PF_USELESS;	/* prefetched lines evicted or pushed out unused */
+uint32_t PF_MISSES;	/* demand misses no prefetch covered */
+
+/***************************************************************/
+/* Decoupled front end (fetch_queue <n>, single-issue pipeline). Fetch */
+/* runs ahead of IF along the path the ooo core's bimodal predictor  */
+/* and BTB pick, up to fetch_width words a cycle, into an n-entry    */
+/* instruction queue, and keeps going while the back end is stalled. */
+/* IF takes one instruction a cycle off the queue; only mispredicted */
+/* branches redirect. icache <KB> adds a direct-mapped instruction    */
+/* cache (dcache_line lines, miss_lat misses) in front of fetch.       */
+/***************************************************************/
+#define IQ_MAX_ENTRIES 64
+#define MAX_FETCH_WIDTH 8
+
+int IQ_ENTRIES = 0;	/* 0 keeps IF fetching straight into IF/ID */
+int FETCH_WIDTH = 1;
+int ICACHE_KB = 0;
+Fetch_Entry IQ[IQ_MAX_ENTRIES];
+int IQ_HEAD, IQ_COUNT;
+uint32_t FE_PC;	/* next address the front end fetches */
+uint32_t FE_STALL;	/* cycles left on an instruction cache miss */
+uint32_t ICACHE_TAGS[CACHE_MAX_LINES];	/* line address + 1, 0 when empty */
+uint64_t IQ_OCCUPANCY;	/* summed every cycle */
+uint32_t FE_FETCHED, FE_BRANCHES, FE_MISPREDICTS;
+uint32_t ICACHE_HITS, ICACHE_MISSES;
+uint32_t FE_BOUND_CYCLES;	/* IF was ready but the queue was empty */
+uint32_t BE_BOUND_CYCLES;	/* the back end was stalled or frozen */
+
+/***************************************************************/
+/* Multicore model: one host thread per core, synchronized every quantum.        */
+/***************************************************************/
+#define MAX_CORES 16
+#define MC_QUEUE_SIZE 1024	/* messages per sender/receiver pair, power of two */
+#define MC_DIR_ENTRIES (1 << 20)	/* hashed presence-bit directory */
+#define LL_VERSIONS 4096	/* hashed store counters backing LL/SC */
+
+#define MSG_INVALIDATE 1
+#define MSG_DOWNGRADE 2
+
+typedef struct Msg_Ring_Struct{	/* single producer, single consumer */
+	_Atomic uint32_t head, tail;
+	uint32_t buf[MC_QUEUE_SIZE];	/* line address | message type */
+} Msg_Ring;
+
+typedef struct Core_Context_Struct{
+	CPU_State current, next;
+	CPU_Pipeline_Reg if_id, id_ex, ex_mem, mem_wb;
+	int stall, mem_stall;
+	uint32_t hazard_stalls, mem_stalls, flush_cycles, skipped_cycles;
+	int exit_pending;
+	int running;
+	uint32_t instructions, cycles;
+	Cache_Model dcache;
+	uint32_t ll_addr, ll_version;	/* link set by the last LL */
+	int ll_valid;
+	uint32_t msgs_sent, invalidations, sc_success, sc_fail;
+} Core_Context;
+
+int MC_CORES = 1;
+int MC_QUANTUM = 100;	/* cycles between barriers */
+Core_Context CORES[MAX_CORES];
+int MC_CORES_USED = 1;	/* cores run since the last reset, the others and the coherence state are still clear */
+Msg_Ring MC_QUEUES[MAX_CORES][MAX_CORES];	/* [receiver][sender] */
+_Atomic uint16_t MC_DIRECTORY[MC_DIR_ENTRIES];
+_Atomic uint32_t LL_VERSION[LL_VERSIONS];
+_Atomic int MC_RUNNING;	/* cores that have not exited */
+_Atomic int MC_BARRIER_COUNT;
+_Atomic int MC_BARRIER_SENSE;
+int MC_STOP;	/* written by the last core into the barrier */
+uint32_t MC_STEP;	/* cycles in the current quantum */
+uint32_t MC_REMAINING;	/* cycles left in the current run command */
+
+SIM_TLS int CORE_ID;
+
+/***************************************************************/
+/* MMU: instruction and data TLBs over a linear page table in kernel data.   */
+/* Kernel addresses (MEM_KTEXT_BEGIN and up) are unmapped.                           */
+/***************************************************************/
+#define MMU_OFF 0
+#define MMU_HW_WALK 1	/* TLB misses read the page table in hardware */
+#define MMU_SW_WALK 2	/* TLB misses trap to the refill handler at MEM_KTEXT_BEGIN */
+
+#define PAGE_SHIFT 12
+#define PAGE_TABLE_BASE MEM_KDATA_BEGIN	/* one PTE word per user page */
+#define PTE_VALID 0x2
+#define PTE_DIRTY 0x4
+#define PTE_PFN_SHIFT 6	/* EntryLo layout, PFN above the flag bits */
+#define TLB_MAX_ENTRIES 1024
+
+/* coprocessor 0 registers used by TLB refill */
+#define CP0_ENTRYLO0 2
+#define CP0_CONTEXT 4
+#define CP0_BADVADDR 8
+#define CP0_ENTRYHI 10
+#define CP0_CAUSE 13
+#define CP0_EPC 14
+
+#define EXC_TLBL 2	/* TLB miss on fetch or load */
+#define EXC_TLBS 3	/* TLB miss on store */
+
+typedef struct TLB_Entry_Struct{
+	uint32_t vpn, pfn;
+	uint32_t lru;
+	int valid;
+} TLB_Entry;
+
+typedef struct TLB_Model_Struct{
+	TLB_Entry entries[TLB_MAX_ENTRIES];
+	int *size;	/* entries option of this TLB */
+	uint32_t clock;
+	uint32_t hits, misses;
+} TLB_Model;
+
+int MMU_MODE = MMU_OFF;
+int ITLB_ENTRIES = 16;
+int DTLB_ENTRIES = 32;
+int TLB_ASSOC = 4;
+int TLB_MISS_LATENCY = 30;	/* hardware walk */
+
+TLB_Model ITLB, DTLB;
+TLB_Model *REFILL_TLB;	/* TLB that missed, written by TLBWR */
+uint32_t CP0[32];
+int EXCEPTION_TAKEN;	/* MEM raised an exception this cycle */
+int FETCH_BLOCKED;	/* a fetch fault is on its way to MEM */
+uint32_t TLB_REFILLS;	/* refill exceptions taken */
+uint32_t PAGE_FAULTS;
+
+/***************************************************************/
+/* Batched functional engine: one program over many lanes, each lane */
+/* an independent instance with its own registers, PC and HI/LO.       */
+/* Lanes share memory like hardware threads, $a0 holds the lane.      */
+/* Every instruction takes at least a cycle, so a lane that retires    */
+/* cycle_limit instructions (BATCH_INST_LIMIT without one) is cut off. */
+/***************************************************************/
+#define BATCH_MAX_LANES 256
+#define BATCH_INST_LIMIT 100000000
+#define BATCH_SCALAR 0
+#define BATCH_SSE2 1
+#define BATCH_AVX2 2
+#define BATCH_AUTO 3
+
+/* vector ALU kernels, b is a register column or an immediate */
+#define BOP_ADD 0
+#define BOP_SUB 1
+#define BOP_AND 2
+#define BOP_OR 3
+#define BOP_XOR 4
+#define BOP_NOR 5
+#define BOP_SLT 6
+#define BOP_SLL 7
+#define BOP_SRL 8
+#define BOP_SRA 9
+
+typedef struct Batch_State_Struct{
+	/* structure of arrays, one column of lanes per register */
+	uint32_t regs[MIPS_REGS][BATCH_MAX_LANES] __attribute__((aligned(32)));
+	uint32_t mask[BATCH_MAX_LANES] __attribute__((aligned(32)));	/* ~0 for lanes at the issuing PC */
+	uint32_t pc[BATCH_MAX_LANES];
+	uint32_t hi[BATCH_MAX_LANES], lo[BATCH_MAX_LANES];
+	uint32_t instructions[BATCH_MAX_LANES];
+	int live[BATCH_MAX_LANES];
+	int cut[BATCH_MAX_LANES];	/* stopped at the instruction limit, not by exit */
+} Batch_State;
+
+Batch_State BATCH;
+int BATCH_LANES;
+int BATCH_SIMD = BATCH_AUTO;	/* kernel requested by batch_simd */
+int BATCH_KERNEL;	/* kernel actually used */
+uint64_t BATCH_STEPS;	/* instructions issued for a group of lanes */
+uint64_t BATCH_LANE_INSTS;	/* instructions retired over all lanes */
+uint32_t BATCH_LIMIT;	/* instructions a lane may retire in this batch */
+
+/***************************************************************/
+/* Trace-driven timing: the pipeline timing model consumes one record */
+/* per committed instruction instead of executing it. Records come from */
+/* a trace file or from a functional engine on another host thread      */
+/* through a single producer, single consumer ring.                       */
+/***************************************************************/
+#define TRACE_RING_SIZE 4096
+#define TRACE_MAGIC 0x5452434D	/* first word of a trace file */
+#define TRACE_EXIT 0x1	/* record flag, the exit SYSCALL */
+
+typedef struct Trace_Record_Struct{
+	uint32_t pc;
+	uint32_t instruction;	/* raw word, the timing model decodes it */
+	uint32_t addr;	/* effective address of a load or store */
+	uint32_t next_pc;	/* branch outcome */
+	uint32_t flags;
+} Trace_Record;
+
+typedef struct Trace_Ring_Struct{	/* functional thread to timing model */
+	_Atomic uint32_t head, tail;
+	_Atomic int done;	/* producer pushed its last record */
+	_Atomic int stop;	/* asks the producer to quit early */
+	Trace_Record buf[TRACE_RING_SIZE];
+} Trace_Ring;
+
+char TRACE_IN[PROG_PATH_SIZE] = "-";	/* trace_in option, - runs the functional engine in process */
+char TRACE_OUT[PROG_PATH_SIZE];	/* trace_out option, file capturing the in-process trace */
+Trace_Ring TRACE_RING;
+pthread_t TRACE_THREAD;
+FILE *TRACE_IN_FP;
+FILE *TRACE_OUT_FP;
+int TRACE_STARTED;
+int TRACE_THREADED;	/* functional engine thread is running */
+CPU_State TRACE_STATE;	/* architectural state owned by the functional engine */
+uint32_t TRACE_TICK;	/* tick the next record enters EX, for the REG_READY scoreboard */
+uint32_t TRACE_WAIT;	/* cycles before the next record issues */
+int TRACE_EXITING;
+
+/***************************************************************/
+/* SimPoint: basic-block vectors collected over fixed instruction        */
+/* intervals by the functional engine, randomly projected and grouped */
+/* with k-means. The detailed model then runs one interval per phase   */
+/* from a checkpoint and CPI is rebuilt from the phase weights.          */
+/***************************************************************/
+#define SP_DIMS 15	/* random projection of the basic-block space */
+#define SP_MAX_K 32
+#define SP_ITERATIONS 100
+#define SP_SEED 0x5EED
+
+typedef struct Checkpoint_Struct{
+	CPU_State state;
+	uint32_t num_pages;
+	uint32_t *page_addr;
+	uint8_t *pages;	/* num_pages copies of MEM_PAGE_SIZE bytes */
+} Checkpoint;
+
+typedef struct SimPoint_Struct{
+	uint32_t interval;	/* interval index, in instructions / interval length */
+	double weight;	/* share of intervals in its phase */
+	Checkpoint start;
+	uint32_t instructions, cycles;	/* detailed run */
+} SimPoint;
+
+/***************************************************************/
+/* Commit fingerprints (fingerprint 1) for regression runs. Every       */
+/* instruction that commits, in WB, at the ooo ROB head or on the        */
+/* functional engine, is folded into a rolling hash: its PC, the       */
+/* register it wrote and the value, and for stores the address and   */
+/* the aligned word left in memory. The state hash covers the final  */
+/* registers and every touched page. commit_log <file> also writes one */
+/* line per commit so two runs can be compared for the first divergence. */
+/***************************************************************/
+#define FP_SEED 0xCBF29CE484222325ULL	/* FNV-1a offset basis */
+#define FP_PRIME 0x100000001B3ULL
+
+int FINGERPRINT = FALSE;
+uint64_t COMMIT_HASH;
+uint32_t COMMIT_COUNT;
+FILE *COMMIT_LOG_FP;
+
+/***************************************************************/
+/* Lockstep checker (lockstep 1). A functional model steps over each   */
+/* instruction as the pipeline or the ooo core commits it and compares */
+/* the effects: the PC, the value written to the destination register, */
+/* and for stores the address and the bytes left in memory. Loads read */
+/* the shared memory, which holds exactly the older stores at commit. */
+/* The whole register file is compared every LS_SWEEP commits and at  */
+/* the exit, to catch writes to a register the instruction does not   */
+/* name. Device loads are not replayed, the model takes the value the  */
+/* core read. The run stops at the first difference.                   */
+/***************************************************************/
+#define LS_SWEEP 4096
+
+int LOCKSTEP = FALSE;
+CPU_State LS_STATE;	/* state of the functional model */
+uint32_t LS_CHECKED;	/* commits compared so far */
+int LS_FAILED;	/* a mismatch stopped the run */
+
+/***************************************************************/
+/* Devices at MMIO_BEGIN. The console sends what programs store to    */
+/* TX_DATA to console_out (stdout by default) in blocks of             */
+/* CONSOLE_BUF_SIZE bytes, flushed when a run returns, and reads      */
+/* RX_DATA from console_in. A load takes the RX byte only where it     */
+/* commits (MEM, the ooo ROB head, the functional engine), so          */
+/* speculative and lockstep reads see it without taking it. Regions  */
+/* of interest accumulate the counters between a store of 1 and a     */
+/* store of 0 to MMIO_ROI, so stats can leave out the loader and setup.*/
+/* The trace and interval cores run the program ahead on another      */
+/* thread, so there CYCLES and INSTS read 0 and regions are not kept.  */
+/* host_pipe runs device accesses in MEM on the main thread instead.  */
+/***************************************************************/
+#define CONSOLE_BUF_SIZE 4096
+
+char CONSOLE_TX[CONSOLE_BUF_SIZE];
+uint32_t CONSOLE_TX_LEN;
+uint32_t CONSOLE_TX_BYTES;	/* sent since reset */
+FILE *CONSOLE_OUT_FP;	/* NULL for stdout */
+FILE *CONSOLE_IN_FP;	/* NULL for no input */
+int CONSOLE_RX_NEXT;	/* the waiting byte, -1 if none */
+pthread_mutex_t CONSOLE_LOCK = PTHREAD_MUTEX_INITIALIZER;	/* core threads share the console */
+
+typedef struct Roi_Counters_Struct {
+	uint32_t cycles, instructions;
+	uint32_t hazard_stalls, mem_stalls, flush_cycles;
+} Roi_Counters;
+
+SIM_TLS int ROI_OPEN;
+SIM_TLS uint32_t ROI_REGIONS;	/* regions opened since reset */
+SIM_TLS Roi_Counters ROI_START;	/* counters when the open region began */
+SIM_TLS Roi_Counters ROI_TOTAL;	/* closed regions */
+
+/***************************************************************/
+/* Stack distance profile (stack_dist 1, pipeline core). Every fetch in */
+/* IF and every load and store in MEM goes to a profiler per stream.   */
+/* The LRU stack distance of an access is the number of other lines     */
+/* used since the last use of its line: a Fenwick tree over access times */
+/* marks each line's latest access and a hash table maps lines to it,   */
+/* so one run gives the fully associative LRU miss ratio of every size  */
+/* in O(log n) per access. Distances only hold for full associativity, */
+/* so a dcache_assoc-way LRU cache per power of two size runs alongside. */
+/* Lines are dcache_line bytes, and the lines touched in each window  */
+/* of sd_window cycles give the working set over time.                  */
+/***************************************************************/
+#define SD_BUCKETS 33	/* stack distance 0, 1, 2-3, 4-7, ... */
+#define SD_MAX_LOG 18	/* largest size profiled, 2^18 lines */
+#define SD_MIN_TREE 4096	/* access times before the first renumbering */
+
+typedef struct Sd_Entry_Struct{
+	uint32_t line;	/* line address + 1, 0 when empty */
+	uint32_t time;	/* latest access */
+	uint32_t window;	/* working set window of the latest access */
+} Sd_Entry;
+
+typedef struct Sd_Profile_Struct{
+	Sd_Entry *table;	/* open addressing, at most half full */
+	uint32_t table_size, lines;	/* slots, distinct lines */
+	uint32_t *tree;	/* Fenwick tree over times 1..tree_size */
+	uint32_t tree_size, now;	/* now is the latest time used */
+	uint64_t hist[SD_BUCKETS];	/* accesses by stack distance */
+	uint64_t accesses, cold;
+	uint32_t *ways[SD_MAX_LOG + 1];	/* tags + 1 of the 2^k line cache, most recent first in each set */
+	uint64_t misses[SD_MAX_LOG + 1];
+	uint32_t window, window_lines;	/* current window and the lines touched in it */
+	uint32_t *ws;	/* lines touched in each finished window */
+	uint32_t ws_count, ws_size;
+} Sd_Profile;
+
+int STACK_DIST = 0;
+int SD_WINDOW = 10000;	/* cycles */
+FILE *SD_OUT_FP;	/* working set series and curves, written by stats */
+Sd_Profile SD_INST, SD_DATA;
+
+/***************************************************************/
+/* Trace export (din_out, branch_out <file|->, pipeline core). Fetches */
+/* in IF and loads and stores in MEM go out as Dinero din lines (label */
+/* 2, 0 or 1 and the hex address), branches resolved in EX as 8-byte     */
+/* binary records. Records fill a buffer, full buffers go to a writer   */
+/* thread per file, and a name ending in .gz is piped through gzip, so */
+/* the simulator only waits when the writer falls behind. Files are    */
+/* complete when a run command returns.                                       */
+/***************************************************************/
+#define EXPORT_BUF_SIZE (1 << 20)
+#define EXPORT_BUFS 4	/* per stream, one filling and the rest queued for the writer */
+#define EXPORT_POLL_US 100	/* writer sleep with nothing queued */
+#define BRANCH_MAGIC 0x5242434D	/* first word of a branch trace */
+#define BRANCH_TAKEN 0x1	/* flags in the low bits of a record's PC */
+#define BRANCH_UNCOND 0x2	/* J, JAL, JR, JALR */
+
+typedef struct Branch_Record_Struct{	/* little endian */
+	uint32_t pc;	/* branch address | BRANCH_TAKEN | BRANCH_UNCOND */
+	uint32_t target;	/* taken target, also when not taken; where a jump went */
+} Branch_Record;
+
+typedef struct Export_Stream_Struct{
+	char *buf[EXPORT_BUFS];
+	uint32_t len[EXPORT_BUFS];	/* bytes handed over in each buffer */
+	_Atomic uint32_t head, tail;	/* buffers written, buffers handed over */
+	_Atomic int quit;
+	uint32_t fill;	/* bytes in buffer tail % EXPORT_BUFS */
+	FILE *fp;	/* NULL when off */
+	int piped;	/* fp is a gzip pipe */
+	pthread_t thread;
+	uint64_t records, bytes;
+} Export_Stream;
+
+Export_Stream DIN_OUT, BRANCH_OUT;
+
+/***************************************************************/
+/* GDB remote stub (gdb <port>, before the first cycle). Serves one     */
+/* gdb connection on 127.0.0.1 and runs the program on the functional */
+/* engine between stops, so continue goes at full speed. Breakpoints  */
+/* and watchpoints are matched by the stub and memory is never patched. */
+/* Registers follow gdb's 32-bit MIPS numbering, little endian.          */
+/***************************************************************/
+#define GDB_MAX_POINTS 64
+#define GDB_PACKET_SIZE 4096
+#define GDB_POLL_STEPS 65536	/* instructions between checks for a ^C */
+#define GDB_NUM_REGS 38	/* r0-r31, sr, lo, hi, bad, cause, pc */
+
+typedef struct Gdb_Point_Struct{
+	int type;	/* Z packet type: 0 or 1 breakpoint, 2 write, 3 read, 4 access watchpoint */
+	uint32_t addr, len;
+} Gdb_Point;
+
+int GDB_FD = -1;
+int GDB_NO_ACK;	/* gdb asked for QStartNoAckMode */
+Gdb_Point GDB_POINTS[GDB_MAX_POINTS];
+int GDB_NUM_POINTS;
+char GDB_INBUF[GDB_PACKET_SIZE];
+int GDB_IN_LEN, GDB_IN_POS;
+
+/***************************************************************/
+/* Simulation server (daemon <socket> <workers>, before the first cycle). */
+/* Listens on a Unix socket, one job per connection. A job starts with */
+/* the line "job <program> [<option>=<val> ...]", the rest of the          */
+/* connection is its command stream and the output streams back. Each */
+/* job runs in a fork of the idle simulator, so it starts from this     */
+/* process' options with memory already set up, and at most <workers>  */
+/* run at once, later connections wait in the listen queue. Programs  */
+/* are parsed once and kept until their file changes. "shutdown" stops */
+/* the server once the running jobs finish.                                     */
+/***************************************************************/
+#define SERVER_MAX_WORKERS 64
+#define SERVER_LINE_SIZE 1024
+#define SERVER_HEADER_SECONDS 5	/* to send the job line */
+#define IMAGE_CACHE_SIZE 64
+
+typedef struct Program_Image_Struct{
+	char file[PROG_PATH_SIZE];
+	time_t mtime;
+	off_t size;
+	uint32_t *words;
+	uint32_t num_words;
+	uint32_t hits;
+} Program_Image;
+
+typedef struct Server_Job_Struct{
+	pid_t pid;	/* 0 when the slot is free */
+	uint32_t id;
+	char file[PROG_PATH_SIZE];
+} Server_Job;
+
+Program_Image IMAGES[IMAGE_CACHE_SIZE];
+int NUM_IMAGES;
+int IMAGE_NEXT_EVICT;
+int SERVER_FD = -1;
+Server_Job SERVER_JOBS[SERVER_MAX_WORKERS];
+uint32_t SERVER_JOBS_RUN, SERVER_JOBS_FAILED;
 
-char prog_file[32];
+char prog_file[PROG_PATH_SIZE];
 
 
 /***************************************************************/
@@ -89,14 +937,25 @@ void help();
 uint32_t mem_read_32(uint32_t address);
 void mem_write_32(uint32_t address, uint32_t value);
 void cycle();
+uint32_t limit_cycles(uint32_t budget);
 void run(int num_cycles);
 void runAll();
 void mdump(uint32_t start, uint32_t stop) ;
 void rdump();
 void handle_command();
+int scan_path(char *path);
 void reset();
+void mem_clear();
+uint32_t cycle_skip(uint32_t budget);
+void pipe_start();
+void pipe_stop();
+void pipe_wait(_Atomic uint32_t *flag, uint32_t value);
+void *pipe_mem_main(void *arg);
+void pipe_cycle();
+uint8_t *mem_page(uint32_t address);
 void init_memory();
 void load_program();
+uint32_t load_program_file(char *file, uint32_t base);
 void handle_pipeline(); /*IMPLEMENT THIS*/
 void WB();/*IMPLEMENT THIS*/
 void MEM();/*IMPLEMENT THIS*/
@@ -104,6 +963,187 @@ void EX();/*IMPLEMENT THIS*/
 void ID();/*IMPLEMENT THIS*/
 void IF();/*IMPLEMENT THIS*/
 void show_pipeline();/*IMPLEMENT THIS*/
+void handle_pipeline_dual();
+int ID_dual();
+void IF_dual(int paired);
+void swap_slot_latches();
+void insert_bubble(CPU_Pipeline_Reg *reg);
+uint32_t forward_value(uint32_t reg);
+void forward_operands(CPU_Pipeline_Reg *reg);
+void pipeline_branch();
+void decode_instruction(uint32_t instruction, Decoded_Inst *d);
+int load_use_hazard(Decoded_Inst *d);
+void pipe_reset();
+uint32_t pipe_hazard(Decoded_Inst *d, uint32_t tick);
+void pipe_produce(Decoded_Inst *d, uint32_t tick);
+void print_pipe_shape();
+int can_pair(Decoded_Inst *d0, Decoded_Inst *d1);
+uint32_t alu_compute(Decoded_Inst *d, uint32_t pc, uint32_t a, uint32_t b, uint32_t *hi, uint32_t *lo);
+uint32_t branch_resolve(Decoded_Inst *d, uint32_t pc, uint32_t a, uint32_t b);
+uint32_t extract_load(Decoded_Inst *d, uint32_t addr, uint32_t word);
+uint32_t load_data(Decoded_Inst *d, uint32_t addr);
+uint32_t merge_store(Decoded_Inst *d, uint32_t addr, uint32_t word, uint32_t value);
+void store_data(Decoded_Inst *d, uint32_t addr, uint32_t value);
+void ooo_reset();
+void ooo_cycle();
+void ooo_commit();
+void ooo_execute();
+void ooo_memory();
+void ooo_issue();
+void ooo_dispatch();
+void ooo_fetch();
+void ooo_broadcast(int rob, uint32_t value, uint32_t hi, uint32_t lo);
+void ooo_recover(int rob);
+int ooo_fu_class(Decoded_Inst *d);
+int ooo_rob_age(int rob);
+void ooo_read_operand(uint32_t reg, uint32_t *value, int *tag);
+uint32_t ooo_predict(uint32_t pc, uint32_t instruction);
+void ooo_train(uint32_t pc, Decoded_Inst *d, uint32_t next_pc);
+void print_ooo_stats();
+void mt_reset();
+void switch_thread(int t);
+void handle_pipeline_mt();
+int ID_mt();
+int select_fetch_thread(int blocked);
+void mt_park(int t, int cycles);
+void load_thread_program(int t, char *file);
+void print_mt_stats();
+int check_config();
+int dcache_access(uint32_t addr, int write);
+Cache_Line *dcache_lookup(uint32_t line);
+void dcache_reset();
+Cache_Line *dcache_fill(uint32_t line, int write);
+void mem_access_timing(uint32_t pc, uint32_t addr, int write);
+int mc_acquire(uint32_t line, int write);
+uint32_t load_linked(uint32_t addr);
+uint32_t store_conditional(uint32_t addr, uint32_t value);
+void store_word(Decoded_Inst *d, uint32_t addr, uint32_t value);
+void mc_reset();
+void mc_run(uint32_t num_cycles);
+void *mc_core_main(void *arg);
+void mc_load_core(int c);
+void mc_save_core(int c);
+void mc_send(int to, uint32_t line, uint32_t type);
+void mc_handle_message(uint32_t msg);
+void mc_poll_messages();
+void mc_barrier(int *sense);
+void print_cache_stats();
+void pf_reset();
+int pf_access(uint32_t pc, uint32_t addr, int write);
+void pf_issue(uint32_t line);
+void pf_complete();
+int pf_claim(uint32_t line, int write);
+void pf_train(uint32_t pc, uint32_t addr, int miss, int used);
+void pf_stream_fill(Stream_Buffer *s);
+void print_pf_stats();
+void fe_reset();
+void fe_fetch();
+void fe_redirect(uint32_t pc);
+void fe_deliver();
+void print_fe_stats();
+void sb_reset();
+void sb_tick();
+uint32_t sb_store(uint32_t addr);
+uint32_t sb_load(uint32_t pc, uint32_t addr);
+void print_sb_stats();
+void print_mc_stats();
+void cdump(int c);
+void mmu_reset();
+int mmu_translate(TLB_Model *tlb, uint32_t *addr);
+TLB_Entry *tlb_victim(TLB_Model *tlb, uint32_t vpn);
+void tlb_write(TLB_Model *tlb, uint32_t vpn, uint32_t entrylo);
+void take_exception(uint32_t cause, uint32_t epc, uint32_t badvaddr);
+void flush_for_exception();
+void print_mmu_stats();
+void set_option(char *name, char *value);
+double host_time();
+uint64_t prof_ticks();
+void prof_record(int slot, uint64_t ticks);
+void print_profile();
+void print_host_stats();
+void print_stats();
+void stats_open();
+void stats_close();
+void stats_publish(uint32_t state);
+void batch_run(int lanes, char *file);
+int batch_step();
+int batch_vector_op(Decoded_Inst *d, int *op, uint32_t **a, uint32_t **b, uint32_t *imm);
+void batch_kernel(int op, uint32_t *dst, uint32_t *a, uint32_t *b, uint32_t imm);
+void batch_kernel_scalar(int op, uint32_t *dst, uint32_t *a, uint32_t *b, uint32_t imm);
+void batch_kernel_sse2(int op, uint32_t *dst, uint32_t *a, uint32_t *b, uint32_t imm);
+void batch_kernel_avx2(int op, uint32_t *dst, uint32_t *a, uint32_t *b, uint32_t imm);
+void batch_dump(int lane);
+int func_step(CPU_State *state, Trace_Record *rec);
+void *trace_producer(void *arg);
+int trace_start();
+int trace_next(Trace_Record *rec);
+void trace_finish();
+void trace_reset();
+void trace_cycle();
+uint32_t record_penalty(Trace_Record *rec);
+void interval_run(uint32_t num_cycles);
+void checkpoint_save(Checkpoint *cp);
+void checkpoint_restore(Checkpoint *cp);
+void checkpoint_free(Checkpoint *cp);
+uint32_t sp_hash(uint32_t x);
+void sp_add_block(float *vec, uint32_t leader, uint32_t count);
+float sp_distance(float *a, float *b);
+int sp_kmeans(float *vecs, int n, int k, int *cluster, float *cent);
+void simpoint_run(uint32_t interval, int k, char *file);
+uint64_t fp_mix(uint64_t hash, uint32_t word);
+void commit_hash(uint32_t pc, Decoded_Inst *d, uint32_t value, uint32_t addr);
+uint64_t state_hash();
+void print_fingerprint();
+void func_run(uint32_t num_instructions);
+void lockstep_reset();
+void lockstep_check(uint32_t pc, Decoded_Inst *d, uint32_t value, uint32_t addr);
+void lockstep_fail(uint32_t pc, const char *what, uint32_t want, uint32_t got);
+uint32_t mmio_read(uint32_t address);
+void mmio_write(uint32_t address, uint32_t value);
+void mmio_consume(uint32_t address);
+void console_reset();
+void console_flush();
+void roi_counters(Roi_Counters *c);
+void print_roi_stats();
+void gdb_serve(int port);
+int gdb_getc();
+int gdb_recv_packet(char *buf);
+void gdb_send_packet(const char *data);
+uint32_t gdb_reg_read(int n);
+void gdb_reg_write(int n, uint32_t value);
+int gdb_handle_packet(char *pkt, char *reply);
+void gdb_resume(int step, char *reply);
+int gdb_point(int type, uint32_t addr, uint32_t len, int insert);
+void sd_reset(Sd_Profile *p);
+void sd_access(Sd_Profile *p, uint32_t addr);
+uint32_t sd_distance(Sd_Profile *p, uint32_t time);
+void sd_mark(Sd_Profile *p, uint32_t time, int delta);
+int sd_time_order(const void *a, const void *b);
+void sd_renumber(Sd_Profile *p);
+Sd_Entry *sd_lookup(Sd_Profile *p, uint32_t line);
+void sd_cache_access(Sd_Profile *p, uint32_t line);
+void sd_window_close(Sd_Profile *p, uint32_t window);
+uint64_t sd_fa_misses(Sd_Profile *p, int k);
+uint32_t sd_window_lines(Sd_Profile *p, uint32_t w);
+double sd_ratio(Sd_Profile *p, uint64_t misses);
+void print_sd_stats();
+int export_open(Export_Stream *s, char *file);
+void export_close(Export_Stream *s);
+void export_close_all();
+void export_flush(Export_Stream *s);
+void export_handover(Export_Stream *s);
+void export_write(Export_Stream *s, const void *data, uint32_t n);
+void *export_main(void *arg);
+void export_din(int label, uint32_t addr);
+void export_branch(uint32_t pc, Decoded_Inst *d, uint32_t next_pc);
+void print_export_stats();
+Program_Image *image_find(char *file);
+Program_Image *image_load(char *file);
+void server_run(char *path, int workers);
+int server_read_line(int fd, char *buf, int size);
+void server_reap(int block);
+void server_job(int fd, uint32_t id, char *line, char *file);
+void server_timeout(int sig);
 void initialize();
 void print_program(); /*IMPLEMENT THIS*/
 void print_instruction(uint32_t);